@@ -88,7 +88,9 @@ void conv_word(
 
 // -----------------------------------------------------------------------
 // Process each line in a word, we need to outline this loop to
-// avoid false control dependencies in Vivado HLS
+// avoid false control dependencies in Vivado HLS. The line buffer only
+// depends on the input, so the filters of all n_par outputs of the pass
+// are applied to it.
 // -----------------------------------------------------------------------
 void process_word(
     const TwoBit  word_buffer_m[CONV_BANKS][CONV_COLS],
@@ -96,11 +98,12 @@ void process_word(
     const bool lb[CONV_BANKS],
     const bool rb[CONV_BANKS],
     TwoBit  line_buffer_m[CONV_BANKS][CONV_ROWS][CONV_COLS],
-    const   Bit conv_params_m[K][K],
-    ConvOut conv_out_buffer_m[WORD_SIZE],
+    const   Bit conv_params_m[CONV_OUT_PAR][K][K],
+    ConvOut conv_out_buffer_m[CONV_OUT_PAR][WORD_SIZE],
     const   ap_uint<3> log_width,
     const   ap_uint<6> words_per_image,
-    const   IdxType wrd
+    const   IdxType wrd,
+    const   IdxType n_par
 ) {
   // slices_per_line = width / BANK_WIDTH
   const ap_uint<5> slices_per_line = 1 << (log_width - LOG_BANK_WIDTH);
@@ -135,7 +138,10 @@ void process_word(
   );
 
   // Convolution
-  conv_word( line_buffer_m, conv_params_m, conv_out_buffer_m );
+  for (IdxType j = 0; j < CONV_OUT_PAR; ++j) {
+    if (j < n_par)
+      conv_word( line_buffer_m, conv_params_m[j], conv_out_buffer_m[j] );
+  }
   
   // Update
   // Fill line buffer with lines from the new word
@@ -176,18 +182,20 @@ void process_word(
 }
 
 // -----------------------------------------------------------------------
-// A single PE reads from all inputs and weights to generate a single
-// output feature map.
+// A single PE reads from all inputs and weights to generate n_par
+// (at most CONV_OUT_PAR) output feature maps, o_index .. o_index+n_par-1.
+// Each input word is loaded and encoded once for all of them.
 // * Make sure this function gets inlined by VHLS, or cosim may fail!
 // -----------------------------------------------------------------------
 void bin_conv(
     Word wt_mem[CONVOLVERS][C_WT_WORDS],
-    NormComp nc,
+    const NormComp nc[CONV_OUT_PAR],
     Word dmem[2][CONVOLVERS][C_DMEM_WORDS],
     ap_uint<1> d_i_idx,
     ap_uint<1> d_o_idx,
     const unsigned   n_inputs,
     const Address    o_index,
+    const IdxType    n_par,
     const ap_uint<1> new_batch,
     const ap_uint<2> width_mode,  // 0=8'b, 1=16'b, 2=32'b
     const ap_uint<2> norm_mode    // 0='do nothing', 1='do norm', 2='do pool'
@@ -201,18 +209,19 @@ void bin_conv(
   assert(n_phases % images_per_phase == 0);
   assert(n_inputs % images_per_phase == 0);
   assert(images_per_phase*words_per_image == WORDS_PER_PHASE);
+  assert(n_par > 0 && n_par <= CONV_OUT_PAR);
 
   // ---------------------------------------------------------------------
   // buffers
   // ---------------------------------------------------------------------
   TwoBit  line_buffer[CONVOLVERS][CONV_BANKS][CONV_ROWS][CONV_COLS];
-  Bit     conv_params[CONVOLVERS][K][K];
-  ConvSum fixed_buffer[WORDS_PER_PHASE][WORD_SIZE];
+  Bit     conv_params[CONVOLVERS][CONV_OUT_PAR][K][K];
+  ConvSum fixed_buffer[CONV_OUT_PAR][WORDS_PER_PHASE][WORD_SIZE];
   ConvSum fixed_temp[WORD_SIZE];
   // per-convolver buffers
   TwoBit  word_buffer[CONVOLVERS][CONV_BANKS][CONV_COLS];
   TwoBit  old_word_buffer[CONVOLVERS][CONV_BANKS][CONV_COLS];
-  ConvOut conv_out_buffer[CONVOLVERS][WORD_SIZE];
+  ConvOut conv_out_buffer[CONVOLVERS][CONV_OUT_PAR][WORD_SIZE];
   // edge padding flag bits
   bool lb[CONV_BANKS];
   bool rb[CONV_BANKS];
@@ -221,6 +230,23 @@ void bin_conv(
   static ap_uint<3> wt_offset = 0;      // offset 0..6 of param
   if (new_batch != 0) { wt_addr = 0; wt_offset = 0; }
 
+  // ---------------------------------------------------------------------
+  // Each output takes one param from every convolver per n_phases
+  // loads, so the params of output o_index+j start j*n_phases params
+  // after those of output o_index
+  Address    wt_addr_j[CONV_OUT_PAR];
+  ap_uint<3> wt_offset_j[CONV_OUT_PAR];
+  for (IdxType j = 0; j < CONV_OUT_PAR; ++j) {
+    const unsigned wt_idx = wt_addr*CONV_W_PER_WORD + wt_offset + j*n_phases;
+    wt_addr_j[j] = wt_idx / CONV_W_PER_WORD;
+    wt_offset_j[j] = wt_idx % CONV_W_PER_WORD;
+  }
+  {
+    const unsigned wt_idx = wt_addr*CONV_W_PER_WORD + wt_offset + n_par*n_phases;
+    wt_addr = wt_idx / CONV_W_PER_WORD;
+    wt_offset = wt_idx % CONV_W_PER_WORD;
+  }
+
   // ---------------------------------------------------------------------
   // Calculate edge padding flag bits
   const ap_uint<4> log_slice = log_width - LOG_BANK_WIDTH;
@@ -237,10 +263,12 @@ void bin_conv(
 
   // ---------------------------------------------------------------------
   // Reset conv buffer
-  for (IdxType i = 0; i < WORDS_PER_PHASE; ++i) {
-    for (IdxType j = 0; j < WORD_SIZE; ++j) {
-      #pragma HLS UNROLL
-      fixed_buffer[i][j] = 0;
+  for (IdxType j = 0; j < CONV_OUT_PAR; ++j) {
+    for (IdxType i = 0; i < WORDS_PER_PHASE; ++i) {
+      for (IdxType b = 0; b < WORD_SIZE; ++b) {
+        #pragma HLS UNROLL
+        fixed_buffer[j][i][b] = 0;
+      }
     }
   }
 
@@ -265,29 +293,33 @@ void bin_conv(
     for (ap_uint<8> count = 0; count < WORDS_PER_PHASE+images_per_phase; ++count) {
       // First word of an image
       if (wrd == 0) {
-        Word wt_word_buffer[CONVOLVERS];
+        Word wt_word_buffer[CONVOLVERS][CONV_OUT_PAR];
 
         // -------------------------------------------------------------------
-        // Load param word
+        // Load param word of every output
         // Each word contains CONV_W_PER_WORD weight filters, after we use
         // them all we should load the next word
         // -------------------------------------------------------------------
         LOOP_WT_WORDS:
-        for (IdxType m = 0; m < CONVOLVERS; ++m) {
-          /*if (wt_offset == 0)
-            wt_word_buffer[m] = wt_mem[m][wt_addr];
-          else
-            wt_word_buffer[m] = wt_word_buffer[m] >> WT_SIZE;
-          */
-          wt_word_buffer[m] = wt_mem[m][wt_addr] >> ap_uint<6>(WT_SIZE*wt_offset);
-        }
-        if (wt_offset == CONV_W_PER_WORD-1) {
-          ++wt_addr;
-          wt_offset = 0;
-        } else {
-          ++wt_offset;
+        for (IdxType j = 0; j < CONV_OUT_PAR; ++j) {
+          if (j >= n_par)
+            continue;
+          for (IdxType m = 0; m < CONVOLVERS; ++m) {
+            /*if (wt_offset == 0)
+              wt_word_buffer[m][j] = wt_mem[m][wt_addr];
+            else
+              wt_word_buffer[m][j] = wt_word_buffer[m][j] >> WT_SIZE;
+            */
+            wt_word_buffer[m][j] = wt_mem[m][wt_addr_j[j]] >> ap_uint<6>(WT_SIZE*wt_offset_j[j]);
+          }
+          if (wt_offset_j[j] == CONV_W_PER_WORD-1) {
+            ++wt_addr_j[j];
+            wt_offset_j[j] = 0;
+          } else {
+            ++wt_offset_j[j];
+          }
         }
-        //print_wt_word(wt_word_buffer[0]);
+        //print_wt_word(wt_word_buffer[0][0]);
 
         // -------------------------------------------------------------------
         // Load params
@@ -296,13 +328,26 @@ void bin_conv(
         // -------------------------------------------------------------------
         LOOP_LOAD_WTS:
         for (IdxType m = 0; m < CONVOLVERS; ++m) {
-          for (ap_uint<2> kr = 0; kr < K; ++kr) {
-            for (ap_uint<2> kc = 0; kc < K; ++kc)
-              conv_params[m][kr][kc] = wt_word_buffer[m][kr*K+kc];
+          for (IdxType j = 0; j < CONV_OUT_PAR; ++j) {
+            if (j >= n_par)
+              continue;
+            for (ap_uint<2> kr = 0; kr < K; ++kr) {
+              for (ap_uint<2> kc = 0; kc < K; ++kc)
+                conv_params[m][j][kr][kc] = wt_word_buffer[m][j][kr*K+kc];
+            }
           }
         }
 
-        DB(3, print_params(conv_params) );
+        DB(3,
+          for (IdxType j = 0; j < n_par; ++j) {
+            Bit params_j[CONVOLVERS][K][K];
+            for (IdxType m = 0; m < CONVOLVERS; ++m)
+              for (ap_uint<2> kr = 0; kr < K; ++kr)
+                for (ap_uint<2> kc = 0; kc < K; ++kc)
+                  params_j[m][kr][kc] = conv_params[m][j][kr][kc];
+            print_params(params_j);
+          }
+        );
       }
 
       // -------------------------------------------------------------------
@@ -331,7 +376,7 @@ void bin_conv(
       for (IdxType m = 0; m < CONVOLVERS; ++m) {
         // Do the following for each word in an image
         process_word( word_buffer[m], old_word_buffer[m], lb, rb, line_buffer[m], conv_params[m],
-            conv_out_buffer[m], log_width, words_per_image, wrd );
+            conv_out_buffer[m], log_width, words_per_image, wrd, n_par );
       } // CONVOLVERS
 
       for (IdxType m = 0; m < CONVOLVERS; ++m) {
@@ -344,13 +389,15 @@ void bin_conv(
       // -------------------------------------------------------------------
       // Sum results across convolvers
       // -------------------------------------------------------------------
-      for (IdxType i = 0; i < WORD_SIZE; ++i) {
-        // Ignore conv results after processing the first word
-        if (wrd > 0) {
-          ConvSum s = 0;
-          for (IdxType m = 0; m < CONVOLVERS; ++m)
-            s += conv_out_buffer[m][i];
-          fixed_buffer[wrd_phase-1][i] += s;
+      for (IdxType j = 0; j < CONV_OUT_PAR; ++j) {
+        for (IdxType i = 0; i < WORD_SIZE; ++i) {
+          // Ignore conv results after processing the first word
+          if (wrd > 0 && j < n_par) {
+            ConvSum s = 0;
+            for (IdxType m = 0; m < CONVOLVERS; ++m)
+              s += conv_out_buffer[m][j][i];
+            fixed_buffer[j][wrd_phase-1][i] += s;
+          }
         }
       }
 
@@ -367,86 +414,96 @@ void bin_conv(
 
   } // n_phases
 
-  LOOP_ACC_PHASES:
-  for (ap_uint<5> w = 0; w < words_per_image; ++w) {
-    for (IdxType b = 0; b < WORD_SIZE; ++b) {
-      #pragma HLS unroll
-      fixed_temp[b] = fixed_buffer[w][b];
-    }
-
-    LOOP_ACC_PHASES_I:
-    for (ap_uint<8> i = words_per_image; i < WORDS_PER_PHASE; i += words_per_image) {
+  // ---------------------------------------------------------------------
+  // Accumulate and normalize the outputs in order, the 8x8 pooled
+  // outputs are packed across consecutive outputs
+  // ---------------------------------------------------------------------
+  LOOP_OUT_PAR:
+  for (IdxType j = 0; j < CONV_OUT_PAR; ++j) {
+    if (j >= n_par)
+      continue;
+    const Address o = o_index + j;
+    LOOP_ACC_PHASES:
+    for (ap_uint<5> w = 0; w < words_per_image; ++w) {
       for (IdxType b = 0; b < WORD_SIZE; ++b) {
-        fixed_temp[b] += fixed_buffer[w+i][b];
-    } }
+        #pragma HLS unroll
+        fixed_temp[b] = fixed_buffer[j][w][b];
+      }
 
-    for (IdxType b = 0; b < WORD_SIZE; ++b) {
-      #pragma HLS unroll
-      fixed_buffer[w][b] = fixed_temp[b];
-    }
-  }
+      LOOP_ACC_PHASES_I:
+      for (ap_uint<8> i = words_per_image; i < WORDS_PER_PHASE; i += words_per_image) {
+        for (IdxType b = 0; b < WORD_SIZE; ++b) {
+          fixed_temp[b] += fixed_buffer[j][w+i][b];
+      } }
 
-  const Address bank_idx = o_index % CONVOLVERS;
-  const Address bank_off = o_index / CONVOLVERS;
-  const ap_uint<5> pool_width = 1 << (log_width-1);
-  DB(4,
-    unsigned width = 1 << log_width;
-    printf ("=== conv result ===\n");
-    print_mat(fixed_buffer[0], width, 8, width);
-  );
-  DB_PRINT(2, "  o_idx=%3d: nc=%6d\n", o_index.to_int(), nc.to_int());
-
-  static Word outword;
-  Word poolword;
-  LOOP_BATCH_NORM:
-  for (ap_uint<6> w = 0; w < words_per_image; ++w) {
-    Word binword;
-    Address o_bank_idx = bank_idx;
-    Address o_bank_offset = bank_off*words_per_image + w;
-    const ap_uint<6> out_offset = (w % 4) << 4;
-
-    for (ap_uint<7> i = 0; i < WORD_SIZE; ++i) {
-      binword[i] = (fixed_buffer[w][i] >= nc) ? 0 : 1;
+      for (IdxType b = 0; b < WORD_SIZE; ++b) {
+        #pragma HLS unroll
+        fixed_buffer[j][w][b] = fixed_temp[b];
+      }
     }
 
-    if (norm_mode == 1) {
-      outword = binword;
-    }
-    else if (norm_mode == 2) {
-      // horizontal pooling first
-      ap_int<WORD_SIZE/2> poolword_h;
-      for (ap_uint<6> i = 0; i < WORD_SIZE/2; ++i) {
-        poolword_h[i] = binword[2*i] & binword[2*i+1];
+    const Address bank_idx = o % CONVOLVERS;
+    const Address bank_off = o / CONVOLVERS;
+    const ap_uint<5> pool_width = 1 << (log_width-1);
+    DB(4,
+      unsigned width = 1 << log_width;
+      printf ("=== conv result ===\n");
+      print_mat(fixed_buffer[j][0], width, 8, width);
+    );
+    DB_PRINT(2, "  o_idx=%3d: nc=%6d\n", o.to_int(), nc[j].to_int());
+
+    static Word outword;
+    Word poolword;
+    LOOP_BATCH_NORM:
+    for (ap_uint<6> w = 0; w < words_per_image; ++w) {
+      Word binword;
+      Address o_bank_idx = bank_idx;
+      Address o_bank_offset = bank_off*words_per_image + w;
+      const ap_uint<6> out_offset = (w % 4) << 4;
+
+      for (ap_uint<7> i = 0; i < WORD_SIZE; ++i) {
+        binword[i] = (fixed_buffer[j][w][i] >= nc[j]) ? 0 : 1;
       }
 
-      // vertical pooling
-      for (ap_uint<6> i = 0; i < WORD_SIZE/4; ++i) {
-        // source indices
-        ap_uint<5> i0 = i >> (log_width-1);
-        i0 = (i0 << log_width) + i(log_width-2,0);
-        ap_uint<5> i1 = i0 + pool_width;
-        // dest index
-        ap_uint<6> d0 = out_offset + i;
-        poolword[d0] = poolword_h[i0] & poolword_h[i1];
+      if (norm_mode == 1) {
+        outword = binword;
       }
+      else if (norm_mode == 2) {
+        // horizontal pooling first
+        ap_int<WORD_SIZE/2> poolword_h;
+        for (ap_uint<6> i = 0; i < WORD_SIZE/2; ++i) {
+          poolword_h[i] = binword[2*i] & binword[2*i+1];
+        }
 
-      // For log_width > 3 we can just assign the word, but log_width = 3 means width = 8,
-      // which means pooled width = 4, which is only 16 bits, which is less than 1 Word.
-      // So each time we get here we only have 16 bits, meaning we have to accumulate four
-      // of these 16-bit batches before writing a word out.
-      if (log_width != LOG_BANK_WIDTH) {
-        o_bank_offset /= 4;
-        outword = poolword;
-      } else {
-        outword = outword >> WORD_SIZE/4;
-        outword(63,48) = poolword(15,0);
-        o_bank_idx = (o_index/4)%CONVOLVERS;
-        o_bank_offset = (o_index/4)/CONVOLVERS;
+        // vertical pooling
+        for (ap_uint<6> i = 0; i < WORD_SIZE/4; ++i) {
+          // source indices
+          ap_uint<5> i0 = i >> (log_width-1);
+          i0 = (i0 << log_width) + i(log_width-2,0);
+          ap_uint<5> i1 = i0 + pool_width;
+          // dest index
+          ap_uint<6> d0 = out_offset + i;
+          poolword[d0] = poolword_h[i0] & poolword_h[i1];
+        }
+
+        // For log_width > 3 we can just assign the word, but log_width = 3 means width = 8,
+        // which means pooled width = 4, which is only 16 bits, which is less than 1 Word.
+        // So each time we get here we only have 16 bits, meaning we have to accumulate four
+        // of these 16-bit batches before writing a word out.
+        if (log_width != LOG_BANK_WIDTH) {
+          o_bank_offset /= 4;
+          outword = poolword;
+        } else {
+          outword = outword >> WORD_SIZE/4;
+          outword(63,48) = poolword(15,0);
+          o_bank_idx = (o/4)%CONVOLVERS;
+          o_bank_offset = (o/4)/CONVOLVERS;
+        }
       }
-    }
 
-    dmem[d_o_idx][o_bank_idx][o_bank_offset] = outword;
-  }
+      dmem[d_o_idx][o_bank_idx][o_bank_offset] = outword;
+    }
+  } // LOOP_OUT_PAR
 }
 
 // -----------------------------------------------------------------------
@@ -720,6 +777,7 @@ void top(
 
   assert(width <= MAX_WIDTH);
   assert(n_inputs != 0);
+  assert(input_words <= DMEM_WORDS && output_words <= DMEM_O_WORDS);
   if (layer_type <= LAYER_CONV) {
     assert(input_words % CONVOLVERS == 0);
     assert(n_inputs*width*width <= DMEM_WORDS*WORD_SIZE);
@@ -796,10 +854,18 @@ void top(
     assert(n_inputs % CONVOLVERS == 0);
 
     LOOP_IMG_BATCH:
-    for (IdxType i = 0; i < n_outputs; ++i) {
-      // Load the batch-norm parameters for this output
-      NormComp nc;
-      load_kh(nc, kh_mem, kh_index);
+    for (IdxType i = 0; i < n_outputs; i += CONV_OUT_PAR) {
+      // up to CONV_OUT_PAR outputs per pass over the input
+      const IdxType n_par = (n_outputs - i < CONV_OUT_PAR) ?
+                            IdxType(n_outputs - i) : IdxType(CONV_OUT_PAR);
+
+      // Load the batch-norm parameters for these outputs
+      NormComp nc[CONV_OUT_PAR];
+      for (IdxType j = 0; j < CONV_OUT_PAR; ++j) {
+        nc[j] = 0;
+        if (j < n_par)
+          load_kh(nc[j], kh_mem, kh_index + j);
+      }
 
       bin_conv(
           wt_mem,
@@ -808,13 +874,14 @@ void top(
           d_i_idx, d_o_idx,
           n_inputs,
           o_index,
+          n_par,
           i == 0 ? 1 : 0,         // new_batch
           width_mode,
           norm_mode
       );
 
-      kh_index++;
-      o_index++;
+      kh_index += n_par;
+      o_index += n_par;
     }
   }
   else {
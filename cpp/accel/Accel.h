@@ -23,6 +23,9 @@
 // Constants
 //-------------------------------------------------------------------
 const unsigned CONVOLVERS = 2;
+// output feature maps bin_conv computes per pass over its input, each
+// input word is read and encoded once and applied to all of them
+const unsigned CONV_OUT_PAR = 2;
 
 const unsigned WORD_SIZE = 64;
 const unsigned WT_SIZE = 9;
@@ -38,7 +41,9 @@ const unsigned KH_WORDS     = WT_L/128*16 / WORD_SIZE;
 
 const unsigned DMEM_WORDS   = 128*32*32 / WORD_SIZE;
 const unsigned C_DMEM_WORDS = DMEM_WORDS / CONVOLVERS;
-const unsigned DMEM_O_WORDS = 512*4*4 / WORD_SIZE;
+// the output port carries up to a whole feature map: memo mode reads
+// back the output of every conv layer, conv1's is DMEM_WORDS
+const unsigned DMEM_O_WORDS = DMEM_WORDS;
 const unsigned DB_MEM_WORDS = 32*32;
 
 const unsigned PIX_PER_PHASE = 2*32*32;
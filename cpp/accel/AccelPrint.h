@@ -3,6 +3,7 @@
 
 #include "Accel.h"
 #include <stdio.h>
+#include <stdint.h>
 
 //------------------------------------------------------------------------
 // For an array of ap_int's, sets/gets the bit at bit_idx
@@ -11,20 +12,31 @@
 template<typename T>
 inline void set_bit(T array[], unsigned bit_idx, Bit val) {
   unsigned W = array[0].length();
-  Address idx = bit_idx / W;
-  Address offset = bit_idx % W;
-  array[idx][offset] = val;
+  array[bit_idx / W][bit_idx % W] = val;
 }
 
 template<typename T>
 inline Bit get_bit(T array[], unsigned bit_idx) {
   unsigned W = array[0].length();
-  Address idx = bit_idx / W;
-  Address offset = bit_idx % W;
-  Bit result = array[idx][offset];
+  Bit result = array[bit_idx / W][bit_idx % W];
   return result;
 }
 
+// Word arrays are updated with a 64-bit shift and mask instead of
+// an ap_int bit reference. Whole maps should be filled or compared
+// a Word at a time (see count_bit_errors in AccelTest.h), these are
+// for single pixels.
+inline void set_bit(Word array[], unsigned bit_idx, Bit val) {
+  const uint64_t mask = uint64_t(1) << (bit_idx % WORD_SIZE);
+  const uint64_t w = array[bit_idx / WORD_SIZE].to_uint64();
+  array[bit_idx / WORD_SIZE] = (val != 0) ? (w | mask) : (w & ~mask);
+}
+
+inline Bit get_bit(Word array[], unsigned bit_idx) {
+  const uint64_t w = array[bit_idx / WORD_SIZE].to_uint64();
+  return ((w >> (bit_idx % WORD_SIZE)) & 1) ? Bit(-1) : Bit(0);
+}
+
 //------------------------------------------------------------------------
 // Printing matrices and bit arrays
 //------------------------------------------------------------------------
@@ -1,6 +1,9 @@
 #include "AccelSchedule.h"
 #include "AccelTest.h"
+#include "BufferPool.h"
 #include "Timer.h"
+#include "Trace.h"
+#include "WeightPack.h"
 
 static Timer timers[N_LAYERS] = {
   "xl-FC3",
@@ -35,8 +38,22 @@ void compute_accel_schedule(
     const ap_uint<1> max_pool,
     AccelSchedule &schedule
 ) {
-  assert (wt != NULL);
-  assert (kh != NULL);
+  plan_accel_schedule(n_inputs, n_outputs, width, layer_type, max_pool, schedule);
+  for (unsigned idx = 0; idx < schedule.size(); ++idx)
+    load_accel_schedule_entry(wt, kh, layer_type, schedule, idx);
+}
+
+// -----------------------------------------------------------------------
+// Sizes the schedule and fills in everything but the weights
+// -----------------------------------------------------------------------
+void plan_accel_schedule(
+    unsigned n_inputs,
+    unsigned n_outputs,
+    unsigned width,
+    const ap_uint<2> layer_type,
+    const ap_uint<1> max_pool,
+    AccelSchedule &schedule
+) {
   const ap_uint<2> width_mode = width >> 4;
   ap_uint<3> layer_mode = 0;
   layer_mode(2,1) = layer_type(1,0);
@@ -59,7 +76,6 @@ void compute_accel_schedule(
   unsigned n_batches = n_outputs / imgs_per_batch;
   schedule.resize(n_batches);
 
-  // divide up the weights according to the value of imgs_per_batch
   unsigned idx = 0;
   for (unsigned o = 0; o < n_outputs; o+=imgs_per_batch, idx++) {
     layer_mode[0] = (o==0) ? 1 : 0;
@@ -70,26 +86,78 @@ void compute_accel_schedule(
     schedule[idx].layer_mode = layer_mode;
     schedule[idx].width_mode = width_mode;
     schedule[idx].norm_mode = max_pool + 1;
+  }
+}
 
-    // now we divide up the weights
-    Word* wt_i = schedule[idx].wt;
-    if (layer_type == LAYER_CONV1)
-      load_conv1_weights(wt, wt_i, o, imgs_per_batch);
-    else if (layer_type == LAYER_CONV)
-      load_conv_weights(wt, wt_i, o, n_inputs, imgs_per_batch);
-    else
-      load_dense_weights(wt, wt_i, o, n_inputs, imgs_per_batch);
-    // divide up the kh params
-    Word* kh_i = schedule[idx].kh;
-    if (layer_type != LAYER_LAST)
-      load_kh (kh, kh_i, o, imgs_per_batch);
-    else
-      load_kh (kh, kh_i, o, 2*imgs_per_batch);
+// -----------------------------------------------------------------------
+// Divides up the weights and kh params for invocation idx. Entries only
+// read wt/kh and write their own buffers, so they can be loaded in
+// parallel.
+// -----------------------------------------------------------------------
+void load_accel_schedule_entry(
+    Word* wt,
+    Word* kh,
+    const ap_uint<2> layer_type,
+    AccelSchedule &schedule,
+    unsigned idx
+) {
+  assert (wt != NULL);
+  assert (kh != NULL);
+  const unsigned n_inputs = schedule[idx].n_inputs;
+  const unsigned imgs_per_batch = schedule[idx].n_outputs;
+  const unsigned o = idx * imgs_per_batch;
+
+  // the native repackers of WeightPack.h, same layout as load_*_weights
+  Word* wt_i = schedule[idx].wt;
+  if (layer_type == LAYER_CONV1)
+    repack_conv1_weights(wt, wt_i, o, imgs_per_batch);
+  else if (layer_type == LAYER_CONV)
+    repack_conv_weights(wt, wt_i, o, n_inputs, imgs_per_batch);
+  else
+    repack_dense_weights(wt, wt_i, o, n_inputs, imgs_per_batch);
+  // divide up the kh params
+  Word* kh_i = schedule[idx].kh;
+  if (layer_type != LAYER_LAST)
+    load_kh (kh, kh_i, o, imgs_per_batch);
+  else
+    load_kh (kh, kh_i, o, 2*imgs_per_batch);
+}
+
+// -----------------------------------------------------------------------
+// Replace the copies made by load_dense_weights / load_kh with pointers
+// to the same words
+// -----------------------------------------------------------------------
+size_t share_dense_weights(
+    Word* wt,
+    Word* kh,
+    const ap_uint<2> layer_type,
+    AccelSchedule &schedule
+) {
+  assert (layer_type == LAYER_DENSE || layer_type == LAYER_LAST);
+  size_t freed = 0;
+  for (unsigned idx = 0; idx < schedule.size(); ++idx) {
+    AccelInfo& a = schedule[idx];
+    const unsigned n_out = a.n_outputs;
+    const unsigned o = idx * n_out;
+    const unsigned n_kh = (layer_type == LAYER_LAST) ? 2*n_out : n_out;
+
+    if (a.owns_buffers) {
+      delete[] a.wt;
+      delete[] a.kh;
+      freed += (WT_WORDS + KH_WORDS) * sizeof(Word);
+    }
+    a.wt = wt + o*a.n_inputs/WORD_SIZE;
+    a.kh = kh + o/KH_PER_WORD;
+    a.wt_words = a.n_inputs*n_out/WORD_SIZE;
+    a.kh_words = (n_kh + KH_PER_WORD-1) / KH_PER_WORD;
+    a.owns_buffers = false;
   }
+  return freed;
 }
 
 // -----------------------------------------------------------------------
 // Invoke accel multiple times based on an AccelSchedule (vec of AccelInfo)
+// [accel] is top() unless a test runs the schedule on another backend
 // -----------------------------------------------------------------------
 void run_accel_schedule(
     Word* data_i,
@@ -98,11 +166,12 @@ void run_accel_schedule(
     unsigned input_words,
     unsigned output_words,
     ap_uint<1> dmem_mode,
-    AccelSchedule& s
+    AccelSchedule& s,
+    AccelTopFn accel
 ) {
-  // weight mems
-  static Word* wt_i = (Word*) MEM_ALLOC( WT_WORDS*sizeof(Word) );
-  static Word* kh_i = (Word*) MEM_ALLOC( KH_WORDS*sizeof(Word) );
+  // weight mems, the pool hands back the same buffers on every call
+  Word* wt_i = (Word*) dma_pool().acquire( WT_WORDS*sizeof(Word) );
+  Word* kh_i = (Word*) dma_pool().acquire( KH_WORDS*sizeof(Word) );
   if (!wt_i || !kh_i) {
     fprintf(stderr, "**** ERROR: Alloc wt_i or kh_i failed in %s\n", __FILE__);
     exit(-2);
@@ -113,14 +182,24 @@ void run_accel_schedule(
 
   // Invoke accelerator once for each element in the schedule
   for (unsigned i = 0; i < N; ++i) {
-    for (unsigned j = 0; j < WT_WORDS; ++j)
-      wt_i[j] = s[i].wt[j];
-    for (unsigned j = 0; j < KH_WORDS; ++j)
-      kh_i[j] = s[i].kh[j];
+    {
+      TraceScope t("load_wt", "host");
+      t.arg("layer", layer_idx+1).arg("entry", i)
+       .arg("wt_words", s[i].wt_words).arg("kh_words", s[i].kh_words);
+      for (unsigned j = 0; j < s[i].wt_words; ++j)
+        wt_i[j] = s[i].wt[j];
+      for (unsigned j = 0; j < s[i].kh_words; ++j)
+        kh_i[j] = s[i].kh[j];
+    }
 
+    TraceScope t("top", "accel");
+    t.arg("layer", layer_idx+1).arg("entry", i)
+     .arg("n_inputs", s[i].n_inputs).arg("n_outputs", s[i].n_outputs)
+     .arg("words_in", (i==0) ? input_words : 0)
+     .arg("words_out", (i==N-1) ? output_words : 0);
     timers[LAYERS-1-layer_idx].start();
 
-    top(
+    accel(
         wt_i, kh_i, data_i, data_o,
         s[i].n_inputs, s[i].n_outputs,
         (i==0)   ? input_words : 0,
@@ -134,8 +213,8 @@ void run_accel_schedule(
     timers[LAYERS-1-layer_idx].stop();
   }
 
-  //MEM_FREE( wt_i );
-  //MEM_FREE( kh_i );
+  dma_pool().release( wt_i );
+  dma_pool().release( kh_i );
 }
 
 // -----------------------------------------------------------------------
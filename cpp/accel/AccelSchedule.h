@@ -1,6 +1,7 @@
 #ifndef ACCEL_ACCEL_SCHEDULE_H
 #define ACCEL_ACCEL_SCHEDULE_H
 
+#include <cstddef>
 #include <vector>
 #include "Accel.h"
 
@@ -9,6 +10,9 @@
 struct AccelInfo {
   Word* wt;
   Word* kh;
+  unsigned wt_words;      // words readable at wt / kh
+  unsigned kh_words;
+  bool owns_buffers;      // false if wt/kh point into another array
   unsigned n_inputs;
   unsigned n_outputs;
   ap_uint<3> layer_mode;  // [0]='new layer', [2:1]='conv1,conv,dense'
@@ -18,16 +22,39 @@ struct AccelInfo {
   AccelInfo() {
     wt = new Word[WT_WORDS];
     kh = new Word[KH_WORDS];
+    wt_words = WT_WORDS;
+    kh_words = KH_WORDS;
+    owns_buffers = true;
   }
 
   ~AccelInfo() {
-    delete[] wt;
-    delete[] kh;
+    if (owns_buffers) {
+      delete[] wt;
+      delete[] kh;
+    }
   }
 };
 
 typedef std::vector<AccelInfo> AccelSchedule;
 
+// The accelerator interface. top() is the HLS model, alternative
+// backends (e.g. top_sw in AccelSw.h) take the same arguments and must
+// produce the same dmem_o words for any sequence of calls.
+typedef void (*AccelTopFn)(
+    Word wt_i[WT_WORDS],
+    Word kh_i[KH_WORDS],
+    Word dmem_i[DMEM_WORDS],
+    Word dmem_o[DMEM_O_WORDS],
+    const Address    n_inputs,
+    const Address    n_outputs,
+    const Address    input_words,
+    const Address    output_words,
+    const ap_uint<3> layer_mode,
+    const ap_uint<1> dmem_mode,
+    const ap_uint<2> width_mode,
+    const ap_uint<2> norm_mode
+);
+
 void compute_accel_schedule(
     Word* wt,
     Word* kh,
@@ -39,6 +66,36 @@ void compute_accel_schedule(
     AccelSchedule &schedule
 );
 
+// The two halves of compute_accel_schedule: plan sizes the schedule and
+// sets the modes of each invocation, load_accel_schedule_entry copies
+// the weights of one invocation. Entries may be loaded in parallel.
+void plan_accel_schedule(
+    unsigned n_inputs,
+    unsigned n_outputs,
+    unsigned width,
+    const ap_uint<2> layer_type,
+    const ap_uint<1> max_pool,
+    AccelSchedule &schedule
+);
+void load_accel_schedule_entry(
+    Word* wt,
+    Word* kh,
+    const ap_uint<2> layer_type,
+    AccelSchedule &schedule,
+    unsigned idx
+);
+
+// Dense layer invocations take a contiguous run of the layer's wt and
+// kh words. This points each invocation of a dense or last layer
+// schedule at its run instead of a private copy and frees the copies,
+// wt and kh must then outlive the schedule. Returns the bytes freed.
+size_t share_dense_weights(
+    Word* wt,
+    Word* kh,
+    const ap_uint<2> layer_type,
+    AccelSchedule &schedule
+);
+
 void run_accel_schedule(
     Word* data_i,
     Word* data_o,
@@ -46,7 +103,8 @@ void run_accel_schedule(
     unsigned input_words,
     unsigned output_words,
     ap_uint<1> dmem_mode,
-    AccelSchedule& s
+    AccelSchedule& s,
+    AccelTopFn accel = top
 );
 
 void load_conv1_weights(Word* wt, Word* wt_o,
@@ -0,0 +1,339 @@
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "AccelSw.h"
+#include "CpuKernels.h"
+
+// -----------------------------------------------------------------------
+// State kept between calls, the statics of top() and bin_conv()
+// -----------------------------------------------------------------------
+static uint64_t dmem[2][CONVOLVERS][C_DMEM_WORDS];
+static uint16_t kh_index = 0;
+static uint16_t o_index = 0;
+static uint64_t outword = 0;
+
+static inline uint64_t to_u64(const Word& w) {
+  return w.to_uint64();
+}
+
+static inline Word from_u64(uint64_t x) {
+  Word w = 0;
+  w(WORD_SIZE-1,0) = x;
+  return w;
+}
+
+// two's complement wrap of x to a signed type of [bits] bits
+static inline int wrap_bits(int64_t x, unsigned bits) {
+  const int64_t half = int64_t(1) << (bits-1);
+  return (int)(((x + half) & (2*half - 1)) - half);
+}
+
+// 16-bit parameter idx of a kh array, see load_kh in Accel.h
+static inline int load_kh16(const Word* kh, unsigned idx) {
+  const uint64_t w = to_u64(kh[idx / KH_PER_WORD]);
+  return (int16_t)(w >> (16*(idx % KH_PER_WORD)));
+}
+
+// -----------------------------------------------------------------------
+// First conv layer, fixed point inputs. C1InputType and C1ConvType both
+// have 18 fractional bits, so the sum is an integer sum of the raw bits.
+// -----------------------------------------------------------------------
+static void sw_fp_conv(
+    const Word* wt_i,
+    const Word* kh_i,
+    unsigned d_i,
+    unsigned d_o,
+    unsigned N
+) {
+  const unsigned M = 3;
+  const unsigned S = 32;
+  const unsigned SP = S+2;
+  const unsigned OUTWORDS = 16;
+  const unsigned W = C1InputType(0).length();
+  const int MIN_PIX = -(1 << (W-1));
+
+  // raw input pixels with a zero border
+  static int pix[M][SP*SP];
+  memset(pix, 0, sizeof(pix));
+  for (unsigned i = 0; i < S*S; ++i) {
+    const uint64_t wrd = dmem[d_i][i/C_DMEM_WORDS][i%C_DMEM_WORDS];
+    for (unsigned m = 0; m < M; ++m)
+      pix[m][(i/S + 1)*SP + i%S + 1] = conv1_channel(wrd, m);
+  }
+
+  for (unsigned n = 0; n < N; ++n) {
+    // filter m of output n is bits [9m, 9m+9) of word n
+    const uint64_t wt_word = to_u64(wt_i[n]);
+    // C1Comp has 12 fractional bits
+    const int64_t nc = (int64_t)load_kh16(kh_i, kh_index + n) * 64;
+
+    uint64_t outwords[OUTWORDS] = {0};
+    for (unsigned r = 0; r < S; ++r) {
+      for (unsigned c = 0; c < S; ++c) {
+        int64_t res = 0;
+        for (unsigned m = 0; m < M; ++m) {
+          for (unsigned wr = 0; wr < K; ++wr) {
+            for (unsigned wc = 0; wc < K; ++wc) {
+              const int v = pix[m][(r+wr)*SP + c+wc];
+              const unsigned t = m*WT_SIZE + 8-(wr*K+wc);
+              // negating the most negative C1InputType wraps to itself
+              res += ((wt_word >> t) & 1) ? ((v == MIN_PIX) ? v : -v) : v;
+            }
+          }
+        }
+        if (wrap_bits(res, C1ConvType(0).length()) < nc)
+          outwords[r/2] |= 1ULL << ((r%2)*S + c);
+      }
+    }
+
+    const unsigned img_idx = (uint16_t)(o_index + n);
+    for (unsigned i = 0; i < OUTWORDS; ++i)
+      dmem[d_o][img_idx % CONVOLVERS][(img_idx / CONVOLVERS)*OUTWORDS + i] = outwords[i];
+  }
+
+  kh_index += N;
+  o_index += N;
+}
+
+// -----------------------------------------------------------------------
+// Binary conv layers. Input plane p is image p/CONVOLVERS of bank
+// p%CONVOLVERS, its filter for output i of this call is filter
+// (i*n_inputs+p)/CONVOLVERS of bank p%CONVOLVERS, seven to a word.
+// -----------------------------------------------------------------------
+static void sw_bin_conv(
+    const Word* wt_i,
+    const Word* kh_i,
+    unsigned d_i,
+    unsigned d_o,
+    unsigned n_inputs,
+    unsigned n_outputs,
+    unsigned width_mode,
+    unsigned norm_mode
+) {
+  const unsigned log_width = width_mode + LOG_BANK_WIDTH;
+  const unsigned S = 1 << log_width;
+  const unsigned SP = S+2;
+  const unsigned P = S*S;
+  const unsigned words_per_image = 1 << (2*width_mode);
+  const unsigned images_per_phase = PIX_PER_PHASE >> (2*log_width);
+
+  assert(n_inputs % CONVOLVERS == 0);
+  assert((n_inputs / CONVOLVERS) % images_per_phase == 0);
+  assert(norm_mode != 2 || n_outputs % 4 == 0);
+
+  // +1/-1 input planes with a zero border
+  std::vector<int8_t> in(n_inputs*SP*SP, 0);
+  for (unsigned p = 0; p < n_inputs; ++p) {
+    const uint64_t* w = &dmem[d_i][p % CONVOLVERS][(p / CONVOLVERS)*words_per_image];
+    int8_t* x = &in[p*SP*SP];
+    for (unsigned k = 0; k < P; ++k)
+      x[(k/S + 1)*SP + k%S + 1] = ((w[k / WORD_SIZE] >> (k % WORD_SIZE)) & 1) ? -1 : 1;
+  }
+
+  std::vector<int> sum(P);
+  for (unsigned i = 0; i < n_outputs; ++i) {
+    std::fill(sum.begin(), sum.end(), 0);
+    for (unsigned p = 0; p < n_inputs; ++p) {
+      const unsigned f = i*n_inputs + p;
+      const unsigned k = f / CONVOLVERS;
+      const uint64_t wt = to_u64(wt_i[(k / CONV_W_PER_WORD)*CONVOLVERS + f % CONVOLVERS])
+                          >> (WT_SIZE*(k % CONV_W_PER_WORD));
+      const int8_t* x = &in[p*SP*SP];
+
+      // window tap (kr,kc) uses filter bit 8-(kr*K+kc)
+      for (unsigned kr = 0; kr < K; ++kr) {
+        for (unsigned kc = 0; kc < K; ++kc) {
+          const int s = ((wt >> (8-(kr*K+kc))) & 1) ? -1 : 1;
+          const int8_t* xs = x + kr*SP + kc;
+          for (unsigned r = 0; r < S; ++r)
+            for (unsigned c = 0; c < S; ++c)
+              sum[r*S + c] += s * xs[r*SP + c];
+        }
+      }
+    }
+
+    // binarize, the sums are a 12-bit ConvSum
+    const int nc = load_kh16(kh_i, kh_index);
+    uint64_t bin[MAX_WIDTH*MAX_WIDTH / WORD_SIZE] = {0};
+    for (unsigned k = 0; k < P; ++k) {
+      if (wrap_bits(sum[k], ConvSum(0).length()) < nc)
+        bin[k / WORD_SIZE] |= 1ULL << (k % WORD_SIZE);
+    }
+
+    const unsigned o = o_index;
+    if (norm_mode == 2) {
+      // a pooled bit is -1 only if all four inputs are -1
+      const unsigned So = S/2;
+      uint64_t pooled[4] = {0};
+      for (unsigned r = 0; r < So; ++r) {
+        for (unsigned c = 0; c < So; ++c) {
+          const unsigned k = 2*r*S + 2*c;
+          const uint64_t b = (bin[k / WORD_SIZE] >> (k % WORD_SIZE)) &
+                             (bin[(k+1) / WORD_SIZE] >> ((k+1) % WORD_SIZE)) &
+                             (bin[(k+S) / WORD_SIZE] >> ((k+S) % WORD_SIZE)) &
+                             (bin[(k+S+1) / WORD_SIZE] >> ((k+S+1) % WORD_SIZE)) & 1;
+          pooled[(r*So + c) / WORD_SIZE] |= b << ((r*So + c) % WORD_SIZE);
+        }
+      }
+
+      if (log_width != LOG_BANK_WIDTH) {
+        const unsigned n_words = words_per_image / 4;
+        for (unsigned w = 0; w < n_words; ++w)
+          dmem[d_o][o % CONVOLVERS][(o / CONVOLVERS)*n_words + w] = pooled[w];
+        outword = pooled[n_words-1];
+      } else {
+        // pooled 8x8 maps are 16 bits, four outputs fill a word
+        outword = (outword >> WORD_SIZE/4) | (pooled[0] << 3*WORD_SIZE/4);
+        dmem[d_o][(o/4) % CONVOLVERS][(o/4) / CONVOLVERS] = outword;
+      }
+    } else {
+      // norm_mode 0 keeps writing the last word
+      for (unsigned w = 0; w < words_per_image; ++w) {
+        if (norm_mode == 1)
+          outword = bin[w];
+        dmem[d_o][o % CONVOLVERS][(o / CONVOLVERS)*words_per_image + w] = outword;
+      }
+    }
+
+    kh_index++;
+    o_index++;
+  }
+}
+
+// -----------------------------------------------------------------------
+// Dense and last layers, input word k is in bank k%CONVOLVERS and the
+// weights of output o of this call start at word o*n_inputs/64
+// -----------------------------------------------------------------------
+static void sw_bin_dense(
+    const Word* wt_i,
+    const Word* kh_i,
+    unsigned layer_type,
+    unsigned d_i,
+    unsigned d_o,
+    unsigned n_inputs,
+    unsigned n_outputs
+) {
+  assert(layer_type == LAYER_DENSE || n_outputs == 10);
+  assert(n_inputs/WORD_SIZE % CONVOLVERS == 0);
+
+  const unsigned n_words = n_inputs / WORD_SIZE;
+  std::vector<uint64_t> in(n_words);
+  for (unsigned k = 0; k < n_words; ++k)
+    in[k] = dmem[d_i][k % CONVOLVERS][k / CONVOLVERS];
+
+  DenseNorm best_out = -1024;
+  ap_int<8> prediction = -1;
+
+  for (unsigned o = 0; o < n_outputs; ++o) {
+    const Word* w = wt_i + o*n_words;
+    int cnt = 0;
+    for (unsigned k = 0; k < n_words; ++k)
+      cnt += __builtin_popcountll(in[k] ^ to_u64(w[k]));
+    // the sums are a 16-bit DenseSum
+    const int sum = wrap_bits(n_inputs - 2*cnt, DenseSum(0).length());
+
+    const unsigned b = o_index + o;
+    uint64_t& o_word = dmem[d_o][(b / WORD_SIZE) % CONVOLVERS][(b / WORD_SIZE) / CONVOLVERS];
+
+    if (layer_type == LAYER_DENSE) {
+      if (sum >= load_kh16(kh_i, o))
+        o_word &= ~(1ULL << (b % WORD_SIZE));
+      else
+        o_word |= 1ULL << (b % WORD_SIZE);
+    } else {
+      const Word kh_word = kh_i[o/2];
+      KType ki;  HType hi;
+      if (o % 2 == 0) {
+        ki(15,0) = kh_word(15, 0);
+        hi(15,0) = kh_word(31,16);
+      } else {
+        ki(15,0) = kh_word(47,32);
+        hi(15,0) = kh_word(63,48);
+      }
+      ap_fixed<20,10> out = ap_fixed<20,10>(DenseSum(sum))*ki + hi;
+
+      if (o == 0 || out > best_out) {
+        prediction = o;
+        best_out = out;
+      }
+    }
+  }
+
+  if (layer_type == LAYER_LAST)
+    dmem[d_o][0][0] = (uint8_t)prediction.to_int();
+
+  o_index += n_outputs;
+}
+
+// -----------------------------------------------------------------------
+// Same interface and data movement as top()
+// -----------------------------------------------------------------------
+void top_sw(
+    Word wt_i[WT_WORDS],
+    Word kh_i[KH_WORDS],
+    Word dmem_i[DMEM_WORDS],
+    Word dmem_o[DMEM_O_WORDS],
+    const Address    n_inputs,
+    const Address    n_outputs,
+    const Address    input_words,
+    const Address    output_words,
+    const ap_uint<3> layer_mode,
+    const ap_uint<1> dmem_mode,
+    const ap_uint<2> width_mode,
+    const ap_uint<2> norm_mode
+) {
+  const ap_uint<2> layer_type = layer_mode(2,1);
+  const unsigned wm = width_mode.to_uint();
+  assert(n_inputs != 0);
+  assert(input_words <= DMEM_WORDS && output_words <= DMEM_O_WORDS);
+
+  if (layer_mode[0]) {
+    kh_index = 0;
+    o_index = 0;
+  } else {
+    kh_index &= 1;
+  }
+
+  const unsigned d_i = dmem_mode.to_uint();
+  const unsigned d_o = 1 - d_i;
+
+  // Data input
+  const unsigned words_per_image = 1 << (2*wm);
+  for (unsigned i = 0; i < input_words; ++i) {
+    const unsigned img_idx = i / words_per_image;
+    const unsigned img_off = i % words_per_image;
+    uint64_t* d;
+    if (layer_type == LAYER_CONV)
+      d = &dmem[d_i][img_idx % CONVOLVERS][(img_idx / CONVOLVERS)*words_per_image + img_off];
+    else if (layer_type == LAYER_CONV1)
+      d = &dmem[d_i][i / C_DMEM_WORDS][i % C_DMEM_WORDS];
+    else
+      d = &dmem[d_i][i % CONVOLVERS][i / CONVOLVERS];
+    *d = to_u64(dmem_i[i]);
+  }
+
+  if (layer_type == LAYER_CONV1) {
+    assert(n_inputs == 3);
+    sw_fp_conv(wt_i, kh_i, d_i, d_o, n_outputs);
+  } else if (layer_type == LAYER_CONV) {
+    sw_bin_conv(wt_i, kh_i, d_i, d_o, n_inputs, n_outputs, wm, norm_mode.to_uint());
+  } else {
+    sw_bin_dense(wt_i, kh_i, layer_type.to_uint(), d_i, d_o, n_inputs, n_outputs);
+  }
+
+  // Data output, 8-wide pooled conv maps are packed like dense outputs
+  const unsigned words_per_out = words_per_image / ((norm_mode != 2) ? 1 : 4);
+  const bool packed = (layer_type > LAYER_CONV) || (wm == 0 && norm_mode == 2);
+  for (unsigned i = 0; i < output_words; ++i) {
+    if (!packed) {
+      const unsigned img_idx = i / words_per_out;
+      const unsigned img_off = i % words_per_out;
+      dmem_o[i] = from_u64(
+          dmem[d_o][img_idx % CONVOLVERS][(img_idx / CONVOLVERS)*words_per_out + img_off]);
+    } else {
+      dmem_o[i] = from_u64(dmem[d_o][i % CONVOLVERS][i / CONVOLVERS]);
+    }
+  }
+}
@@ -0,0 +1,36 @@
+#ifndef ACCEL_ACCEL_SW_H
+#define ACCEL_ACCEL_SW_H
+
+#include "Accel.h"
+
+//------------------------------------------------------------------------
+// Software implementation of the accelerator interface, an alternative
+// backend to run an AccelSchedule on (see AccelTopFn).
+//
+// top_sw() takes the same arguments as top() and keeps the same state
+// between calls: both dmem halves, o_index/kh_index and the pending
+// pooled word of 8-wide conv layers, so any sequence of calls leaves
+// the same words in dmem_o as it does with top(). The kernels are plain
+// integer code instead of the line buffers and ap_int arithmetic of the
+// HLS model: binary conv sums +1/-1 planes, dense layers xor and
+// popcount whole words. Sums wrap at the widths of the accelerator
+// types (ConvSum, DenseSum, C1ConvType).
+//
+// Like top() it holds its state in statics, one caller at a time.
+//------------------------------------------------------------------------
+void top_sw(
+    Word wt_i[WT_WORDS],
+    Word kh_i[KH_WORDS],
+    Word dmem_i[DMEM_WORDS],
+    Word dmem_o[DMEM_O_WORDS],
+    const Address    n_inputs,
+    const Address    n_outputs,
+    const Address    input_words,
+    const Address    output_words,
+    const ap_uint<3> layer_mode,  // [0]='new layer', [2:1]='conv1,conv,dense,last'
+    const ap_uint<1> dmem_mode,   // 0 means dmem[0] is input
+    const ap_uint<2> width_mode,  // 0=8'b, 1=16'b, 2=32'b
+    const ap_uint<2> norm_mode    // 0='do nothing', 1='do norm', 2='do pool'
+);
+
+#endif
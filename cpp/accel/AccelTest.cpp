@@ -2,6 +2,7 @@
 #include "AccelSchedule.h"
 #include <math.h>
 #include <cstdlib>
+#include <stdint.h>
 
 //------------------------------------------------------------------------
 // Helper functions
@@ -22,6 +23,22 @@ bool layer_is_last(unsigned layer_idx) {
   assert(layer_idx != 0 && layer_idx <= N_LAYERS);
   return T_tab[layer_idx-1] == LAYER_LAST;
 }
+unsigned layer_of_type(unsigned layer_type, unsigned M, unsigned S,
+                       unsigned pool) {
+  unsigned best = N_LAYERS;
+  int best_score = -1;
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    if (T_tab[l] != layer_type)
+      continue;
+    const int score = (M_tab[l] == M) + (S_tab[l] == S) + (pool_tab[l] == pool);
+    if (score > best_score) {
+      best = l;
+      best_score = score;
+    }
+  }
+  assert(best < N_LAYERS);
+  return best;
+}
 bool layer_wt_size(unsigned layer_idx);
 bool layer_kh_size(unsigned layer_idx);
 
@@ -43,6 +60,31 @@ unsigned WTS_TO_WORDS(const unsigned n) {
   return ((words+CONVOLVERS-1) / CONVOLVERS) * CONVOLVERS;
 }
 
+//------------------------------------------------------------------------
+void set_bit_array(Word array[], const float* data, unsigned size) {
+  const unsigned full = size / WORD_SIZE;
+  for (unsigned i = 0; i < full; ++i) {
+    Word wrd = 0;
+    wrd(WORD_SIZE-1,0) = pack_signs64(data + i*WORD_SIZE);
+    array[i] = wrd;
+  }
+  const unsigned rem = size % WORD_SIZE;
+  if (rem)
+    array[full](rem-1,0) = pack_signs64(data + full*WORD_SIZE, rem);
+}
+
+unsigned count_bit_errors(const Word* a, const Word* b, unsigned n_bits) {
+  unsigned n_err = 0;
+  for (unsigned i = 0; i*WORD_SIZE < n_bits; ++i) {
+    uint64_t diff = a[i].to_uint64() ^ b[i].to_uint64();
+    const unsigned left = n_bits - i*WORD_SIZE;
+    if (left < WORD_SIZE)
+      diff &= (uint64_t(1) << left) - 1;
+    n_err += __builtin_popcountll(diff);
+  }
+  return n_err;
+}
+
 //------------------------------------------------------------------------
 // Binarize weights and pack them into Words
 //------------------------------------------------------------------------
@@ -58,28 +100,50 @@ void set_weight_array(Word* w, const float* wts, unsigned layer_idx) {
 }
 
 void set_conv_weight_array(Word* w, const float* wts, unsigned size) {
-  unsigned wrd = 0, off = 0;
-  for (unsigned m = 0; m < size; ++m) {
-    for (unsigned i = 0; i < WT_SIZE; ++i) {
-      set_bit(w, wrd*WORD_SIZE+off*WT_SIZE+i, wts[m*WT_SIZE+i]>=0 ? Bit(0) : Bit(-1));
-    }
-    if (++off == CONV_W_PER_WORD) {
-      off = 0;
-      wrd++;
-    }
+  set_conv_weight_array(w, wts, 0, size);
+}
+
+// Packs filters [begin, end), begin must be a multiple of CONV_W_PER_WORD
+// so that different ranges never share a Word. The 7 filters of a Word
+// are 63 consecutive floats whose signs land in bits 0..62 in order, so
+// each Word is a single bulk sign pack.
+void set_conv_weight_array(Word* w, const float* wts, unsigned begin, unsigned end) {
+  assert(begin % CONV_W_PER_WORD == 0);
+  const unsigned W_BITS = CONV_W_PER_WORD*WT_SIZE;
+  for (unsigned m = begin; m < end; m += CONV_W_PER_WORD) {
+    const unsigned n_bits = (end - m < CONV_W_PER_WORD) ? (end - m)*WT_SIZE : W_BITS;
+    Word wrd = 0;
+    wrd(WORD_SIZE-1,0) = pack_signs64(wts + m*WT_SIZE, n_bits);
+    w[m / CONV_W_PER_WORD] = wrd;
   }
 }
 
 void set_dense_weight_array(Word* w, const float* wts, unsigned M, unsigned N) {
-  unsigned w_idx = 0;
-  for (unsigned n = 0; n < N; ++n) {
-    for (unsigned m = 0; m < M; m+=WORD_SIZE) {
-      Word wrd = 0;
-      for (unsigned b = 0; b < WORD_SIZE; ++b) {
-        wrd[b] = ((wts[(m+b)*N+n] < 0) ? 1 : 0);
+  set_dense_weight_array(w, wts, M, N, 0, N);
+}
+
+// Packs outputs [n_begin, n_end). Word n*M/64 + m/64 holds the signs of
+// column n, rows m..m+63 of the MxN weight matrix, so a naive packer
+// walks the matrix with stride N. Instead pack 64 contiguous floats from
+// each of 64 rows into a 64x64 bit tile, transpose it, then write 64
+// finished words.
+void set_dense_weight_array(Word* w, const float* wts, unsigned M, unsigned N,
+                            unsigned n_begin, unsigned n_end) {
+  const unsigned TILE = WORD_SIZE;
+  const unsigned M_WORDS = M / WORD_SIZE;
+  uint64_t tile[TILE];
+
+  for (unsigned n0 = n_begin; n0 < n_end; n0 += TILE) {
+    const unsigned nn = (n_end - n0 < TILE) ? n_end - n0 : TILE;
+    for (unsigned m = 0; m < M; m += WORD_SIZE) {
+      for (unsigned b = 0; b < WORD_SIZE; ++b)
+        tile[b] = pack_signs64(wts + (m+b)*N + n0, nn);
+      transpose64(tile);
+      for (unsigned j = 0; j < nn; ++j) {
+        Word wrd = 0;
+        wrd(WORD_SIZE-1,0) = tile[j];
+        w[(n0+j)*M_WORDS + m/WORD_SIZE] = wrd;
       }
-      w[w_idx] = wrd;
-      ++w_idx;
     }
   }
 }
@@ -223,7 +287,7 @@ void test_conv_layer(
   unsigned output_words = N*So*So/WORD_SIZE;
   if (output_words < 1) output_words = 1;
   assert (input_words <= DMEM_WORDS);
-  //assert (output_words <= DMEM_O_WORDS);
+  assert (output_words <= DMEM_O_WORDS);
 
   DB(3,
     printf ("*data*:\n");
@@ -243,7 +307,7 @@ void test_conv_layer(
 
   run_accel_schedule(
       data_i, data_o,
-      0,      // layer_idx
+      layer_of_type(conv_mode == 0 ? LAYER_CONV1 : LAYER_CONV, M, Si, max_pool),
       input_words,
       output_words,
       0,      // dmem_mode
@@ -258,18 +322,7 @@ void test_conv_layer(
 
   // Compare bin results
   printf ("## Checking results ##\n");
-  unsigned n_err = 0;
-  for (unsigned n = 0; n < N; ++n) {
-    for (unsigned r = 0; r < So; ++r) {
-      for (unsigned c = 0; c < So; ++c) {
-        if (get_bit(data_o, n*So*So+r*So+c) != get_bit(bin_ref, n*So*So+r*So+c)) {
-          n_err++;
-          //printf ("bin out != ref at n=%d, (%d,%d)\n", n, r,c);
-          //if (n_err > 64) exit(-1);
-        }
-      }
-    }
-  }
+  const unsigned n_err = count_bit_errors(data_o, bin_ref, N*So*So);
   float err_rate = float(n_err) / (N*So*So)*100;
   printf ("Error rate: %7.4f%%\n", err_rate);
   assert(err_rate < 1.0);
@@ -306,7 +359,7 @@ void test_dense_layer(
 
   run_accel_schedule(
       data_i, data_o,
-      0,      // layer_idx
+      layer_of_type(LAYER_DENSE, M, 1, 0),
       M/WORD_SIZE,
       N/WORD_SIZE,
       0,      // dmem_mode
@@ -321,12 +374,7 @@ void test_dense_layer(
 
   // Compare bin results
   printf ("## Checking results ##\n");
-  unsigned n_err = 0;
-  for (unsigned n = 0; n < N; ++n) {
-    if (get_bit(data_o, n) != get_bit(bin_ref, n)) {
-      n_err++;
-    }
-  }
+  const unsigned n_err = count_bit_errors(data_o, bin_ref, N);
   float err_rate = float(n_err)/N * 100;
   printf ("Error rate: %7.4f%%\n", err_rate);
   assert(err_rate < 1.0);
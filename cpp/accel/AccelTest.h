@@ -4,6 +4,7 @@
 #include "Typedefs.h"
 #include "Accel.h"
 #include "AccelPrint.h"
+#include "BitPack.h"
 #include <cstdlib>
 
 const unsigned N_LAYERS = 9;
@@ -16,12 +17,21 @@ const unsigned widx_tab[] = {0,   3,   6,   9,  12,  15,   18,   21,   24};
 const unsigned kidx_tab[] = {1,   4,   7,  10,  13,  16,   19,   22,   25};
 const unsigned hidx_tab[] = {2,   5,   8,  11,  14,  17,   20,   23,   26};
 const unsigned pool_tab[] = {0,   1,   0,   1,   0,   1,    0,    0,    0};
+// names of the layers in traces
+const char* const name_tab[] = {"conv1", "conv2", "conv3", "conv4", "conv5", "conv6",
+                                "dense1", "dense2", "last"};
 
 // layer_idx goes from 1 to 9
 bool layer_is_conv(unsigned layer_idx);
 bool layer_is_binconv(unsigned layer_idx);
 bool layer_is_fpconv(unsigned layer_idx);
 bool layer_is_last(unsigned layer_idx);
+// 0-based index of the layer of [layer_type] closest to a layer with
+// M inputs of width S and pooling [pool], the first of the layers
+// matching most of the three. Labels the timers and traces of test
+// layers.
+unsigned layer_of_type(unsigned layer_type, unsigned M, unsigned S,
+                       unsigned pool);
 bool layer_wt_size(unsigned layer_idx);
 bool layer_kh_size(unsigned layer_idx);
 
@@ -40,13 +50,23 @@ void set_bit_array(T1 array[], const T2* data, unsigned size) {
     set_bit(array, i, (data[i]>=0) ? Bit(0) : Bit(-1));
   }
 }
+// Bulk version for float maps, packs 64 signs per Word. Bits of the
+// last Word past [size] are left unchanged, as above
+void set_bit_array(Word array[], const float* data, unsigned size);
+
+// Number of bits in [0, n_bits) that differ between [a] and [b],
+// compared a Word at a time
+unsigned count_bit_errors(const Word* a, const Word* b, unsigned n_bits);
 
 //------------------------------------------------------------------------
 // Functions used to preprocess params and inputs
 //------------------------------------------------------------------------
 void set_weight_array(Word* w, const float* wts, unsigned layer_idx);
 void set_conv_weight_array(Word* w, const float* wts, unsigned size);
+void set_conv_weight_array(Word* w, const float* wts, unsigned begin, unsigned end);
 void set_dense_weight_array(Word* w, const float* wts, unsigned M, unsigned N);
+void set_dense_weight_array(Word* w, const float* wts, unsigned M, unsigned N,
+                            unsigned n_begin, unsigned n_end);
 
 void set_bnorm_array(Word* kh, const float* k, const float* h, unsigned layer_idx);
 void set_bnorm_array1(Word* kh, const float* k, const float* h, unsigned layer_idx, unsigned N);
@@ -0,0 +1,290 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "BitTensor.h"
+#include "BitPack.h"
+
+static const size_t ALIGN_BYTES = 64;
+static const size_t ALIGN_WORDS = ALIGN_BYTES / sizeof(Word);
+
+static inline size_t div_up(size_t a, size_t b) {
+  return (a + b - 1) / b;
+}
+
+static Word* aligned_words(size_t n) {
+  void* ptr = NULL;
+  const size_t bytes = div_up(n ? n : 1, ALIGN_WORDS) * ALIGN_BYTES;
+  if (posix_memalign(&ptr, ALIGN_BYTES, bytes) != 0) {
+    fprintf(stderr, "**** ERROR: cannot allocate %lu bytes for a BitTensor\n",
+        (unsigned long)bytes);
+    exit(-2);
+  }
+  return (Word*)ptr;
+}
+
+static inline uint64_t to_u64(const Word& w) {
+  return w.to_uint64();
+}
+
+static inline Word from_u64(uint64_t x) {
+  Word w = 0;
+  w(WORD_SIZE-1,0) = x;
+  return w;
+}
+
+// -----------------------------------------------------------------------
+// BitArena
+// -----------------------------------------------------------------------
+BitArena::BitArena(size_t words)
+  : m_base(aligned_words(words)), m_words(words), m_used(0)
+{}
+
+BitArena::~BitArena() {
+  free(m_base);
+}
+
+Word* BitArena::alloc(size_t n) {
+  const size_t start = div_up(m_used, ALIGN_WORDS) * ALIGN_WORDS;
+  if (start + n > m_words) {
+    fprintf(stderr, "**** ERROR: BitArena of %lu words cannot fit %lu more\n",
+        (unsigned long)m_words, (unsigned long)n);
+    exit(-2);
+  }
+  m_used = start + n;
+  Word* p = m_base + start;
+  for (size_t i = 0; i < n; ++i)
+    p[i] = 0;
+  return p;
+}
+
+// -----------------------------------------------------------------------
+// BitTensor
+// -----------------------------------------------------------------------
+BitTensor::BitTensor(unsigned planes, unsigned height, unsigned width,
+                     BitLayout layout)
+  : m_data(NULL), m_owned(true),
+    m_planes(planes), m_height(height), m_width(width), m_layout(layout)
+{
+  m_data = aligned_words(n_words());
+  clear();
+}
+
+BitTensor::BitTensor(BitArena& arena, unsigned planes, unsigned height,
+                     unsigned width, BitLayout layout)
+  : m_data(NULL), m_owned(false),
+    m_planes(planes), m_height(height), m_width(width), m_layout(layout)
+{
+  m_data = arena.alloc(n_words());
+}
+
+BitTensor::BitTensor(Word* data, unsigned planes, unsigned height,
+                     unsigned width, BitLayout layout)
+  : m_data(data), m_owned(false),
+    m_planes(planes), m_height(height), m_width(width), m_layout(layout)
+{
+  assert(data);
+}
+
+BitTensor::~BitTensor() {
+  if (m_owned)
+    free(m_data);
+}
+
+size_t BitTensor::num_words(unsigned planes, unsigned height,
+                            unsigned width, BitLayout layout) {
+  const size_t pixels = size_t(height)*width;
+  const size_t rm_words = div_up(planes*pixels, WORD_SIZE);
+  if (layout == BITS_ROW_MAJOR)
+    return rm_words;
+  if (layout == BITS_CHANNELS)
+    return pixels * div_up(planes, WORD_SIZE);
+
+  // the accelerator banks whole planes, which must fill whole words
+  assert(pixels < WORD_SIZE || pixels % WORD_SIZE == 0);
+  const size_t unit = (pixels < WORD_SIZE) ? 1 : pixels / WORD_SIZE;
+  const size_t units = div_up(rm_words, unit);
+  return CONVOLVERS * div_up(units, CONVOLVERS) * unit;
+}
+
+size_t BitTensor::unit_words() const {
+  const size_t pixels = size_t(m_height)*m_width;
+  return (pixels < WORD_SIZE) ? 1 : pixels / WORD_SIZE;
+}
+
+size_t BitTensor::bank_words() const {
+  assert(m_layout == BITS_BANKED);
+  return n_words() / CONVOLVERS;
+}
+
+Word* BitTensor::bank(unsigned b) {
+  assert(b < CONVOLVERS);
+  return m_data + b*bank_words();
+}
+
+const Word* BitTensor::bank(unsigned b) const {
+  assert(b < CONVOLVERS);
+  return m_data + b*bank_words();
+}
+
+size_t BitTensor::banked_index(size_t i) const {
+  const size_t unit = unit_words();
+  const size_t u = i / unit;
+  return (u % CONVOLVERS)*bank_words() + (u / CONVOLVERS)*unit + i % unit;
+}
+
+size_t BitTensor::locate(unsigned p, unsigned r, unsigned c,
+                         unsigned& bit) const {
+  assert(p < m_planes && r < m_height && c < m_width);
+  if (m_layout == BITS_CHANNELS) {
+    bit = p % WORD_SIZE;
+    return (size_t(r)*m_width + c) * div_up(m_planes, WORD_SIZE) + p / WORD_SIZE;
+  }
+  const size_t i = (size_t(p)*m_height + r)*m_width + c;
+  bit = i % WORD_SIZE;
+  return (m_layout == BITS_BANKED) ? banked_index(i / WORD_SIZE) : i / WORD_SIZE;
+}
+
+Bit BitTensor::get(unsigned p, unsigned r, unsigned c) const {
+  unsigned bit;
+  const size_t w = locate(p, r, c, bit);
+  Bit b = m_data[w][bit];
+  return b;
+}
+
+void BitTensor::set(unsigned p, unsigned r, unsigned c, Bit b) {
+  unsigned bit;
+  const size_t w = locate(p, r, c, bit);
+  m_data[w][bit] = b;
+}
+
+void BitTensor::clear() {
+  const size_t n = n_words();
+  for (size_t i = 0; i < n; ++i)
+    m_data[i] = 0;
+}
+
+// -----------------------------------------------------------------------
+// Float conversion goes through a row-major tensor
+// -----------------------------------------------------------------------
+void BitTensor::from_floats(const float* data) {
+  if (m_layout != BITS_ROW_MAJOR) {
+    BitTensor rm(m_planes, m_height, m_width);
+    rm.from_floats(data);
+    convert_from(rm);
+    return;
+  }
+  const size_t n = bits();
+  for (size_t i = 0; i < n; i += WORD_SIZE) {
+    const unsigned len = (n - i < WORD_SIZE) ? n - i : WORD_SIZE;
+    m_data[i / WORD_SIZE] = from_u64(pack_signs64(data + i, len));
+  }
+}
+
+void BitTensor::to_floats(float* data) const {
+  if (m_layout != BITS_ROW_MAJOR) {
+    BitTensor rm(m_planes, m_height, m_width);
+    rm.convert_from(*this);
+    rm.to_floats(data);
+    return;
+  }
+  const size_t n = bits();
+  for (size_t i = 0; i < n; i += WORD_SIZE) {
+    const uint64_t w = to_u64(m_data[i / WORD_SIZE]);
+    unpack_signs(data + i, &w, (n - i < WORD_SIZE) ? n - i : WORD_SIZE);
+  }
+}
+
+// -----------------------------------------------------------------------
+// Layout conversion. Row-major <-> banked is a word permutation and
+// row-major <-> channels a 64x64 bit transpose per tile of 64 planes by
+// 64 pixels, anything else goes bit by bit.
+// -----------------------------------------------------------------------
+void BitTensor::convert_from(const BitTensor& src) {
+  assert(src.m_planes == m_planes && src.m_height == m_height &&
+         src.m_width == m_width);
+  assert(src.m_data != m_data);
+
+  if (src.m_layout == m_layout) {
+    const size_t n = n_words();
+    for (size_t i = 0; i < n; ++i)
+      m_data[i] = src.m_data[i];
+    return;
+  }
+
+  const size_t rm_words = div_up(bits(), WORD_SIZE);
+  if (m_layout == BITS_BANKED && src.m_layout == BITS_ROW_MAJOR) {
+    clear();
+    for (size_t i = 0; i < rm_words; ++i)
+      m_data[banked_index(i)] = src.m_data[i];
+    return;
+  }
+  if (m_layout == BITS_ROW_MAJOR && src.m_layout == BITS_BANKED) {
+    for (size_t i = 0; i < rm_words; ++i)
+      m_data[i] = src.m_data[src.banked_index(i)];
+    return;
+  }
+
+  const size_t pixels = size_t(m_height)*m_width;
+  if (m_planes % WORD_SIZE == 0 && pixels % WORD_SIZE == 0 &&
+      (m_layout == BITS_ROW_MAJOR || src.m_layout == BITS_ROW_MAJOR)) {
+    transpose_channels(src);
+    return;
+  }
+
+  clear();
+  for (unsigned p = 0; p < m_planes; ++p)
+    for (unsigned r = 0; r < m_height; ++r)
+      for (unsigned c = 0; c < m_width; ++c)
+        set(p, r, c, src.get(p, r, c));
+}
+
+// Row-major word (plane p, pixel block q) is p*xw + q and channel word
+// (pixel x, plane block b) is x*cw + b. A tile of 64 planes by 64 pixels
+// is 64 words in either layout and one transpose maps between them.
+void BitTensor::transpose_channels(const BitTensor& src) {
+  const size_t cw = m_planes / WORD_SIZE;
+  const size_t xw = size_t(m_height)*m_width / WORD_SIZE;
+  const bool to_channels = (m_layout == BITS_CHANNELS);
+  uint64_t tile[WORD_SIZE];
+
+  for (size_t b = 0; b < cw; ++b) {
+    for (size_t q = 0; q < xw; ++q) {
+      for (unsigned k = 0; k < WORD_SIZE; ++k) {
+        const size_t s = to_channels ? (b*WORD_SIZE + k)*xw + q
+                                     : (q*WORD_SIZE + k)*cw + b;
+        tile[k] = to_u64(src.m_data[s]);
+      }
+      transpose64(tile);
+      for (unsigned k = 0; k < WORD_SIZE; ++k) {
+        const size_t d = to_channels ? (q*WORD_SIZE + k)*cw + b
+                                     : (b*WORD_SIZE + k)*xw + q;
+        m_data[d] = from_u64(tile[k]);
+      }
+    }
+  }
+}
+
+size_t BitTensor::count_diffs(const BitTensor& other) const {
+  assert(other.m_planes == m_planes && other.m_height == m_height &&
+         other.m_width == m_width);
+  size_t diffs = 0;
+  if (other.m_layout == BITS_ROW_MAJOR && m_layout == BITS_ROW_MAJOR) {
+    // whole words, then only the used bits of the last one
+    const size_t n = bits();
+    for (size_t i = 0; i < n / WORD_SIZE; ++i)
+      diffs += __builtin_popcountll(to_u64(m_data[i] ^ other.m_data[i]));
+    if (n % WORD_SIZE) {
+      const uint64_t mask = (uint64_t(1) << (n % WORD_SIZE)) - 1;
+      const size_t i = n / WORD_SIZE;
+      diffs += __builtin_popcountll(to_u64(m_data[i] ^ other.m_data[i]) & mask);
+    }
+    return diffs;
+  }
+  for (unsigned p = 0; p < m_planes; ++p)
+    for (unsigned r = 0; r < m_height; ++r)
+      for (unsigned c = 0; c < m_width; ++c)
+        diffs += (get(p, r, c) != other.get(p, r, c));
+  return diffs;
+}
@@ -0,0 +1,131 @@
+#ifndef ACCEL_BIT_TENSOR_H
+#define ACCEL_BIT_TENSOR_H
+
+#include <cstddef>
+
+#include "Accel.h"
+
+//------------------------------------------------------------------------
+// Binary feature maps with an explicit shape and packing layout.
+//
+// A BitTensor holds [planes] maps of [height] x [width] bits. Element
+// (p,r,c) has the linear index i = (p*height + r)*width + c, and the
+// layout decides which Word and bit it lives in:
+//
+//  BITS_ROW_MAJOR  bit i%64 of word i/64. This is the dmem_i / dmem_o
+//                  interface of top() and what the test references use.
+//  BITS_BANKED     the accelerator's internal dmem order. The row-major
+//                  words are grouped into units of one plane (or one
+//                  word for planes under 64 bits), unit u goes to bank
+//                  u%CONVOLVERS at unit u/CONVOLVERS, and the banks are
+//                  stored back to back. Same mapping as LOOP_DMEM_I.
+//  BITS_CHANNELS   pixel-major: pixel r*width+c owns ceil(planes/64)
+//                  words and bit p%64 of its word p/64 is plane p, the
+//                  layout of the CPU conv kernels in CpuKernels that
+//                  GoldenModel and DeltaInference share.
+//
+// Storage is 64-byte aligned. A tensor either owns it, takes it from a
+// BitArena, or is a zero-copy view of an existing buffer such as one
+// from dma_pool(). Tensors cannot be copied, use convert_from().
+//------------------------------------------------------------------------
+enum BitLayout {
+  BITS_ROW_MAJOR = 0,
+  BITS_BANKED = 1,
+  BITS_CHANNELS = 2
+};
+
+//------------------------------------------------------------------------
+// Bump allocator handing out 64-byte aligned Word ranges from a single
+// block, released all at once by reset() or the destructor
+//------------------------------------------------------------------------
+class BitArena {
+  Word* m_base;
+  size_t m_words;
+  size_t m_used;
+
+  public:
+    // Reserves space for [words] Words
+    BitArena(size_t words);
+    ~BitArena();
+
+    // Returns [n] zeroed Words, exits if the arena is full
+    Word* alloc(size_t n);
+    void reset() { m_used = 0; }
+
+    size_t capacity() const { return m_words; }
+    size_t used() const { return m_used; }
+
+  private:
+    BitArena(const BitArena&);
+    BitArena& operator=(const BitArena&);
+};
+
+class BitTensor {
+  Word* m_data;
+  bool m_owned;
+  unsigned m_planes, m_height, m_width;
+  BitLayout m_layout;
+
+  public:
+    // Allocates a zeroed tensor
+    BitTensor(unsigned planes, unsigned height, unsigned width,
+              BitLayout layout = BITS_ROW_MAJOR);
+    // Allocates a zeroed tensor from [arena]
+    BitTensor(BitArena& arena, unsigned planes, unsigned height,
+              unsigned width, BitLayout layout = BITS_ROW_MAJOR);
+    // View of [data] which must hold at least num_words(...) Words
+    BitTensor(Word* data, unsigned planes, unsigned height,
+              unsigned width, BitLayout layout = BITS_ROW_MAJOR);
+    ~BitTensor();
+
+    unsigned planes() const { return m_planes; }
+    unsigned height() const { return m_height; }
+    unsigned width()  const { return m_width; }
+    BitLayout layout() const { return m_layout; }
+    size_t bits() const { return size_t(m_planes)*m_height*m_width; }
+
+    // Word-level views
+    Word* words() { return m_data; }
+    const Word* words() const { return m_data; }
+    size_t n_words() const {
+      return num_words(m_planes, m_height, m_width, m_layout);
+    }
+    // Start and size of bank [b] of a BITS_BANKED tensor
+    Word* bank(unsigned b);
+    const Word* bank(unsigned b) const;
+    size_t bank_words() const;
+
+    Bit get(unsigned p, unsigned r, unsigned c) const;
+    void set(unsigned p, unsigned r, unsigned c, Bit b);
+    void clear();
+
+    // Binarize [planes*height*width] floats given in (p,r,c) order,
+    // negative values set a bit
+    void from_floats(const float* data);
+    // Writes -1.0 for set and +1.0 for clear bits in (p,r,c) order
+    void to_floats(float* data) const;
+
+    // Copies the bits of [src], which must have the same shape but
+    // may have any layout
+    void convert_from(const BitTensor& src);
+    // Number of elements that differ from [other], same shape
+    size_t count_diffs(const BitTensor& other) const;
+
+    // Words needed for a tensor of the given shape and layout
+    static size_t num_words(unsigned planes, unsigned height,
+                            unsigned width, BitLayout layout);
+
+  private:
+    BitTensor(const BitTensor&);
+    BitTensor& operator=(const BitTensor&);
+
+    // words in one banked unit
+    size_t unit_words() const;
+    // storage index of row-major word [i] in a BITS_BANKED tensor
+    size_t banked_index(size_t i) const;
+    // storage word and bit of element (p,r,c)
+    size_t locate(unsigned p, unsigned r, unsigned c, unsigned& bit) const;
+    void transpose_channels(const BitTensor& src);
+};
+
+#endif
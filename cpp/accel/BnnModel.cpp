@@ -0,0 +1,767 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <utility>
+#include <vector>
+
+#include "AccelSw.h"
+#include "BnnModel.h"
+#include "BufferPool.h"
+#include "Common.h"
+#include "Dense.h"
+#include "LowJitter.h"
+#include "MemTrack.h"
+#include "Metrics.h"
+#include "ParallelFor.h"
+#include "Trace.h"
+
+// -----------------------------------------------------------------------
+// Startup is split into tasks that write disjoint words: conv filter
+// ranges aligned to whole Words, 64-output blocks of the dense layers,
+// the kh params of one layer, one invocation of a schedule
+// -----------------------------------------------------------------------
+typedef std::chrono::steady_clock Clock;
+
+// conv filters / dense outputs packed per task
+static const unsigned CONV_FILTERS_PER_TASK = CONV_W_PER_WORD * 2048;
+static const unsigned DENSE_OUTPUTS_PER_TASK = WORD_SIZE;
+
+struct PackTask {
+  unsigned layer;       // 0-based
+  bool kh;              // the kh params instead of weights
+  unsigned begin, end;  // filter (conv) or output (dense) range
+};
+
+static float seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<float>(Clock::now() - t0).count();
+}
+
+// -----------------------------------------------------------------------
+// Memory accounting (MemTrack.h): [sign] +1 tags, -1 untags
+// -----------------------------------------------------------------------
+static int param_array_layer(unsigned i) {
+  for (unsigned l = 0; l < N_LAYERS; ++l)
+    if (widx_tab[l] == i || kidx_tab[l] == i || hidx_tab[l] == i)
+      return l;
+  return MEM_NO_LAYER;
+}
+
+static void tag_params(const Params* params, const PackedParams* packed, int sign) {
+  if (params) {
+    for (unsigned i = 0; i < params->num_arrays(); ++i)
+      mem_tag(MEM_PARAMS, param_array_layer(i), sign * (long long)params->array_size(i));
+  }
+  if (packed) {
+    long long rest = packed->bytes();
+    for (unsigned i = 0; i < packed->num_arrays(); ++i) {
+      const PackedArrayInfo& info = packed->array(i).info;
+      mem_tag(MEM_PARAMS, int(info.layer) - 1, sign * (long long)info.bytes);
+      rest -= info.bytes;
+    }
+    mem_tag(MEM_PARAMS, MEM_NO_LAYER, sign * rest);
+  }
+}
+
+// buffers the schedule entries own, shared ones belong to wt/kh
+static void tag_schedule(const AccelSchedule& s, unsigned l, int sign) {
+  long long bytes = 0;
+  for (unsigned i = 0; i < s.size(); ++i)
+    if (s[i].owns_buffers)
+      bytes += (s[i].wt_words + s[i].kh_words) * sizeof(Word);
+  mem_tag(MEM_SCHEDULE, l, sign * bytes);
+}
+
+std::string default_param_file() {
+  const char* env = getenv("BNN_PARAMS");
+  return env ? env : get_root_dir() + "/params/cifar10_parameters_nb.zip";
+}
+
+void StartupTimes::print() const {
+  printf ("## Startup: load %.3f s, pack %.3f s, schedule %.3f s "
+          "(%u threads), total %.3f s ##\n",
+      load, pack, schedule, threads, total());
+}
+
+BnnModel::BnnModel(std::string param_file, unsigned n_threads)
+  : params(NULL),
+    packed(NULL),
+    cpu_dense(false),
+    cpu_last(false),
+    accel(top),
+    delta(NULL),
+    compacted(false)
+{
+  Clock::time_point t0 = Clock::now();
+  if (PackedParams::is_packed(param_file))
+    packed = new PackedParams(param_file);
+  else
+    params = new Params(param_file);
+  if (!check_archive(params, packed))
+    exit(-1);
+  startup.load = seconds_since(t0);
+  init(n_threads);
+}
+
+BnnModel::BnnModel(Params* p, PackedParams* pp, unsigned n_threads)
+  : params(p),
+    packed(pp),
+    cpu_dense(false),
+    cpu_last(false),
+    accel(top),
+    delta(NULL),
+    compacted(false)
+{
+  assert((params == NULL) != (packed == NULL));
+  init(n_threads);
+}
+
+void BnnModel::init(unsigned n_threads) {
+  startup.threads = n_threads ? n_threads : default_threads();
+  tag_params(params, packed, 1);
+  mem_phase("load");
+
+  // ---------------------------------------------------------------------
+  // allocate and binarize all weights, or copy them from a packed archive
+  // ---------------------------------------------------------------------
+  Clock::time_point t0 = Clock::now();
+  std::vector<PackTask> tasks;
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    const unsigned M = M_tab[l];
+    const unsigned N = N_tab[l];
+    wt_words[l] = layer_is_conv(l+1) ? WTS_TO_WORDS(M*N) : M*N / WORD_SIZE;
+    wt[l] = new Word[wt_words[l]];
+    kh_words[l] = N/KH_PER_WORD * sizeof(Word);
+    kh[l] = new Word[kh_words[l]];
+    mem_tag(MEM_PACKED, l, (wt_words[l] + kh_words[l]) * sizeof(Word));
+
+    // a packed archive is copied one array per task
+    const unsigned size = packed ? 1 : layer_is_conv(l+1) ? M*N : N;
+    const unsigned step = layer_is_conv(l+1) ? CONV_FILTERS_PER_TASK
+                                             : DENSE_OUTPUTS_PER_TASK;
+    for (unsigned i = 0; i < size; i += step) {
+      PackTask t = { l, false, i, (size - i < step) ? size : i + step };
+      tasks.push_back(t);
+    }
+    PackTask t = { l, true, 0, N };
+    tasks.push_back(t);
+  }
+
+  parallel_for(tasks.size(), startup.threads, [&](unsigned i) {
+    const PackTask& t = tasks[i];
+    const unsigned l = t.layer;
+    if (packed) {
+      if (t.kh)
+        copy_packed(l, PACKED_KH, kh[l], packed_kh_words(l));
+      else
+        copy_packed(l, PACKED_WT, wt[l], packed_wt_words(l));
+    } else if (t.kh) {
+      const float* k = params->float_data(kidx_tab[l]);
+      const float* h = params->float_data(hidx_tab[l]);
+      set_bnorm_array(kh[l], k, h, l+1);
+    } else if (layer_is_conv(l+1)) {
+      set_conv_weight_array(wt[l], params->float_data(widx_tab[l]), t.begin, t.end);
+    } else {
+      set_dense_weight_array(wt[l], params->float_data(widx_tab[l]),
+                             M_tab[l], N_tab[l], t.begin, t.end);
+    }
+  });
+  startup.pack = seconds_since(t0);
+  mem_phase("pack");
+
+  // ---------------------------------------------------------------------
+  // compute accelerator schedule (divides up weights)
+  // ---------------------------------------------------------------------
+  t0 = Clock::now();
+  std::vector<std::pair<unsigned, unsigned> > entries;  // (layer, idx)
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    plan_accel_schedule(M_tab[l], N_tab[l], S_tab[l], T_tab[l], pool_tab[l],
+                        sched[l]);
+    tag_schedule(sched[l], l, 1);
+    for (unsigned i = 0; i < sched[l].size(); ++i)
+      entries.push_back(std::make_pair(l, i));
+  }
+
+  parallel_for(entries.size(), startup.threads, [&](unsigned i) {
+    const unsigned l = entries[i].first;
+    load_accel_schedule_entry(wt[l], kh[l], T_tab[l], sched[l], entries[i].second);
+  });
+  startup.schedule = seconds_since(t0);
+
+  // allocate memories for data i/o for the accelerator, data_o is
+  // sized for a full conv layer output so the memos can read it back
+  data_i = (Word*) dma_pool().acquire( DMEM_WORDS * sizeof(Word) );
+  data_o = (Word*) dma_pool().acquire( DMEM_WORDS * sizeof(Word) );
+  if (!data_i || !data_o) {
+    fprintf (stderr, "**** ERROR: Alloc failed in %s\n", __FILE__);
+    exit(-2);
+  }
+  mem_phase("schedule");
+}
+
+BnnModel::~BnnModel() {
+  tag_params(params, packed, -1);
+  delete delta;
+  delete params;
+  delete packed;
+  dma_pool().release( data_o );
+  dma_pool().release( data_i );
+  for (unsigned n = 0; n < N_LAYERS; ++n) {
+    mem_tag(MEM_PACKED, n, -(long long)((wt_words[n] + kh_words[n]) * sizeof(Word)));
+    mem_tag(MEM_PARAMS, n, -(long long)((m_k[n].size() + m_h[n].size()) * sizeof(float)));
+    tag_schedule(sched[n], n, -1);
+    delete[] wt[n];
+    delete[] kh[n];
+  }
+}
+
+// -----------------------------------------------------------------------
+// Packed archives. Only the words that carry data are stored: the conv
+// filters without the CONVOLVERS padding, N/KH_PER_WORD threshold words
+// or N/2 k,h pair words for the last layer.
+// -----------------------------------------------------------------------
+unsigned BnnModel::packed_wt_words(unsigned l) {
+  const unsigned MN = M_tab[l] * N_tab[l];
+  return layer_is_conv(l+1) ? (MN + CONV_W_PER_WORD-1) / CONV_W_PER_WORD
+                            : MN / WORD_SIZE;
+}
+
+unsigned BnnModel::packed_kh_words(unsigned l) {
+  const unsigned N = N_tab[l];
+  return layer_is_last(l+1) ? (N+1) / 2 : (N + KH_PER_WORD-1) / KH_PER_WORD;
+}
+
+// -----------------------------------------------------------------------
+// Float archives hold the weights, k and h of every layer at widx_tab,
+// kidx_tab, hidx_tab. Packed archives hold the weight and kh words of
+// every layer and the float k, h of the dense layers.
+// -----------------------------------------------------------------------
+static bool check_packed_array(const PackedParams* packed, unsigned l,
+                               unsigned kind, size_t bytes) {
+  const PackedArray* a = packed->find(l+1, kind);
+  if (!a || a->info.M != M_tab[l] || a->info.N != N_tab[l] ||
+      a->info.bytes != bytes) {
+    static const char* const kind_names[] = { "weight", "kh", "k", "h" };
+    fprintf (stderr, "**** ERROR: packed params have no %s array of shape "
+             "%ux%u for layer %u\n", kind_names[kind], M_tab[l], N_tab[l], l+1);
+    return false;
+  }
+  return true;
+}
+
+bool BnnModel::check_archive(const Params* params, const PackedParams* packed) {
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    const unsigned M = M_tab[l];
+    const unsigned N = N_tab[l];
+    if (packed) {
+      if (!check_packed_array(packed, l, PACKED_WT, packed_wt_words(l) * sizeof(uint64_t)) ||
+          !check_packed_array(packed, l, PACKED_KH, packed_kh_words(l) * sizeof(uint64_t)))
+        return false;
+      if (!layer_is_conv(l+1) &&
+          (!check_packed_array(packed, l, PACKED_K, N * sizeof(float)) ||
+           !check_packed_array(packed, l, PACKED_H, N * sizeof(float))))
+        return false;
+    } else {
+      const unsigned wt_floats = layer_is_conv(l+1) ? M*N*K*K : M*N;
+      const unsigned idx[3] = { widx_tab[l], kidx_tab[l], hidx_tab[l] };
+      const unsigned floats[3] = { wt_floats, N, N };
+      for (unsigned i = 0; i < 3; ++i) {
+        if (idx[i] >= params->num_arrays() ||
+            params->array_size(idx[i]) != floats[i] * sizeof(float)) {
+          fprintf (stderr, "**** ERROR: params array %u of layer %u should "
+                   "hold %u floats\n", idx[i], l+1, floats[i]);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void BnnModel::copy_packed(unsigned l, unsigned kind, Word* dst, unsigned n_words) {
+  if (!check_packed_array(packed, l, kind, n_words * sizeof(uint64_t)))
+    exit(-1);
+  const uint64_t* src = (const uint64_t*) packed->find(l+1, kind)->data;
+  for (unsigned i = 0; i < n_words; ++i)
+    dst[i] = src[i];
+}
+
+const float* BnnModel::k_data(unsigned l) const {
+  if (compacted)
+    return &m_k[l][0];
+  if (params)
+    return params->float_data(kidx_tab[l]);
+  if (!check_packed_array(packed, l, PACKED_K, N_tab[l] * sizeof(float)))
+    exit(-1);
+  return (const float*) packed->find(l+1, PACKED_K)->data;
+}
+
+const float* BnnModel::h_data(unsigned l) const {
+  if (compacted)
+    return &m_h[l][0];
+  if (params)
+    return params->float_data(hidx_tab[l]);
+  if (!check_packed_array(packed, l, PACKED_H, N_tab[l] * sizeof(float)))
+    exit(-1);
+  return (const float*) packed->find(l+1, PACKED_H)->data;
+}
+
+bool BnnModel::save_packed(std::string filename) const {
+  if (compacted) {
+    fprintf (stderr, "Cannot save a compacted model, the conv weights are gone\n");
+    return false;
+  }
+  // the Words as plain 64-bit integers
+  std::vector<std::vector<uint64_t> > words;
+  std::vector<PackedArray> arrays;
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    for (unsigned kind = PACKED_WT; kind <= PACKED_KH; ++kind) {
+      const Word* src = (kind == PACKED_WT) ? wt[l] : kh[l];
+      const unsigned n = (kind == PACKED_WT) ? packed_wt_words(l) : packed_kh_words(l);
+      words.push_back(std::vector<uint64_t>(n));
+      for (unsigned i = 0; i < n; ++i)
+        words.back()[i] = src[i].to_uint64();
+    }
+  }
+
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    for (unsigned kind = PACKED_WT; kind <= PACKED_H; ++kind) {
+      // the float k, h are only kept for the CPU dense layers
+      if (kind >= PACKED_K && layer_is_conv(l+1))
+        continue;
+      PackedArray a;
+      a.info.layer = l+1;
+      a.info.kind = kind;
+      a.info.M = M_tab[l];
+      a.info.N = N_tab[l];
+      a.info.offset = 0;
+      if (kind <= PACKED_KH) {
+        const std::vector<uint64_t>& w = words[2*l + kind];
+        a.info.bytes = w.size() * sizeof(uint64_t);
+        a.data = &w[0];
+      } else {
+        a.info.bytes = N_tab[l] * sizeof(float);
+        a.data = (kind == PACKED_K) ? k_data(l) : h_data(l);
+      }
+      arrays.push_back(a);
+    }
+  }
+  return write_packed_params(filename, arrays);
+}
+
+void BnnModel::read_env() {
+  cpu_dense = getenv("BNN_DENSE_LAYER_CPU") != NULL;
+  cpu_last = getenv("BNN_LAST_LAYER_CPU") != NULL;
+
+  const char* accel_env = getenv("BNN_ACCEL");
+  accel = top;
+  if (accel_env && !strcmp(accel_env, "sw"))
+    accel = top_sw;
+  else if (accel_env && strcmp(accel_env, "hls"))
+    fprintf (stderr, "Unknown BNN_ACCEL=%s, using the HLS model\n", accel_env);
+
+  const char* cache_env = getenv("BNN_CACHE_SIZE");
+  const char* memo_env = getenv("BNN_MEMO_SIZE");
+  cache.set_capacity(cache_env ? atoi(cache_env) : 0);
+  for (unsigned l = 0; l < LCONV; ++l)
+    memo[l].set_capacity(memo_env ? atoi(memo_env) : 0);
+  set_cache_bypass(getenv("BNN_CACHE_BYPASS") != NULL);
+  set_delta(getenv("BNN_DELTA") != NULL);
+  if (getenv("BNN_COMPACT")) {
+    if (delta)
+      fprintf (stderr, "BNN_COMPACT is ignored in delta mode\n");
+    else
+      compact();
+  }
+  metrics_start_from_env();
+}
+
+void BnnModel::set_cache_bypass(bool bypass) {
+  cache.set_bypass(bypass);
+  for (unsigned l = 0; l < LCONV; ++l)
+    memo[l].set_bypass(bypass);
+}
+
+void BnnModel::set_delta(bool on) {
+  if (on && compacted) {
+    fprintf (stderr, "Delta mode is not available on a compacted model\n");
+    return;
+  }
+  if (on && !delta)
+    delta = new DeltaInference(wt, kh);
+  if (!on) {
+    delete delta;
+    delta = NULL;
+  }
+}
+
+size_t BnnModel::compact() {
+  if (compacted)
+    return 0;
+  size_t freed = 0;
+
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    if (layer_is_conv(l+1)) {
+      freed += (wt_words[l] + kh_words[l]) * sizeof(Word);
+      mem_tag(MEM_PACKED, l, -(long long)((wt_words[l] + kh_words[l]) * sizeof(Word)));
+      delete[] wt[l];
+      delete[] kh[l];
+      wt[l] = kh[l] = NULL;
+      wt_words[l] = kh_words[l] = 0;
+    } else {
+      m_k[l].assign(k_data(l), k_data(l) + N_tab[l]);
+      m_h[l].assign(h_data(l), h_data(l) + N_tab[l]);
+      mem_tag(MEM_PARAMS, l, 2 * N_tab[l] * sizeof(float));
+      tag_schedule(sched[l], l, -1);
+      freed += share_dense_weights(wt[l], kh[l], T_tab[l], sched[l]);
+      tag_schedule(sched[l], l, 1);
+    }
+  }
+
+  tag_params(params, packed, -1);
+  if (params) {
+    for (unsigned i = 0; i < params->num_arrays(); ++i)
+      freed += params->array_size(i);
+    delete params;
+    params = NULL;
+  }
+  if (packed) {
+    freed += packed->bytes();
+    delete packed;
+    packed = NULL;
+  }
+  compacted = true;
+
+#ifdef __GLIBC__
+  // hand the freed heap back to the OS so that it shows in the RSS
+  malloc_trim(0);
+#endif
+  return freed;
+}
+
+size_t BnnModel::lock_resident() {
+  size_t bytes = 0;
+  unsigned failed = 0;
+  // lock first so that the pages faulted in below stay resident
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    failed += !lock_pages(wt[l], wt_words[l]*sizeof(Word));
+    failed += !lock_pages(kh[l], kh_words[l]*sizeof(Word));
+    prefault_pages(wt[l], wt_words[l]*sizeof(Word));
+    prefault_pages(kh[l], kh_words[l]*sizeof(Word));
+    bytes += (wt_words[l] + kh_words[l]) * sizeof(Word);
+
+    for (unsigned i = 0; i < sched[l].size(); ++i) {
+      AccelInfo& a = sched[l][i];
+      if (!a.owns_buffers)
+        continue;
+      failed += !lock_pages(a.wt, a.wt_words*sizeof(Word));
+      failed += !lock_pages(a.kh, a.kh_words*sizeof(Word));
+      prefault_pages(a.wt, a.wt_words*sizeof(Word));
+      prefault_pages(a.kh, a.kh_words*sizeof(Word));
+      bytes += (a.wt_words + a.kh_words) * sizeof(Word);
+    }
+  }
+
+  // run_accel_schedule's weight buffers come from the pool, get them
+  // into it now instead of on the first image
+  void* wt_i = dma_pool().acquire( WT_WORDS*sizeof(Word) );
+  void* kh_i = dma_pool().acquire( KH_WORDS*sizeof(Word) );
+  dma_pool().release(wt_i);
+  dma_pool().release(kh_i);
+  failed += !dma_pool().lock_buffers();
+  bytes += dma_pool().stats().bytes_reserved;
+
+  if (failed)
+    fprintf(stderr, "lock_resident: %u regions could not be locked, "
+                    "check ulimit -l\n", failed);
+  return bytes;
+}
+
+void BnnModel::print_stats() const {
+  if (cache.capacity() > 0)
+    cache.print_stats("Result cache");
+  for (unsigned l = 0; l < LCONV; ++l) {
+    if (memo[l].capacity() > 0) {
+      char name[32];
+      snprintf(name, sizeof(name), "Conv%u memo", l+1);
+      memo[l].print_stats(name);
+    }
+  }
+  if (delta)
+    delta->print_stats();
+}
+
+int BnnModel::predict(Word* img_i) {
+  const unsigned img_words = S_tab[0]*S_tab[0];
+  TraceScope t("predict", "model");
+  static MetricCounter* n_images = metric_counter("bnn_images_total",
+      "Images run through the model");
+  static MetricCounter* n_hits = metric_counter("bnn_cache_hits_total",
+      "Images answered from the result cache");
+  n_images->inc();
+
+  uint64_t img_hash = 0;
+  if (cache.enabled()) {
+    Word p;
+    img_hash = hash_words(img_i, img_words);
+    if (cache.lookup(img_hash, img_i, img_words, &p)) {
+      t.arg("cache_hit", 1);
+      n_hits->inc();
+      return p.to_int();
+    }
+  }
+
+  bool use_memo = false;
+  for (unsigned l = 0; l < LCONV; ++l)
+    use_memo |= memo[l].enabled();
+
+  int prediction = -1;
+  if (delta) {
+    prediction = delta->predict(img_i);
+  } else {
+    if (use_memo)
+      run_conv_layers_memo(img_i);
+    else
+      run_conv_layers(img_i);
+    prediction = run_dense_layers(!use_memo);
+  }
+
+  if (cache.enabled()) {
+    Word p = prediction;
+    cache.insert(img_hash, img_i, img_words, &p, 1);
+  }
+  return prediction;
+}
+
+void BnnModel::predict_batch(Word* const* imgs, unsigned n, int* predictions) {
+  if (!batch_shares_work()) {
+    for (unsigned b = 0; b < n; ++b)
+      predictions[b] = predict(imgs[b]);
+    return;
+  }
+
+  const unsigned img_words = S_tab[0]*S_tab[0];
+  TraceScope t("predict_batch", "model");
+  t.arg("images", n);
+  static MetricCounter* n_images = metric_counter("bnn_images_total",
+      "Images run through the model");
+  static MetricCounter* n_hits = metric_counter("bnn_cache_hits_total",
+      "Images answered from the result cache");
+  n_images->inc(n);
+
+  // the images that miss the result cache
+  std::vector<unsigned> run;
+  std::vector<uint64_t> img_hash(n, 0);
+  for (unsigned b = 0; b < n; ++b) {
+    if (cache.enabled()) {
+      Word p;
+      img_hash[b] = hash_words(imgs[b], img_words);
+      if (cache.lookup(img_hash[b], imgs[b], img_words, &p)) {
+        n_hits->inc();
+        predictions[b] = p.to_int();
+        continue;
+      }
+    }
+    run.push_back(b);
+  }
+  const unsigned R = run.size();
+  if (R == 0)
+    return;
+
+  bool use_memo = false;
+  for (unsigned l = 0; l < LCONV; ++l)
+    use_memo |= memo[l].enabled();
+
+  // the conv layers run image by image, their outputs are gathered as
+  // the dense layer inputs of the batch
+  unsigned max_words = 0;
+  for (unsigned l = LCONV; l <= LDENSE; ++l)
+    max_words = std::max(max_words, M_tab[l] / WORD_SIZE);
+  m_batch_fmaps[0].resize(R * max_words);
+  m_batch_fmaps[1].resize(R * max_words);
+
+  const unsigned fmap_words = M_tab[LCONV] / WORD_SIZE;
+  for (unsigned r = 0; r < R; ++r) {
+    if (use_memo)
+      run_conv_layers_memo(imgs[run[r]]);
+    else
+      run_conv_layers(imgs[run[r]]);
+    const Word* conv_o = use_memo ? data_i : data_o;
+    TraceScope c("copy", "host");
+    c.arg("words", fmap_words);
+    for (unsigned i = 0; i < fmap_words; ++i)
+      m_batch_fmaps[0][r*max_words + i] = conv_o[i];
+  }
+
+  std::vector<const Word*> in(R);
+  std::vector<Word*> out(R);
+  unsigned cur = 0;
+  for (unsigned l = LCONV+1; l <= LDENSE; ++l) {
+    TraceScope tl(name_tab[l-1], "layer");
+    tl.arg("layer", l).arg("images", R);
+    for (unsigned r = 0; r < R; ++r) {
+      in[r] = &m_batch_fmaps[cur][r*max_words];
+      out[r] = &m_batch_fmaps[1-cur][r*max_words];
+    }
+    dense_layer_cpu_batch(wt[l-1], k_data(l-1), h_data(l-1),
+                          &in[0], &out[0], R, M_tab[l-1], N_tab[l-1]);
+    cur = 1 - cur;
+  }
+
+  std::vector<int> pred(R);
+  {
+    TraceScope tl(name_tab[LDENSE], "layer");
+    tl.arg("layer", LDENSE+1).arg("images", R);
+    for (unsigned r = 0; r < R; ++r)
+      in[r] = &m_batch_fmaps[cur][r*max_words];
+    last_layer_cpu_batch(wt[LDENSE], k_data(LDENSE), h_data(LDENSE),
+                         &in[0], &pred[0], R, M_tab[LDENSE], N_tab[LDENSE]);
+  }
+
+  for (unsigned r = 0; r < R; ++r) {
+    const unsigned b = run[r];
+    predictions[b] = pred[r];
+    if (cache.enabled()) {
+      Word p = pred[r];
+      cache.insert(img_hash[b], imgs[b], img_words, &p, 1);
+    }
+  }
+}
+
+//------------------------------------------------------------
+// Conv layers, the feature maps stay in the accelerator
+//------------------------------------------------------------
+void BnnModel::run_conv_layers(Word* img_i) {
+  for (unsigned l = 1; l <= LCONV; ++l) {
+    const unsigned M = M_tab[l-1];
+    const unsigned N = N_tab[l-1];
+    const unsigned S = S_tab[l-1];
+    unsigned input_words = (l==1) ? S*S : M*S*S/WORD_SIZE;
+    unsigned output_words = (pool_tab[l-1]) ? N*S*S/WORD_SIZE/4 : N*S*S/WORD_SIZE;
+
+    TraceScope t(name_tab[l-1], "layer");
+    t.arg("layer", l);
+    run_accel_schedule(
+        (l==1) ? img_i : data_i, data_o,
+        l-1,        // layer_idx
+        (l==1) ? input_words : 0,
+        (l==LCONV && cpu_dense) ? output_words : 0,
+        l % 2,      // mem_mode
+        sched[l-1],
+        accel
+    );
+  }
+}
+
+//------------------------------------------------------------
+// Conv layers with memos, every layer reads its input from and
+// writes its output to memory. On exit data_i and data_o both
+// hold the output of the last conv layer.
+//------------------------------------------------------------
+void BnnModel::run_conv_layers_memo(Word* img_i) {
+  const Word* in = img_i;
+
+  for (unsigned l = 1; l <= LCONV; ++l) {
+    const unsigned M = M_tab[l-1];
+    const unsigned N = N_tab[l-1];
+    const unsigned S = S_tab[l-1];
+    unsigned input_words = (l==1) ? S*S : M*S*S/WORD_SIZE;
+    unsigned output_words = (pool_tab[l-1]) ? N*S*S/WORD_SIZE/4 : N*S*S/WORD_SIZE;
+
+    TraceScope t(name_tab[l-1], "layer");
+    t.arg("layer", l);
+    const uint64_t h = memo[l-1].enabled() ? hash_words(in, input_words) : 0;
+    if (!memo[l-1].lookup(h, in, input_words, data_o)) {
+      run_accel_schedule(
+          (Word*)in, data_o,
+          l-1,
+          input_words,
+          output_words,
+          l % 2,
+          sched[l-1],
+          accel
+      );
+      memo[l-1].insert(h, in, input_words, data_o, output_words);
+    } else {
+      t.arg("memo_hit", 1);
+    }
+
+    TraceScope c("copy", "host");
+    c.arg("words", output_words);
+    for (unsigned i = 0; i < output_words; ++i)
+      data_i[i] = data_o[i];
+    in = data_i;
+  }
+}
+
+//------------------------------------------------------------
+// Dense and last layers, returns the predicted class. With
+// [input_in_dmem] the accelerator still holds the conv6 output,
+// otherwise it is taken from data_i.
+//------------------------------------------------------------
+int BnnModel::run_dense_layers(bool input_in_dmem) {
+  for (unsigned l = LCONV+1; l <= LDENSE; ++l) {
+    const unsigned M = M_tab[l-1];
+    const unsigned N = N_tab[l-1];
+    TraceScope t(name_tab[l-1], "layer");
+    t.arg("layer", l);
+
+    if (cpu_dense) {
+      {
+        TraceScope c("copy", "host");
+        c.arg("words", M/WORD_SIZE);
+        for (unsigned i = 0; i < M/WORD_SIZE; ++i)
+          data_i[i] = data_o[i];
+      }
+
+      dense_layer_cpu(
+          wt[l-1], k_data(l-1), h_data(l-1),
+          data_i, data_o, M, N
+      );
+
+    } else {
+      run_accel_schedule(
+          data_i, data_o,
+          l-1,
+          (l==LCONV+1 && !input_in_dmem) ? M/WORD_SIZE : 0,
+          (l==LDENSE && cpu_last) ? 1024/WORD_SIZE : 0,
+          l % 2,
+          sched[l-1],
+          accel
+      );
+    }
+  }
+
+  //------------------------------------------------------------
+  // Execute last layer
+  //------------------------------------------------------------
+  int prediction = -1;
+  TraceScope t(name_tab[LDENSE], "layer");
+  t.arg("layer", LDENSE+1);
+  if (cpu_dense || cpu_last) {
+    prediction = last_layer_cpu(
+        wt[LDENSE],
+        k_data(LDENSE),
+        h_data(LDENSE),
+        data_o,
+        M_tab[LDENSE], N_tab[LDENSE]
+    );
+  } else {
+    run_accel_schedule(
+        data_i, data_o,
+        LDENSE,
+        0, 1,
+        1,
+        sched[LDENSE],
+        accel
+    );
+    ap_int<8> p = 0;
+    p(7,0) = data_o[0](7,0);
+    prediction = p.to_int();
+  }
+
+  return prediction;
+}
@@ -0,0 +1,166 @@
+#ifndef ACCEL_BNN_MODEL_H
+#define ACCEL_BNN_MODEL_H
+
+#include <string>
+#include <vector>
+
+#include "Accel.h"
+#include "AccelSchedule.h"
+#include "AccelTest.h"
+#include "ParamIO.h"
+#include "DeltaInference.h"
+#include "ResultCache.h"
+
+//------------------------------------------------------------------------
+// The full 9-layer BNN, ready to run: the source params, the binarized
+// and packed weights and batch-norm params of every layer, the
+// accelerator schedule of every layer and the accelerator data buffers.
+// Build it once and call predict() for each image.
+//
+// Two optional caches sit in front of the accelerator, both are off
+// (capacity 0) by default:
+// - cache maps the conv1 input words of an image to its prediction,
+//   a repeated image skips the network entirely
+// - memo[l] maps the input of conv layer l+1 to its output. With any
+//   memo enabled every conv layer moves its feature maps through
+//   data_i/data_o so that they can be hashed, and a hit skips the layer
+//
+// In delta mode (see DeltaInference.h) all layers run on the CPU and
+// only recompute what changed since the previous image.
+//------------------------------------------------------------------------
+// Wall-clock seconds spent in each phase of building a BnnModel
+struct StartupTimes {
+  float load;         // reading (and inflating) the params archive
+  float pack;         // binarizing and packing weights and kh params
+  float schedule;     // dividing the weights up into invocations
+  unsigned threads;   // threads used by pack and schedule
+
+  StartupTimes() : load(0), pack(0), schedule(0), threads(0) {}
+  float total() const { return load + pack + schedule; }
+  void print() const;
+};
+
+struct BnnModel {
+  static const unsigned LCONV  = 6;   // last conv
+  static const unsigned LDENSE = 8;   // last dense
+
+  StartupTimes startup;
+
+  // the source archive, one of them is NULL
+  Params* params;
+  PackedParams* packed;
+  Word* wt[N_LAYERS];
+  Word* kh[N_LAYERS];
+  unsigned wt_words[N_LAYERS];
+  unsigned kh_words[N_LAYERS];
+  AccelSchedule sched[N_LAYERS];
+
+  // accelerator data i/o
+  Word* data_i;
+  Word* data_o;
+
+  // run the dense / last layers on the CPU instead of the accelerator
+  bool cpu_dense;
+  bool cpu_last;
+
+  // the accelerator the schedules run on, top() or the software
+  // backend top_sw() (see AccelSw.h)
+  AccelTopFn accel;
+
+  ResultCache cache;
+  ResultCache memo[LCONV];
+
+  // NULL unless delta mode is on
+  DeltaInference* delta;
+
+  // set by compact()
+  bool compacted;
+
+  // Loads the params archive, binarizes and packs all layers and
+  // computes their schedules. [param_file] is either the float zip
+  // archive or a packed archive (see PackedParams), which is copied
+  // as it is instead of being binarized. Packing and scheduling are split into
+  // tasks over layers and output blocks and run on [n_threads]
+  // threads, 0 = default_threads().
+  BnnModel(std::string param_file, unsigned n_threads = 0);
+  // Builds the model from an archive the caller has loaded (exactly one
+  // of params, packed is non-NULL) and passed check_archive, the model
+  // takes ownership of it. startup.load is left at 0.
+  BnnModel(Params* params, PackedParams* packed, unsigned n_threads = 0);
+  ~BnnModel();
+
+  // Checks that a loaded archive has every array the model reads, with
+  // the sizes the layer shapes need. Prints the first problem found.
+  static bool check_archive(const Params* params, const PackedParams* packed);
+
+  // Reads the BNN_* environment flags:
+  //   BNN_DENSE_LAYER_CPU, BNN_LAST_LAYER_CPU  set cpu_dense, cpu_last
+  //   BNN_ACCEL=hls|sw    accel = top or top_sw
+  //   BNN_CACHE_SIZE=n    result cache capacity in images
+  //   BNN_MEMO_SIZE=n     capacity of each conv layer memo
+  //   BNN_CACHE_BYPASS    bypass the result cache and all memos
+  //   BNN_DELTA           delta mode
+  //   BNN_COMPACT         compact(), ignored in delta mode
+  //   BNN_METRICS         starts the metrics exporter (Metrics.h)
+  void read_env();
+  void set_cache_bypass(bool bypass);
+  // Delta mode needs the packed conv weights, it cannot be turned on
+  // after compact()
+  void set_delta(bool on);
+  // Keeps one executable copy of each layer and frees everything else:
+  // the source archive (the dense layers' float k/h are kept for the
+  // CPU paths), the packed conv weights (the schedules hold the
+  // accelerator's copy) and the private weight copies of the dense
+  // schedules (they point into the packed dense weights instead).
+  // Returns the number of bytes freed.
+  size_t compact();
+  // Locks the packed weights, the schedules and the DMA buffers into
+  // RAM and pre-faults them (low-jitter mode). Returns the number of
+  // bytes locked, failures are reported.
+  size_t lock_resident();
+  // Prints the cache and delta mode statistics of the enabled ones
+  void print_stats() const;
+  // Writes the packed weights and kh params of all layers, plus the
+  // float k/h of the dense layers, as a packed archive
+  bool save_packed(std::string filename) const;
+
+  // Float batch norm params of layer l (0-based), used by the CPU
+  // dense and last layers
+  const float* k_data(unsigned l) const;
+  const float* h_data(unsigned l) const;
+
+  // Runs all layers on one image, [img_i] holds the conv1 input words
+  // produced by binarize_input_images. Returns the predicted class.
+  int predict(Word* img_i);
+  // Runs [n] images, predictions[b] is the class of imgs[b]. With
+  // cpu_dense the dense and last layers run across the whole batch, so
+  // their weights are read once per batch instead of once per image.
+  // Otherwise the images run one after another: top() keeps the output
+  // index and the partial output words of a dense layer on chip, so one
+  // schedule entry cannot be shared between images.
+  void predict_batch(Word* const* imgs, unsigned n, int* predictions);
+  // true if predict_batch shares work between the images of a batch
+  bool batch_shares_work() const { return cpu_dense && !delta; }
+
+  private:
+    // float k/h of the dense layers once the source archive is freed
+    std::vector<float> m_k[N_LAYERS];
+    std::vector<float> m_h[N_LAYERS];
+    // dense layer inputs / outputs of the images of a batch
+    std::vector<Word> m_batch_fmaps[2];
+
+    void init(unsigned n_threads);
+    static unsigned packed_wt_words(unsigned l);
+    static unsigned packed_kh_words(unsigned l);
+    void copy_packed(unsigned l, unsigned kind, Word* dst, unsigned n_words);
+
+    void run_conv_layers(Word* img_i);
+    void run_conv_layers_memo(Word* img_i);
+    int run_dense_layers(bool input_in_dmem);
+};
+
+// The params archive the tools load: $BNN_PARAMS if set (float or
+// packed), else the float archive in params/
+std::string default_param_file();
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef ACCEL_BNN_PROTOCOL_H
+#define ACCEL_BNN_PROTOCOL_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+//------------------------------------------------------------------------
+// Wire format of the inference server (bnn_server) and its clients, and
+// of the bnn_shard workers. Frames are sent in host byte order over a
+// Unix domain socket or over stdin/stdout:
+//   request  = BnnRequestHeader, then 3*32*32 pixels in [format]
+//   response = BnnResponse
+//------------------------------------------------------------------------
+const uint32_t BNN_REQUEST_MAGIC  = 0x424e4e51;   // "BNNQ"
+const uint32_t BNN_RESPONSE_MAGIC = 0x424e4e52;   // "BNNR"
+
+const unsigned BNN_IMG_PIXELS = 3*32*32;
+
+enum BnnPixelFormat {
+  BNN_PIX_F32_CHW = 0,  // float in [-1,1], planar RGB (the test set format)
+  BNN_PIX_U8_HWC  = 1   // raw 8-bit interleaved RGB
+};
+
+struct BnnRequestHeader {
+  uint32_t magic;
+  uint32_t id;          // echoed back in the response
+  uint32_t format;      // BnnPixelFormat
+};
+
+struct BnnResponse {
+  uint32_t magic;
+  uint32_t id;
+  int32_t  prediction;  // class index, -1 on a malformed request
+  uint32_t latency_us;  // time from arrival to completion in the server
+  uint32_t batch_size;  // size of the batch the request ran in
+};
+
+//------------------------------------------------------------------------
+// Shard report, sent once by an accel_test_bnn worker to the bnn_shard
+// coordinator when BNN_SHARD_REPORT names its socket:
+//   report = BnnShardHeader, then [count] int8 predictions
+//------------------------------------------------------------------------
+const uint32_t BNN_SHARD_MAGIC = 0x424e4e53;      // "BNNS"
+
+struct BnnShardHeader {
+  uint32_t magic;
+  uint32_t start;       // index of the first image of the shard
+  uint32_t count;       // number of images
+  uint32_t n_errors;    // as counted by the worker
+  float startup_s;      // model load, pack and schedule
+  float run_s;          // wall time of the image loop
+  float p50_us;         // image latency percentiles
+  float p99_us;
+};
+
+inline size_t bnn_pixel_bytes(uint32_t format) {
+  return (format == BNN_PIX_U8_HWC) ? 1 : 4;
+}
+
+//------------------------------------------------------------------------
+// Convert a raw 8-bit HWC image to the [-1,1] CHW float layout used by
+// binarize_input_images (same scaling as the BinaryNet CIFAR-10 inputs)
+//------------------------------------------------------------------------
+inline void bnn_u8_hwc_to_f32_chw(const uint8_t* in, float* out) {
+  const unsigned C = 3, S = 32;
+  for (unsigned s = 0; s < S*S; ++s) {
+    for (unsigned c = 0; c < C; ++c)
+      out[c*S*S + s] = in[s*C + c] * (2.0f/255.0f) - 1.0f;
+  }
+}
+
+//------------------------------------------------------------------------
+// Blocking read/write of exactly [bytes] bytes, false on EOF or error
+//------------------------------------------------------------------------
+inline bool read_full(int fd, void* buf, size_t bytes) {
+  char* p = (char*)buf;
+  while (bytes > 0) {
+    ssize_t r = read(fd, p, bytes);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    bytes -= r;
+  }
+  return true;
+}
+
+inline bool write_full(int fd, const void* buf, size_t bytes) {
+  const char* p = (const char*)buf;
+  while (bytes > 0) {
+    ssize_t r = write(fd, p, bytes);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    bytes -= r;
+  }
+  return true;
+}
+
+#endif
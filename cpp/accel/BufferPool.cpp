@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __SDSCC__
+  #include "sds_lib.h"
+#else
+  #include <sys/mman.h>
+#endif
+
+#include "BufferPool.h"
+#include "LowJitter.h"
+#include "MemTrack.h"
+
+// buffers at least this large are aligned for transparent huge pages
+static const size_t HUGE_PAGE_BYTES = 2 << 20;
+static const size_t SMALL_PAGE_BYTES = 4096;
+
+BufferPool::BufferPool() : m_locked(false) {
+  m_stats = BufferPoolStats();
+}
+
+BufferPool::~BufferPool() {
+  if (!m_in_use.empty()) {
+    fprintf(stderr, "BufferPool: %lu buffers still in use at exit\n",
+        (unsigned long)m_in_use.size());
+  }
+  for (std::map<void*, unsigned>::iterator it = m_in_use.begin();
+       it != m_in_use.end(); ++it)
+    os_free(it->first);
+  trim();
+}
+
+// -----------------------------------------------------------------------
+// Size classes are powers of two from 2^MIN_CLASS_LOG to 2^MAX_CLASS_LOG
+// -----------------------------------------------------------------------
+unsigned BufferPool::size_class(size_t bytes) {
+  unsigned c = 0;
+  while (c < N_CLASSES && (size_t(1) << (c + MIN_CLASS_LOG)) < bytes)
+    ++c;
+  return c;
+}
+
+size_t BufferPool::class_size(size_t bytes) {
+  return size_t(1) << (size_class(bytes) + MIN_CLASS_LOG);
+}
+
+void* BufferPool::os_alloc(size_t bytes) {
+#ifdef __SDSCC__
+  return sds_alloc(bytes);
+#else
+  void* ptr = NULL;
+  const size_t align = (bytes >= HUGE_PAGE_BYTES) ? HUGE_PAGE_BYTES : SMALL_PAGE_BYTES;
+  if (posix_memalign(&ptr, align, bytes) != 0)
+    return NULL;
+  #ifdef MADV_HUGEPAGE
+  if (bytes >= HUGE_PAGE_BYTES)
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+  #endif
+  return ptr;
+#endif
+}
+
+void BufferPool::os_free(void* ptr) {
+#ifdef __SDSCC__
+  sds_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+// -----------------------------------------------------------------------
+// Hand out a cached buffer of the right class, or allocate a new one
+// -----------------------------------------------------------------------
+void* BufferPool::acquire(size_t bytes) {
+  const unsigned c = size_class(bytes);
+  if (c >= N_CLASSES) {
+    fprintf(stderr, "BufferPool: request of %lu bytes is too large\n",
+        (unsigned long)bytes);
+    return NULL;
+  }
+  const size_t csize = size_t(1) << (c + MIN_CLASS_LOG);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.acquires++;
+
+  void* ptr = NULL;
+  if (!m_free[c].empty()) {
+    ptr = m_free[c].back();
+    m_free[c].pop_back();
+    m_stats.hits++;
+  } else {
+    ptr = os_alloc(csize);
+    if (!ptr)
+      return NULL;
+    if (m_locked) {
+      lock_pages(ptr, csize);
+      prefault_pages(ptr, csize);
+    }
+    m_stats.allocs++;
+    m_stats.bytes_reserved += csize;
+    mem_tag(MEM_DMA, MEM_NO_LAYER, csize);
+  }
+
+  m_in_use[ptr] = c;
+  m_stats.bytes_in_use += csize;
+  if (m_stats.bytes_in_use > m_stats.peak_bytes_in_use)
+    m_stats.peak_bytes_in_use = m_stats.bytes_in_use;
+  return ptr;
+}
+
+void BufferPool::release(void* ptr) {
+  if (ptr == NULL)
+    return;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::map<void*, unsigned>::iterator it = m_in_use.find(ptr);
+  if (it == m_in_use.end()) {
+    // a foreign pointer or a second release, the pool state stays intact
+    fprintf(stderr, "**** ERROR: BufferPool::release of %p, not a buffer in use\n", ptr);
+    return;
+  }
+
+  const unsigned c = it->second;
+  m_in_use.erase(it);
+  m_free[c].push_back(ptr);
+  m_stats.releases++;
+  m_stats.bytes_in_use -= size_t(1) << (c + MIN_CLASS_LOG);
+}
+
+void BufferPool::trim() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (unsigned c = 0; c < N_CLASSES; ++c) {
+    for (unsigned i = 0; i < m_free[c].size(); ++i) {
+      os_free(m_free[c][i]);
+      m_stats.frees++;
+      m_stats.bytes_reserved -= size_t(1) << (c + MIN_CLASS_LOG);
+      mem_tag(MEM_DMA, MEM_NO_LAYER, -((long long)1 << (c + MIN_CLASS_LOG)));
+    }
+    m_free[c].clear();
+  }
+}
+
+bool BufferPool::lock_buffers() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_locked = true;
+  bool ok = true;
+  for (unsigned c = 0; c < N_CLASSES; ++c) {
+    const size_t csize = size_t(1) << (c + MIN_CLASS_LOG);
+    for (unsigned i = 0; i < m_free[c].size(); ++i) {
+      ok &= lock_pages(m_free[c][i], csize);
+      prefault_pages(m_free[c][i], csize);
+    }
+  }
+  for (std::map<void*, unsigned>::iterator it = m_in_use.begin();
+       it != m_in_use.end(); ++it) {
+    const size_t csize = size_t(1) << (it->second + MIN_CLASS_LOG);
+    ok &= lock_pages(it->first, csize);
+    prefault_pages(it->first, csize);
+  }
+  return ok;
+}
+
+BufferPoolStats BufferPool::stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void BufferPool::print_stats() const {
+  BufferPoolStats s = stats();
+  printf ("DMA pool: %lu acquires (%lu hits), %lu allocs, "
+          "%lu KB reserved, %lu KB in use, %lu KB peak\n",
+          s.acquires, s.hits, s.allocs,
+          (unsigned long)(s.bytes_reserved >> 10),
+          (unsigned long)(s.bytes_in_use >> 10),
+          (unsigned long)(s.peak_bytes_in_use >> 10));
+}
+
+//------------------------------------------------------------------------
+BufferPool& dma_pool() {
+  static BufferPool pool;
+  return pool;
+}
@@ -0,0 +1,74 @@
+#ifndef ACCEL_BUFFER_POOL_H
+#define ACCEL_BUFFER_POOL_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+//------------------------------------------------------------------------
+// Pool of physically contiguous buffers for the accelerator data movers.
+//
+// Buffers are grouped into power-of-two size classes. release() returns
+// a buffer to the free list of its class instead of freeing it, so
+// repeated acquire/release cycles (one per layer, per image, per context)
+// do not go back to the allocator. Memory comes from sds_alloc when built
+// with SDSoC and from page aligned (huge-page advised) memory on x86.
+//------------------------------------------------------------------------
+struct BufferPoolStats {
+  unsigned long acquires;     // calls to acquire()
+  unsigned long hits;         // acquires served from a free list
+  unsigned long releases;     // calls to release()
+  unsigned long allocs;       // buffers obtained from the allocator
+  unsigned long frees;        // buffers returned to the allocator
+  size_t bytes_reserved;      // bytes held by the pool (in use + cached)
+  size_t bytes_in_use;        // bytes currently handed out
+  size_t peak_bytes_in_use;   // high-water mark of bytes_in_use
+};
+
+class BufferPool {
+  // smallest and largest size class, as log2 of the size in bytes
+  static const unsigned MIN_CLASS_LOG = 12;
+  static const unsigned MAX_CLASS_LOG = 30;
+  static const unsigned N_CLASSES = MAX_CLASS_LOG - MIN_CLASS_LOG + 1;
+
+  std::vector<void*> m_free[N_CLASSES];
+  std::map<void*, unsigned> m_in_use;   // ptr -> size class
+  BufferPoolStats m_stats;
+  bool m_locked;
+  mutable std::mutex m_mutex;
+
+  public:
+    BufferPool();
+    // Returns every buffer to the allocator, buffers still in use
+    // are reported and freed as well
+    ~BufferPool();
+
+    // Returns a buffer of at least [bytes] bytes or NULL if the
+    // allocator is out of memory
+    void* acquire(size_t bytes);
+    // Returns a buffer obtained from acquire() to the pool, reports and
+    // ignores pointers that are not in use
+    void release(void* ptr);
+    // Returns all cached (not in use) buffers to the allocator
+    void trim();
+    // Locks and pre-faults every buffer the pool holds and every
+    // buffer it allocates from now on, false if a lock failed
+    bool lock_buffers();
+
+    BufferPoolStats stats() const;
+    void print_stats() const;
+
+    // Size in bytes of the class serving a request of [bytes]
+    static size_t class_size(size_t bytes);
+
+  private:
+    static unsigned size_class(size_t bytes);
+    static void* os_alloc(size_t bytes);
+    static void os_free(void* ptr);
+};
+
+// Process-wide pool shared by all schedules, contexts and test drivers
+BufferPool& dma_pool();
+
+#endif
@@ -0,0 +1,222 @@
+#include <assert.h>
+
+#include "CpuKernels.h"
+#include "BitTensor.h"
+
+// -----------------------------------------------------------------------
+// Setup: unpack the weights into per-tap, channel-packed words and the
+// thresholds into ints
+// -----------------------------------------------------------------------
+CpuLayers::CpuLayers(Word* const wt[N_LAYERS], Word* const kh[N_LAYERS]) {
+  for (unsigned l = 0; l < L_CONV; ++l) {
+    CpuConvLayer& L = conv[l];
+    L.M = M_tab[l];
+    L.N = N_tab[l];
+    L.S = S_tab[l];
+    L.pool = pool_tab[l];
+
+    L.nc.resize(L.N);
+    for (unsigned n = 0; n < L.N; ++n) {
+      NormComp nc;
+      load_kh(nc, kh[l], n);
+      // conv1 thresholds are C1Comp with 12 fractional bits, the
+      // conv1 sums have 18
+      L.nc[n] = (l == 0) ? nc.to_int() * 64 : nc.to_int();
+    }
+
+    if (l == 0) {
+      L.wt1.resize(L.N*L.M);
+      for (unsigned f = 0; f < L.N*L.M; ++f) {
+        L.wt1[f] = 0;
+        for (unsigned t = 0; t < WT_SIZE; ++t)
+          L.wt1[f] |= conv_wt_bit(wt[l], f, t) << t;
+      }
+    } else {
+      const unsigned MW = L.M / WORD_SIZE;
+      L.wt.assign(L.N*WT_SIZE*MW, 0);
+      for (unsigned n = 0; n < L.N; ++n) {
+        for (unsigned m = 0; m < L.M; ++m) {
+          for (unsigned t = 0; t < WT_SIZE; ++t) {
+            if (conv_wt_bit(wt[l], n*L.M+m, t))
+              L.wt[(n*WT_SIZE + t)*MW + m/WORD_SIZE] |= 1ULL << (m % WORD_SIZE);
+          }
+        }
+      }
+    }
+  }
+
+  for (unsigned d = 0; d < N_LAYERS - L_CONV; ++d) {
+    const unsigned l = L_CONV + d;
+    CpuDenseLayer& L = dense[d];
+    L.M = M_tab[l];
+    L.N = N_tab[l];
+    L.wt.resize(L.M*L.N/WORD_SIZE);
+    for (unsigned i = 0; i < L.wt.size(); ++i)
+      L.wt[i] = wt[l][i].to_uint64();
+
+    if (T_tab[l] == LAYER_DENSE) {
+      L.nc.resize(L.N);
+      for (unsigned n = 0; n < L.N; ++n) {
+        NormComp nc;
+        load_kh(nc, kh[l], n);
+        L.nc[n] = nc.to_int();
+      }
+    } else {
+      L.kh.assign(kh[l], kh[l] + (L.N+1)/2);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------
+// Conv1, fixed point inputs, no pooling
+// -----------------------------------------------------------------------
+void cpu_conv1_pixel(const CpuConvLayer& L, const uint64_t* img,
+                     int r, int c, uint64_t* bits) {
+  const int S = L.S;
+
+  // gather the window, tap t holds input pixel (r+1-t/3, c+1-t%3)
+  int pix[WT_SIZE][3];
+  for (unsigned t = 0; t < WT_SIZE; ++t) {
+    const int rr = r + 1 - (int)(t/K);
+    const int cc = c + 1 - (int)(t%K);
+    const bool valid = (rr >= 0 && rr < S && cc >= 0 && cc < S);
+    for (unsigned m = 0; m < L.M; ++m)
+      pix[t][m] = valid ? conv1_channel(img[rr*S + cc], m) : 0;
+  }
+
+  for (unsigned i = 0; i < L.N / WORD_SIZE; ++i)
+    bits[i] = 0;
+  for (unsigned n = 0; n < L.N; ++n) {
+    int res = 0;
+    for (unsigned m = 0; m < L.M; ++m) {
+      const unsigned w = L.wt1[n*L.M + m];
+      for (unsigned t = 0; t < WT_SIZE; ++t)
+        res += ((w >> t) & 1) ? -pix[t][m] : pix[t][m];
+    }
+    if (res < L.nc[n])
+      bits[n / WORD_SIZE] |= 1ULL << (n % WORD_SIZE);
+  }
+}
+
+// -----------------------------------------------------------------------
+// Binary conv of one output pixel (before pooling) for all outputs
+// -----------------------------------------------------------------------
+void cpu_conv_pixel(const CpuConvLayer& L, const uint64_t* in,
+                    int r, int c, uint64_t* bits) {
+  const int S = L.S;
+  const unsigned MW = L.M / WORD_SIZE;
+
+  // valid taps of the window and their input pixels
+  unsigned taps[WT_SIZE];
+  const uint64_t* px[WT_SIZE];
+  unsigned n_taps = 0;
+  for (unsigned t = 0; t < WT_SIZE; ++t) {
+    const int rr = r + 1 - (int)(t/K);
+    const int cc = c + 1 - (int)(t%K);
+    if (rr >= 0 && rr < S && cc >= 0 && cc < S) {
+      taps[n_taps] = t;
+      px[n_taps] = in + (rr*S + cc)*MW;
+      n_taps++;
+    }
+  }
+
+  for (unsigned i = 0; i < L.N / WORD_SIZE; ++i)
+    bits[i] = 0;
+  for (unsigned n = 0; n < L.N; ++n) {
+    const uint64_t* wn = &L.wt[n*WT_SIZE*MW];
+    int cnt = 0;
+    for (unsigned k = 0; k < n_taps; ++k) {
+      const uint64_t* w = wn + taps[k]*MW;
+      for (unsigned i = 0; i < MW; ++i)
+        cnt += __builtin_popcountll(px[k][i] ^ w[i]);
+    }
+    const int sum = wrap_conv_sum(n_taps*L.M - 2*cnt);
+    if (sum < L.nc[n])
+      bits[n / WORD_SIZE] |= 1ULL << (n % WORD_SIZE);
+  }
+}
+
+void cpu_conv_output(const CpuConvLayer& L, const uint64_t* in,
+                     int r, int c, uint64_t* bits, uint64_t* tmp) {
+  if (!L.pool) {
+    cpu_conv_pixel(L, in, r, c, bits);
+    return;
+  }
+  // a pooled bit is -1 only if all four inputs are -1
+  const unsigned NW = L.N / WORD_SIZE;
+  for (unsigned i = 0; i < NW; ++i)
+    bits[i] = ~0ULL;
+  for (unsigned p = 0; p < 4; ++p) {
+    cpu_conv_pixel(L, in, 2*r + p/2, 2*c + p%2, tmp);
+    for (unsigned i = 0; i < NW; ++i)
+      bits[i] &= tmp[i];
+  }
+}
+
+// -----------------------------------------------------------------------
+// Dense layers
+// -----------------------------------------------------------------------
+static inline int dense_sum(const CpuDenseLayer& L, const uint64_t* in,
+                            unsigned n) {
+  const unsigned MW = L.M / WORD_SIZE;
+  const uint64_t* w = &L.wt[n*MW];
+  int cnt = 0;
+  for (unsigned i = 0; i < MW; ++i)
+    cnt += __builtin_popcountll(in[i] ^ w[i]);
+  return L.M - 2*cnt;
+}
+
+void cpu_dense(const CpuDenseLayer& L, const uint64_t* in, uint64_t* out) {
+  for (unsigned i = 0; i < L.N / WORD_SIZE; ++i)
+    out[i] = 0;
+  for (unsigned n = 0; n < L.N; ++n) {
+    if (dense_sum(L, in, n) < L.nc[n])
+      out[n / WORD_SIZE] |= 1ULL << (n % WORD_SIZE);
+  }
+}
+
+int cpu_last(const CpuDenseLayer& L, const uint64_t* in) {
+  DenseNorm best_out = -1024;
+  int prediction = -1;
+
+  for (unsigned n = 0; n < L.N; ++n) {
+    const DenseSum sum = dense_sum(L, in, n);
+
+    const Word kh_word = L.kh[n/2];
+    KType ki;  HType hi;
+    if (n % 2 == 0) {
+      ki(15,0) = kh_word(15, 0);
+      hi(15,0) = kh_word(31,16);
+    } else {
+      ki(15,0) = kh_word(47,32);
+      hi(15,0) = kh_word(63,48);
+    }
+    ap_fixed<20,10> out = ap_fixed<20,10>(sum)*ki + hi;
+
+    if (n == 0 || out > best_out) {
+      prediction = n;
+      best_out = out;
+    }
+  }
+  return prediction;
+}
+
+// -----------------------------------------------------------------------
+// Layout conversion through BitTensor, a 64x64 transpose per tile when
+// the pixels fill whole words
+// -----------------------------------------------------------------------
+void channels_to_rows(const std::vector<uint64_t>& ch, unsigned N,
+                      unsigned S, std::vector<uint64_t>& rm) {
+  BitTensor src(N, S, S, BITS_CHANNELS);
+  BitTensor dst(N, S, S, BITS_ROW_MAJOR);
+  assert(ch.size() == src.n_words());
+  Word* s = src.words();
+  for (size_t i = 0; i < ch.size(); ++i)
+    s[i] = ch[i];
+  dst.convert_from(src);
+
+  const Word* d = dst.words();
+  rm.resize(dst.n_words());
+  for (size_t i = 0; i < rm.size(); ++i)
+    rm[i] = d[i].to_uint64();
+}
@@ -0,0 +1,96 @@
+#ifndef ACCEL_CPU_KERNELS_H
+#define ACCEL_CPU_KERNELS_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Accel.h"
+#include "AccelTest.h"
+
+//------------------------------------------------------------------------
+// Bit-exact CPU kernels of all 9 layers, shared by GoldenModel and
+// DeltaInference.
+//
+// The arithmetic follows the accelerator bit for bit: conv1 fixed point
+// sums, 12-bit wrapping binary conv sums, integer thresholds, the 2x2
+// max pool as an AND of the four -1 bits and the fixed point scores of
+// the last layer. Binary conv and dense layers xor and popcount 64
+// inputs at a time against channel-packed weights.
+//
+// Conv feature maps are channel-packed: pixel p of a layer with N
+// channels occupies N/64 words, bit n of the pixel's words is channel n
+// (BITS_CHANNELS of BitTensor). Dense layers take the row-major order
+// of dmem_o.
+//------------------------------------------------------------------------
+
+// conv sums are accumulated in a 12-bit ConvSum on the accelerator
+inline int wrap_conv_sum(int sum) {
+  return ((sum + 2048) & 4095) - 2048;
+}
+
+// bit t of the 9-bit conv filter f in a set_conv_weight_array array
+inline unsigned conv_wt_bit(const Word* w, unsigned f, unsigned t) {
+  const unsigned off = (f % CONV_W_PER_WORD)*WT_SIZE + t;
+  return (w[f / CONV_W_PER_WORD].to_uint64() >> off) & 1;
+}
+
+// channel m of a conv1 input word, the raw bits of a C1InputType
+inline int conv1_channel(uint64_t wrd, unsigned m) {
+  const unsigned W = C1InputType(0).length();
+  const int64_t v = (int64_t)(wrd << (WORD_SIZE - W*(m+1)));
+  return (int)(v >> (WORD_SIZE - W));
+}
+
+struct CpuConvLayer {
+  unsigned M, N, S, pool;
+  std::vector<uint64_t> wt;   // [n][tap][M/64], tap = kernel bit
+  std::vector<uint16_t> wt1;  // conv1 only, filters [n][m], 9 bits each
+  std::vector<int> nc;        // threshold of each output
+
+  // output width, after pooling
+  unsigned out_width() const { return pool ? S/2 : S; }
+};
+
+struct CpuDenseLayer {
+  unsigned M, N;
+  std::vector<uint64_t> wt;   // [n][M/64]
+  std::vector<int> nc;        // thresholds, unused by the last layer
+  std::vector<Word> kh;       // k,h pairs of the last layer
+};
+
+//------------------------------------------------------------------------
+// Weights and thresholds of all layers, unpacked into per-tap,
+// channel-packed words and ints. Immutable once built.
+//------------------------------------------------------------------------
+struct CpuLayers {
+  CpuConvLayer conv[L_CONV];
+  CpuDenseLayer dense[N_LAYERS - L_CONV];
+
+  // [wt] and [kh] are the packed weights and batch-norm params of all
+  // layers as set by set_weight_array / set_bnorm_array
+  CpuLayers(Word* const wt[N_LAYERS], Word* const kh[N_LAYERS]);
+};
+
+// Conv1 output pixel (r,c) for all outputs, [img] holds the S*S conv1
+// input words of the image
+void cpu_conv1_pixel(const CpuConvLayer& L, const uint64_t* img,
+                     int r, int c, uint64_t* bits);
+// Binary conv output pixel (r,c) before pooling for all outputs, [in]
+// is the channel-packed input map
+void cpu_conv_pixel(const CpuConvLayer& L, const uint64_t* in,
+                    int r, int c, uint64_t* bits);
+// Output pixel (r,c) of a binary conv layer, pooled if the layer pools.
+// [tmp] has room for N/64 words.
+void cpu_conv_output(const CpuConvLayer& L, const uint64_t* in,
+                     int r, int c, uint64_t* bits, uint64_t* tmp);
+// N output bits of a dense layer from its M input bits
+void cpu_dense(const CpuDenseLayer& L, const uint64_t* in, uint64_t* out);
+// Scores of the last layer, returns the predicted class
+int cpu_last(const CpuDenseLayer& L, const uint64_t* in);
+
+// Channel-packed conv maps of N planes of S x S pixels to the row-major
+// order of dmem_o, where bit n*S*S + p is plane n at pixel p
+void channels_to_rows(const std::vector<uint64_t>& ch, unsigned N,
+                      unsigned S, std::vector<uint64_t>& rm);
+
+#endif
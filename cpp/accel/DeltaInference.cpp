@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+
+#include "DeltaInference.h"
+#include "Timer.h"
+#include "Trace.h"
+
+static Timer t_delta_conv("delta-conv");
+static Timer t_delta_dense("delta-dense");
+
+// -----------------------------------------------------------------------
+// Setup: the unpacked layers and empty maps
+// -----------------------------------------------------------------------
+DeltaInference::DeltaInference(Word* const wt[N_LAYERS], Word* const kh[N_LAYERS])
+  : m_layers(wt, kh),
+    m_valid(false),
+    m_prediction(-1),
+    m_frames(0),
+    m_unchanged(0)
+{
+  for (unsigned l = 0; l < LCONV; ++l) {
+    const CpuConvLayer& L = m_layers.conv[l];
+    m_conv_out[l].assign(L.out_width()*L.out_width()*L.N/WORD_SIZE, 0);
+    m_recomputed[l] = 0;
+  }
+  for (unsigned d = 0; d < NDENSE; ++d)
+    m_dense_runs[d] = 0;
+
+  m_img.assign(S_tab[0]*S_tab[0], 0);
+}
+
+// -----------------------------------------------------------------------
+// Run one frame
+// -----------------------------------------------------------------------
+int DeltaInference::predict(const Word* img_i) {
+  const bool full = !m_valid;
+  m_frames++;
+
+  Region r = diff_input(img_i);
+  if (r.empty()) {
+    m_unchanged++;
+    return m_prediction;
+  }
+
+  t_delta_conv.start();
+  {
+    TraceScope t(name_tab[0], "cpu");
+    r = run_conv1(full ? Region{0, 0, (int)S_tab[0]-1, (int)S_tab[0]-1} : r);
+    t.arg("changed_rows", r.empty() ? 0 : r.r1 - r.r0 + 1)
+     .arg("changed_cols", r.empty() ? 0 : r.c1 - r.c0 + 1);
+  }
+  for (unsigned l = 1; l < LCONV && (full || !r.empty()); ++l) {
+    const int S = m_layers.conv[l].S;
+    TraceScope t(name_tab[l], "cpu");
+    r = run_conv(l, full ? Region{0, 0, S-1, S-1} : r);
+    t.arg("changed_rows", r.empty() ? 0 : r.r1 - r.r0 + 1)
+     .arg("changed_cols", r.empty() ? 0 : r.c1 - r.c0 + 1);
+  }
+  t_delta_conv.stop();
+
+  if (r.empty() && !full)
+    return m_prediction;
+
+  // conv6 output to the linear layout of the dense layers, bit n*So*So+p
+  const CpuConvLayer& C = m_layers.conv[LCONV-1];
+  std::vector<uint64_t> bits;
+  channels_to_rows(m_conv_out[LCONV-1], C.N, C.out_width(), bits);
+
+  // each dense layer runs only if its input changed
+  t_delta_dense.start();
+  for (unsigned d = 0; d < NDENSE; ++d) {
+    if (!full && bits == m_dense_in[d]) {
+      t_delta_dense.stop();
+      return m_prediction;
+    }
+    m_dense_in[d].swap(bits);
+    m_dense_runs[d]++;
+    if (d < NDENSE-1) {
+      TraceScope t(name_tab[LCONV+d], "cpu");
+      bits.resize(m_layers.dense[d].N / WORD_SIZE);
+      cpu_dense(m_layers.dense[d], m_dense_in[d].data(), bits.data());
+    }
+  }
+  {
+    TraceScope t(name_tab[N_LAYERS-1], "cpu");
+    m_prediction = cpu_last(m_layers.dense[NDENSE-1], m_dense_in[NDENSE-1].data());
+  }
+  t_delta_dense.stop();
+
+  m_valid = true;
+  return m_prediction;
+}
+
+// -----------------------------------------------------------------------
+// Copies the new frame and returns the box of pixels that differ
+// -----------------------------------------------------------------------
+DeltaInference::Region DeltaInference::diff_input(const Word* img_i) {
+  const int S = S_tab[0];
+  Region r = { INT_MAX, INT_MAX, -1, -1 };
+  for (int row = 0; row < S; ++row) {
+    for (int col = 0; col < S; ++col) {
+      const uint64_t w = img_i[row*S + col].to_uint64();
+      if (w != m_img[row*S + col] || !m_valid) {
+        m_img[row*S + col] = w;
+        r.r0 = std::min(r.r0, row);  r.r1 = std::max(r.r1, row);
+        r.c0 = std::min(r.c0, col);  r.c1 = std::max(r.c1, col);
+      }
+    }
+  }
+  return r;
+}
+
+// -----------------------------------------------------------------------
+// Writes the bits of output pixel (r,c) and grows [changed] if they
+// differ from the stored ones
+// -----------------------------------------------------------------------
+static void store_pixel(std::vector<uint64_t>& out, unsigned So, unsigned NW,
+                        int r, int c, const uint64_t* bits, int* changed) {
+  uint64_t* o = &out[(r*So + c)*NW];
+  bool diff = false;
+  for (unsigned i = 0; i < NW; ++i) {
+    diff |= (o[i] != bits[i]);
+    o[i] = bits[i];
+  }
+  if (diff) {
+    changed[0] = std::min(changed[0], r);  changed[2] = std::max(changed[2], r);
+    changed[1] = std::min(changed[1], c);  changed[3] = std::max(changed[3], c);
+  }
+}
+
+// -----------------------------------------------------------------------
+// Conv1, fixed point inputs, no pooling
+// -----------------------------------------------------------------------
+DeltaInference::Region DeltaInference::run_conv1(const Region& in) {
+  const CpuConvLayer& L = m_layers.conv[0];
+  const int S = L.S;
+  const unsigned NW = L.N / WORD_SIZE;
+  const int r0 = std::max(in.r0-1, 0), r1 = std::min(in.r1+1, S-1);
+  const int c0 = std::max(in.c0-1, 0), c1 = std::min(in.c1+1, S-1);
+
+  int changed[4] = { INT_MAX, INT_MAX, -1, -1 };
+  std::vector<uint64_t> bits(NW);
+
+  for (int r = r0; r <= r1; ++r) {
+    for (int c = c0; c <= c1; ++c) {
+      cpu_conv1_pixel(L, m_img.data(), r, c, bits.data());
+      store_pixel(m_conv_out[0], S, NW, r, c, bits.data(), changed);
+    }
+  }
+
+  m_recomputed[0] += (r1-r0+1) * (c1-c0+1);
+  Region res = { changed[0], changed[1], changed[2], changed[3] };
+  return res;
+}
+
+// -----------------------------------------------------------------------
+// Binary conv layers 2-6
+// -----------------------------------------------------------------------
+DeltaInference::Region DeltaInference::run_conv(unsigned l, const Region& in) {
+  const CpuConvLayer& L = m_layers.conv[l];
+  const uint64_t* in_fmaps = m_conv_out[l-1].data();
+  const int S = L.S;
+  const unsigned So = L.out_width();
+  const unsigned NW = L.N / WORD_SIZE;
+
+  // conv outputs that see the dirty inputs, then the pooled outputs
+  int r0 = std::max(in.r0-1, 0), r1 = std::min(in.r1+1, S-1);
+  int c0 = std::max(in.c0-1, 0), c1 = std::min(in.c1+1, S-1);
+  if (L.pool) {
+    r0 /= 2;  r1 /= 2;
+    c0 /= 2;  c1 /= 2;
+  }
+
+  int changed[4] = { INT_MAX, INT_MAX, -1, -1 };
+  std::vector<uint64_t> bits(NW), tmp(NW);
+
+  for (int r = r0; r <= r1; ++r) {
+    for (int c = c0; c <= c1; ++c) {
+      cpu_conv_output(L, in_fmaps, r, c, bits.data(), tmp.data());
+      store_pixel(m_conv_out[l], So, NW, r, c, bits.data(), changed);
+    }
+  }
+
+  m_recomputed[l] += (r1-r0+1) * (c1-c0+1);
+  Region res = { changed[0], changed[1], changed[2], changed[3] };
+  return res;
+}
+
+void DeltaInference::print_stats() const {
+  printf ("Delta inference: %lu frames, %lu unchanged\n", m_frames, m_unchanged);
+  for (unsigned l = 0; l < LCONV; ++l) {
+    const unsigned So = m_layers.conv[l].out_width();
+    printf ("  Conv%u: %5.1f%% of outputs recomputed\n", l+1,
+        m_frames ? 100.0f*m_recomputed[l] / (m_frames*So*So) : 0.0f);
+  }
+  for (unsigned d = 0; d < NDENSE; ++d)
+    printf ("  FC%u: ran on %lu frames\n", d+1, m_dense_runs[d]);
+}
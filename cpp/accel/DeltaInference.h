@@ -0,0 +1,75 @@
+#ifndef ACCEL_DELTA_INFERENCE_H
+#define ACCEL_DELTA_INFERENCE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Accel.h"
+#include "AccelTest.h"
+#include "CpuKernels.h"
+
+//------------------------------------------------------------------------
+// Incremental inference on the CPU for streams of similar frames.
+//
+// The feature maps of the previous frame are kept for every layer. A new
+// frame is diffed against the previous one word by word (one word per
+// conv1 input pixel), and the bounding box of changed pixels is pushed
+// through the conv layers: a 3x3 conv grows it by one pixel on each side
+// and a 2x2 pool halves it. Only the output pixels inside the box are
+// recomputed, and the next layer's box is the box of output pixels whose
+// bits actually changed, so a change that binarizes away stops there.
+// A dense layer runs only when its input bits changed.
+//
+// The layers are the bit-exact kernels of CpuKernels.h, which keep
+// conv feature maps channel-packed: pixel p of a layer with N channels
+// occupies N/64 words, bit n of the pixel's words is channel n.
+//------------------------------------------------------------------------
+class DeltaInference {
+  static const unsigned LCONV = L_CONV;
+  static const unsigned NDENSE = N_LAYERS - L_CONV;
+
+  // inclusive bounding box of dirty pixels, empty when r0 > r1
+  struct Region {
+    int r0, c0, r1, c1;
+    bool empty() const { return r0 > r1; }
+  };
+
+  CpuLayers m_layers;
+  std::vector<uint64_t> m_conv_out[LCONV];  // channel-packed conv outputs
+  std::vector<uint64_t> m_dense_in[NDENSE]; // dense input bits of the previous run
+
+  std::vector<uint64_t> m_img;        // conv1 input words of the last frame
+  bool m_valid;
+  int m_prediction;
+
+  // statistics
+  unsigned long m_frames;
+  unsigned long m_unchanged;            // identical input, nothing ran
+  unsigned long m_recomputed[LCONV];    // conv output pixels recomputed
+  unsigned long m_dense_runs[NDENSE];
+
+  public:
+    // [wt] and [kh] are the packed weights and batch-norm params of all
+    // layers as set by set_weight_array / set_bnorm_array
+    DeltaInference(Word* const wt[N_LAYERS], Word* const kh[N_LAYERS]);
+
+    // Classifies one frame, [img_i] holds its conv1 input words
+    int predict(const Word* img_i);
+    // Forgets the previous frame, the next one is computed in full
+    void reset() { m_valid = false; }
+
+    void print_stats() const;
+
+    // Maps of the last frame: the channel-packed output of conv layer l
+    // and the input bits of dense layer d (0-based), as a full run of
+    // GoldenModel gives them in Maps::conv[l] and Maps::out[L_CONV-1+d]
+    const std::vector<uint64_t>& conv_out(unsigned l) const { return m_conv_out[l]; }
+    const std::vector<uint64_t>& dense_in(unsigned d) const { return m_dense_in[d]; }
+
+  private:
+    Region diff_input(const Word* img_i);
+    Region run_conv1(const Region& in);
+    Region run_conv(unsigned l, const Region& in);
+};
+
+#endif
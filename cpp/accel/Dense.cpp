@@ -1,5 +1,8 @@
+#include <vector>
+
 #include "Dense.h"
 #include "Timer.h"
+#include "Trace.h"
 
 const static Word m1("0x5555555555555555", 16);
 const static Word m2("0x3333333333333333", 16);
@@ -53,6 +56,8 @@ void dense_layer_cpu(
     const unsigned M,
     const unsigned N
 ) {
+  TraceScope t("dense_cpu", "cpu");
+  t.arg("M", M).arg("N", N);
   t_dense.start();
 
   for (unsigned n = 0; n < N; n+=WORD_SIZE) {
@@ -80,6 +85,8 @@ int last_layer_cpu(
     const unsigned M,
     const unsigned N
 ) {
+  TraceScope t("last_cpu", "cpu");
+  t.arg("M", M).arg("N", N);
   t_last.start();
 
   int pred = -1;
@@ -97,3 +104,71 @@ int last_layer_cpu(
   t_last.stop();
   return pred;
 }
+
+// -----------------------------------------------------------------------
+// Internal dense layer on a batch of images
+// -----------------------------------------------------------------------
+void dense_layer_cpu_batch(
+    const Word*  wt,
+    const float* k_data,
+    const float* h_data,
+    const Word* const* in,
+    Word* const* out,
+    const unsigned B,
+    const unsigned M,
+    const unsigned N
+) {
+  TraceScope t("dense_cpu", "cpu");
+  t.arg("M", M).arg("N", N).arg("images", B);
+  t_dense.start();
+
+  for (unsigned n = 0; n < N; n+=WORD_SIZE) {
+    for (unsigned b = 0; b < B; ++b)
+      out[b][n/WORD_SIZE] = 0;
+    for (unsigned nb = 0; nb < WORD_SIZE; ++nb) {
+      for (unsigned b = 0; b < B; ++b) {
+        int sum = dotproduct_m(in[b], wt, M, n+nb);
+        float res = static_cast<float>(sum) * k_data[n+nb] + h_data[n+nb];
+        if (res < 0)
+          out[b][n/WORD_SIZE][nb] = 1;
+      }
+    }
+  }
+
+  t_dense.stop();
+}
+
+// -----------------------------------------------------------------------
+// Final dense layer on a batch of images
+// -----------------------------------------------------------------------
+void last_layer_cpu_batch(
+    const Word*  wt,
+    const float* k_data,
+    const float* h_data,
+    const Word* const* in,
+    int* pred,
+    const unsigned B,
+    const unsigned M,
+    const unsigned N
+) {
+  TraceScope t("last_cpu", "cpu");
+  t.arg("M", M).arg("N", N).arg("images", B);
+  t_last.start();
+
+  std::vector<float> maxval(B, 0);
+  for (unsigned b = 0; b < B; ++b)
+    pred[b] = -1;
+
+  for (unsigned n = 0; n < N; ++n) {
+    for (unsigned b = 0; b < B; ++b) {
+      int sum = dotproduct_m(in[b], wt, M, n);
+      float val = static_cast<float>(sum) * k_data[n] + h_data[n];
+      if (pred[b] == -1 || val > maxval[b]) {
+        pred[b] = n;
+        maxval[b] = val;
+      }
+    }
+  }
+
+  t_last.stop();
+}
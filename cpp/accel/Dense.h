@@ -24,4 +24,29 @@ int last_layer_cpu(
     const unsigned N
 );
 
+// The same layers on a batch of [B] images, in[b] / out[b] are the
+// input and output words of image b. Each weight row is read once and
+// applied to all images while it is in cache.
+void dense_layer_cpu_batch(
+    const Word* w,
+    const float* k_data,
+    const float* h_data,
+    const Word* const* in,
+    Word* const* out,
+    const unsigned B,
+    const unsigned M,
+    const unsigned N
+);
+
+void last_layer_cpu_batch(
+    const Word* w,
+    const float* k_data,
+    const float* h_data,
+    const Word* const* in,
+    int* pred,
+    const unsigned B,
+    const unsigned M,
+    const unsigned N
+);
+
 #endif
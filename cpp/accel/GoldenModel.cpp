@@ -0,0 +1,88 @@
+#include "GoldenModel.h"
+#include "ParallelFor.h"
+#include "Trace.h"
+
+GoldenModel::GoldenModel(Word* const wt[N_LAYERS], Word* const kh[N_LAYERS])
+  : m_layers(wt, kh)
+{}
+
+unsigned GoldenModel::output_words(unsigned l) {
+  if (layer_is_last(l+1))
+    return 0;
+  if (!layer_is_conv(l+1))
+    return N_tab[l] / WORD_SIZE;
+  const unsigned So = pool_tab[l] ? S_tab[l]/2 : S_tab[l];
+  return N_tab[l]*So*So / WORD_SIZE;
+}
+
+// -----------------------------------------------------------------------
+// Run one image / a batch
+// -----------------------------------------------------------------------
+int GoldenModel::run(const Word* img_i, Maps& maps) const {
+  TraceScope t("golden", "cpu");
+  {
+    TraceScope tl(name_tab[0], "cpu");
+    run_conv1(img_i, maps.conv[0]);
+  }
+  for (unsigned l = 1; l < LCONV; ++l) {
+    TraceScope tl(name_tab[l], "cpu");
+    run_conv(l, maps.conv[l-1], maps.conv[l]);
+  }
+
+  for (unsigned l = 0; l < LCONV; ++l) {
+    const CpuConvLayer& L = m_layers.conv[l];
+    channels_to_rows(maps.conv[l], L.N, L.out_width(), maps.out[l]);
+  }
+
+  // the conv6 output in dmem_o order is the input of the dense layers
+  for (unsigned l = LCONV; l < N_LAYERS-1; ++l) {
+    TraceScope tl(name_tab[l], "cpu");
+    maps.out[l].resize(N_tab[l] / WORD_SIZE);
+    cpu_dense(m_layers.dense[l - LCONV], maps.out[l-1].data(), maps.out[l].data());
+  }
+  maps.out[N_LAYERS-1].clear();
+
+  TraceScope tl(name_tab[N_LAYERS-1], "cpu");
+  maps.prediction = cpu_last(m_layers.dense[N_LAYERS-LCONV-1],
+                             maps.out[N_LAYERS-2].data());
+  return maps.prediction;
+}
+
+void GoldenModel::run_batch(const Word* imgs, unsigned n, Maps maps[],
+                            unsigned n_threads) const {
+  const unsigned img_words = S_tab[0]*S_tab[0];
+  parallel_for(n, n_threads, [&](unsigned i) {
+    run(imgs + i*img_words, maps[i]);
+  });
+}
+
+// -----------------------------------------------------------------------
+// Conv layers, every output pixel
+// -----------------------------------------------------------------------
+void GoldenModel::run_conv1(const Word* img_i, std::vector<uint64_t>& out) const {
+  const CpuConvLayer& L = m_layers.conv[0];
+  const int S = L.S;
+  const unsigned NW = L.N / WORD_SIZE;
+  out.resize(S*S*NW);
+
+  std::vector<uint64_t> img(S*S);
+  for (int p = 0; p < S*S; ++p)
+    img[p] = img_i[p].to_uint64();
+
+  for (int r = 0; r < S; ++r)
+    for (int c = 0; c < S; ++c)
+      cpu_conv1_pixel(L, img.data(), r, c, &out[(r*S + c)*NW]);
+}
+
+void GoldenModel::run_conv(unsigned l, const std::vector<uint64_t>& in,
+                           std::vector<uint64_t>& out) const {
+  const CpuConvLayer& L = m_layers.conv[l];
+  const int So = L.out_width();
+  const unsigned NW = L.N / WORD_SIZE;
+  out.resize(So*So*NW);
+
+  std::vector<uint64_t> tmp(NW);
+  for (int r = 0; r < So; ++r)
+    for (int c = 0; c < So; ++c)
+      cpu_conv_output(L, in.data(), r, c, &out[(r*So + c)*NW], tmp.data());
+}
@@ -0,0 +1,57 @@
+#ifndef ACCEL_GOLDEN_MODEL_H
+#define ACCEL_GOLDEN_MODEL_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Accel.h"
+#include "AccelTest.h"
+#include "CpuKernels.h"
+
+//------------------------------------------------------------------------
+// Bit-exact CPU reference of all 9 layers, used to verify the accelerator
+// model over the whole test set. Every layer is a full run of the
+// kernels in CpuKernels.h.
+//
+// The model is immutable once built, run() keeps all per-image state in
+// the caller's Maps, so any number of threads can share one model.
+//------------------------------------------------------------------------
+class GoldenModel {
+  static const unsigned LCONV = L_CONV;
+
+  CpuLayers m_layers;
+
+  public:
+    // Outputs of every layer for one image
+    struct Maps {
+      // out[l] is the output of layer l+1 in the accelerator's dmem_o
+      // order, bit n*So*So + r*So + c is output n at pixel (r,c). The
+      // last layer has no maps, only the prediction.
+      std::vector<uint64_t> out[N_LAYERS];
+      int prediction;
+      // conv outputs channel-packed: pixel p owns N/64 words
+      std::vector<uint64_t> conv[LCONV];
+    };
+
+    // [wt] and [kh] are the packed weights and batch-norm params of all
+    // layers as set by set_weight_array / set_bnorm_array
+    GoldenModel(Word* const wt[N_LAYERS], Word* const kh[N_LAYERS]);
+
+    // Runs one image, [img_i] holds its conv1 input words. Returns the
+    // predicted class, also stored in maps.prediction.
+    int run(const Word* img_i, Maps& maps) const;
+    // Runs images [0, n) of [imgs], S*S words each, on [n_threads]
+    // threads (0 = default_threads())
+    void run_batch(const Word* imgs, unsigned n, Maps maps[],
+                   unsigned n_threads = 0) const;
+
+    // Number of 64-bit words in Maps::out[l], 0-based layer
+    static unsigned output_words(unsigned l);
+
+  private:
+    void run_conv1(const Word* img_i, std::vector<uint64_t>& out) const;
+    void run_conv(unsigned l, const std::vector<uint64_t>& in,
+                  std::vector<uint64_t>& out) const;
+};
+
+#endif
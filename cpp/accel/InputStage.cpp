@@ -0,0 +1,120 @@
+#include "InputStage.h"
+#include "AccelTest.h"
+#include "BufferPool.h"
+#include "LowJitter.h"
+#include "Metrics.h"
+#include "Timer.h"
+#include "Trace.h"
+
+static const unsigned IMG_SIZE = 3*32*32;
+
+static Timer t_stage("stage");
+
+InputStager::InputStager(const float* images, unsigned n_imgs, unsigned depth)
+  : m_images(images),
+    m_n_imgs(n_imgs),
+    m_depth(depth),
+    m_slots(depth + 1),
+    m_staged(0),
+    m_released(0),
+    m_stop(false)
+{
+  for (unsigned i = 0; i < m_slots; ++i) {
+    Word* buf = (Word*) dma_pool().acquire( DMEM_WORDS * sizeof(Word) );
+    if (!buf) {
+      fprintf(stderr, "**** ERROR: Alloc staging buffer failed in %s\n", __FILE__);
+      exit(-2);
+    }
+    m_ring.push_back(buf);
+  }
+
+  if (m_depth > 0)
+    m_thread = std::thread(&InputStager::stage_loop, this);
+}
+
+InputStager::~InputStager() {
+  if (m_thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+  }
+  for (unsigned i = 0; i < m_slots; ++i)
+    dma_pool().release(m_ring[i]);
+}
+
+// images binarized but not yet handed back by the consumer
+static MetricGauge* ready_gauge() {
+  static MetricGauge* g = metric_gauge("bnn_input_stage_depth",
+      "Images staged ahead of the accelerator");
+  return g;
+}
+
+// -----------------------------------------------------------------------
+// Helper thread: stay up to m_depth images ahead of the consumer. The
+// image in use keeps its slot until release(), hence depth+1 slots.
+// -----------------------------------------------------------------------
+void InputStager::stage_loop() {
+  trace_thread_name("input-stage");
+  for (unsigned n = 0; n < m_n_imgs; ++n) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [&]{ return m_stop || n < m_released + m_depth + 1; });
+      if (m_stop)
+        return;
+    }
+
+    TraceScope t("binarize", "host");
+    t.arg("image", n);
+    t_stage.start();
+    binarize_input_images(m_ring[n % m_slots], m_images + n*IMG_SIZE, 32);
+    t_stage.stop();
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_staged = n+1;
+      ready_gauge()->set(m_staged - m_released);
+    }
+    m_cv.notify_all();
+  }
+}
+
+Word* InputStager::acquire(unsigned n) {
+  assert(n < m_n_imgs);
+  assert(n == m_released);
+
+  if (m_depth == 0) {
+    TraceScope t("binarize", "host");
+    t.arg("image", n);
+    t_stage.start();
+    binarize_input_images(m_ring[0], m_images + n*IMG_SIZE, 32);
+    t_stage.stop();
+    return m_ring[0];
+  }
+
+  // a wait here is a bubble: the stager fell behind
+  TraceScope t("wait_input", "host");
+  t.arg("image", n);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_cv.wait(lock, [&]{ return n < m_staged; });
+  return m_ring[n % m_slots];
+}
+
+void InputStager::release(unsigned n) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    assert(n == m_released);
+    m_released = n+1;
+    if (m_depth > 0)
+      ready_gauge()->set(m_staged - m_released);
+  }
+  m_cv.notify_all();
+}
+
+bool InputStager::pin(int cpu) {
+  if (!m_thread.joinable())
+    return true;
+  return pin_thread(m_thread.native_handle(), cpu);
+}
@@ -0,0 +1,53 @@
+#ifndef ACCEL_INPUT_STAGE_H
+#define ACCEL_INPUT_STAGE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Accel.h"
+
+//------------------------------------------------------------------------
+// Binarizes and packs input images into a ring of DMA buffers on a
+// helper thread, so that the conversion of the next [depth] images
+// overlaps with inference of the current one. The ring has depth+1
+// buffers, the current image's buffer is held until release().
+// - Images must be acquired and released in order 0,1,2,...
+// - With depth 0 no thread is started and acquire() converts the
+//   image in the caller's thread (the old serial behavior)
+//------------------------------------------------------------------------
+class InputStager {
+  const float* m_images;
+  const unsigned m_n_imgs;
+  const unsigned m_depth;
+  const unsigned m_slots;
+
+  std::vector<Word*> m_ring;
+  unsigned m_staged;      // images [0, m_staged) have been converted
+  unsigned m_released;    // images [0, m_released) were handed back
+  bool m_stop;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_thread;
+
+  public:
+    // [images] holds n_imgs 3x32x32 float images back to back
+    InputStager(const float* images, unsigned n_imgs, unsigned depth);
+    ~InputStager();
+
+    // Blocks until image n is staged and returns its conv1 input words
+    Word* acquire(unsigned n);
+    // Returns the buffer of image n to the ring, call once the
+    // accelerator has consumed the input
+    void release(unsigned n);
+
+    // Pins the helper thread to core [cpu], no-op with depth 0
+    bool pin(int cpu);
+
+  private:
+    void stage_loop();
+};
+
+#endif
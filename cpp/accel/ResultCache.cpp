@@ -0,0 +1,180 @@
+#include <cstdio>
+
+#include "ResultCache.h"
+
+// -----------------------------------------------------------------------
+// XXH64
+// -----------------------------------------------------------------------
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl64(uint64_t x, unsigned r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t lane) {
+  acc += lane * PRIME64_2;
+  acc = rotl64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t v) {
+  acc ^= xxh_round(0, v);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t hash_words(const Word* words, unsigned n_words, uint64_t seed) {
+  unsigned i = 0;
+  uint64_t h;
+
+  if (n_words >= 4) {
+    uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+    uint64_t v2 = seed + PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME64_1;
+    for (; i + 4 <= n_words; i += 4) {
+      v1 = xxh_round(v1, words[i+0].to_uint64());
+      v2 = xxh_round(v2, words[i+1].to_uint64());
+      v3 = xxh_round(v3, words[i+2].to_uint64());
+      v4 = xxh_round(v4, words[i+3].to_uint64());
+    }
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = xxh_merge(h, v1);
+    h = xxh_merge(h, v2);
+    h = xxh_merge(h, v3);
+    h = xxh_merge(h, v4);
+  } else {
+    h = seed + PRIME64_5;
+  }
+
+  h += (uint64_t)n_words * sizeof(uint64_t);
+
+  for (; i < n_words; ++i) {
+    h ^= xxh_round(0, words[i].to_uint64());
+    h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+// -----------------------------------------------------------------------
+// ResultCache
+// -----------------------------------------------------------------------
+ResultCache::ResultCache(unsigned capacity)
+  : m_capacity(capacity),
+    m_bypass(false),
+    m_hits(0),
+    m_misses(0),
+    m_evictions(0)
+{}
+
+ResultCache::EntryList::iterator ResultCache::find(
+    uint64_t hash, const Word* key, unsigned key_words
+) {
+  auto range = m_index.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    const Entry& e = *it->second;
+    if (e.key.size() != key_words)
+      continue;
+    unsigned i = 0;
+    while (i < key_words && e.key[i] == key[i])
+      ++i;
+    if (i == key_words)
+      return it->second;
+  }
+  return m_lru.end();
+}
+
+bool ResultCache::lookup(const Word* key, unsigned key_words, Word* value) {
+  if (!enabled())
+    return false;
+  return lookup(hash_words(key, key_words), key, key_words, value);
+}
+
+bool ResultCache::lookup(uint64_t hash, const Word* key, unsigned key_words,
+                         Word* value) {
+  if (!enabled())
+    return false;
+
+  EntryList::iterator e = find(hash, key, key_words);
+  if (e == m_lru.end()) {
+    m_misses++;
+    return false;
+  }
+
+  m_hits++;
+  m_lru.splice(m_lru.begin(), m_lru, e);
+  for (unsigned i = 0; i < e->value.size(); ++i)
+    value[i] = e->value[i];
+  return true;
+}
+
+void ResultCache::insert(const Word* key, unsigned key_words,
+                         const Word* value, unsigned value_words) {
+  if (!enabled())
+    return;
+  insert(hash_words(key, key_words), key, key_words, value, value_words);
+}
+
+void ResultCache::insert(uint64_t hash, const Word* key, unsigned key_words,
+                         const Word* value, unsigned value_words) {
+  if (!enabled())
+    return;
+
+  EntryList::iterator e = find(hash, key, key_words);
+  if (e != m_lru.end()) {
+    m_lru.splice(m_lru.begin(), m_lru, e);
+    e->value.assign(value, value + value_words);
+    return;
+  }
+
+  evict_to(m_capacity - 1);
+  m_lru.push_front(Entry());
+  Entry& n = m_lru.front();
+  n.hash = hash;
+  n.key.assign(key, key + key_words);
+  n.value.assign(value, value + value_words);
+  m_index.insert(std::make_pair(hash, m_lru.begin()));
+}
+
+void ResultCache::evict_to(unsigned n) {
+  while (m_lru.size() > n) {
+    EntryList::iterator last = --m_lru.end();
+    auto range = m_index.equal_range(last->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == last) {
+        m_index.erase(it);
+        break;
+      }
+    }
+    m_lru.erase(last);
+    m_evictions++;
+  }
+}
+
+void ResultCache::set_capacity(unsigned capacity) {
+  m_capacity = capacity;
+  evict_to(capacity);
+}
+
+void ResultCache::clear() {
+  m_lru.clear();
+  m_index.clear();
+}
+
+void ResultCache::print_stats(const char* name) const {
+  const unsigned long lookups = m_hits + m_misses;
+  printf ("%s: %u/%u entries%s, %lu hits, %lu misses (%4.2f%% hit rate), "
+          "%lu evictions\n",
+      name, size(), m_capacity, m_bypass ? " (bypassed)" : "",
+      m_hits, m_misses, lookups ? float(m_hits)*100/lookups : 0.0f,
+      m_evictions);
+}
@@ -0,0 +1,78 @@
+#ifndef ACCEL_RESULT_CACHE_H
+#define ACCEL_RESULT_CACHE_H
+
+#include <list>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "Accel.h"
+
+//------------------------------------------------------------------------
+// 64-bit xxHash (XXH64) of an array of Words, each Word is consumed as
+// one 8-byte lane
+//------------------------------------------------------------------------
+uint64_t hash_words(const Word* words, unsigned n_words, uint64_t seed=0);
+
+//------------------------------------------------------------------------
+// LRU cache mapping a block of Words (the key) to another block of
+// Words (the value). Entries are found by the hash of the key and the
+// stored key is compared in full, so a hash collision is a miss and
+// never returns a wrong value.
+// - Capacity is in entries, capacity 0 disables the cache
+// - In bypass mode lookups always miss and nothing is inserted, the
+//   counters are left untouched
+//------------------------------------------------------------------------
+class ResultCache {
+  struct Entry {
+    uint64_t hash;
+    std::vector<Word> key;
+    std::vector<Word> value;
+  };
+  typedef std::list<Entry> EntryList;
+
+  unsigned m_capacity;
+  bool m_bypass;
+  EntryList m_lru;    // most recently used first
+  std::unordered_multimap<uint64_t, EntryList::iterator> m_index;
+
+  unsigned long m_hits;
+  unsigned long m_misses;
+  unsigned long m_evictions;
+
+  public:
+    ResultCache(unsigned capacity=0);
+
+    // Looks up [key], on a hit copies the value to [value] and
+    // returns true
+    bool lookup(const Word* key, unsigned key_words, Word* value);
+    // Same with the key hash already computed
+    bool lookup(uint64_t hash, const Word* key, unsigned key_words, Word* value);
+
+    // Inserts or refreshes [key] -> [value], evicting the least
+    // recently used entry when full
+    void insert(const Word* key, unsigned key_words,
+                const Word* value, unsigned value_words);
+    void insert(uint64_t hash, const Word* key, unsigned key_words,
+                const Word* value, unsigned value_words);
+
+    // Changing the capacity evicts entries down to the new size
+    void set_capacity(unsigned capacity);
+    void set_bypass(bool bypass) { m_bypass = bypass; }
+    void clear();
+
+    bool enabled() const { return m_capacity > 0 && !m_bypass; }
+    unsigned capacity() const { return m_capacity; }
+    unsigned size() const { return m_lru.size(); }
+    unsigned long hits() const { return m_hits; }
+    unsigned long misses() const { return m_misses; }
+    unsigned long evictions() const { return m_evictions; }
+
+    void print_stats(const char* name) const;
+
+  private:
+    EntryList::iterator find(uint64_t hash, const Word* key, unsigned key_words);
+    void evict_to(unsigned n);
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <stdint.h>
+
+#include "WeightPack.h"
+#include "AccelTest.h"
+
+typedef unsigned __int128 uint128_t;
+
+// the 7 filters of a packed conv word, bit 63 is unused
+static const unsigned FILTER_BITS = CONV_W_PER_WORD*WT_SIZE;
+static const uint64_t FILTER_MASK = (uint64_t(1) << FILTER_BITS) - 1;
+
+static inline uint64_t filter_bits(const Word& w) {
+  return w.to_uint64() & FILTER_MASK;
+}
+
+// -----------------------------------------------------------------------
+// Returns [count] <= 7 consecutive filters of a packed conv weight array
+// starting at filter j, filter j in the low bits. Like the ap_int loops
+// it only touches the second source word if the filters cross into it.
+// -----------------------------------------------------------------------
+static inline uint64_t read_filters(const Word* wt, unsigned j, unsigned count) {
+  const unsigned addr = j / CONV_W_PER_WORD;
+  const unsigned off = j % CONV_W_PER_WORD;
+  uint128_t acc = filter_bits(wt[addr]);
+  if (off + count > CONV_W_PER_WORD)
+    acc |= uint128_t(filter_bits(wt[addr+1])) << FILTER_BITS;
+  const uint64_t mask = (uint64_t(1) << count*WT_SIZE) - 1;
+  return uint64_t(acc >> off*WT_SIZE) & mask;
+}
+
+// -----------------------------------------------------------------------
+// conv1: 3 filters per word, output n's filters start at filter 3*(o+n)
+// -----------------------------------------------------------------------
+void repack_conv1_weights(const Word* wt, Word* wt_o, unsigned o, unsigned n_out)
+{
+  const unsigned M = 3;
+  for (unsigned n = 0; n < n_out; ++n)
+    wt_o[n] = read_filters(wt, (o+n)*M, M);
+}
+
+// -----------------------------------------------------------------------
+// bin conv: filter p of each group of CONV_W_PER_WORD*CONVOLVERS goes to
+// field p / CONVOLVERS of bank p % CONVOLVERS
+// -----------------------------------------------------------------------
+void repack_conv_weights(const Word* wt, Word* wt_o,
+                         unsigned o, unsigned n_in, unsigned n_out
+) {
+  const unsigned GROUP = CONV_W_PER_WORD*CONVOLVERS;
+  const unsigned wt_words = WTS_TO_WORDS(n_in*n_out);
+  assert (wt_words <= WT_WORDS);
+
+  unsigned curr = o*n_in;
+  for (unsigned n = 0; n < wt_words/CONVOLVERS; ++n, curr += GROUP) {
+    if (CONVOLVERS == 1) {
+      wt_o[n] = read_filters(wt, curr, CONV_W_PER_WORD);
+      continue;
+    }
+
+    // unpack the group into single filters, then deal them out
+    uint16_t f[GROUP];
+    for (unsigned m = 0; m < CONVOLVERS; ++m) {
+      const uint64_t src = read_filters(wt, curr + m*CONV_W_PER_WORD, CONV_W_PER_WORD);
+      for (unsigned k = 0; k < CONV_W_PER_WORD; ++k)
+        f[m*CONV_W_PER_WORD + k] = (src >> k*WT_SIZE) & ((1 << WT_SIZE) - 1);
+    }
+    for (unsigned m = 0; m < CONVOLVERS; ++m) {
+      uint64_t bank = 0;
+      for (unsigned k = 0; k < CONV_W_PER_WORD; ++k)
+        bank |= uint64_t(f[k*CONVOLVERS + m]) << k*WT_SIZE;
+      wt_o[n*CONVOLVERS+m] = bank;
+    }
+  }
+}
+
+// -----------------------------------------------------------------------
+// dense: a contiguous run of whole words
+// -----------------------------------------------------------------------
+void repack_dense_weights(const Word* wt, Word* wt_o,
+                          unsigned o, unsigned n_in, unsigned n_out
+) {
+  assert(n_in % WORD_SIZE == 0);
+  const Word* src = wt + o*n_in/WORD_SIZE;
+  const unsigned n_words = n_in*n_out/WORD_SIZE;
+  std::copy(src, src + n_words, wt_o);
+}
@@ -0,0 +1,25 @@
+#ifndef ACCEL_WEIGHT_PACK_H
+#define ACCEL_WEIGHT_PACK_H
+
+#include "Accel.h"
+
+//------------------------------------------------------------------------
+// Native-integer versions of load_conv1_weights, load_conv_weights and
+// load_dense_weights (AccelSchedule.h). They produce the same wt_mem
+// layout, word for word, but move the 9-bit filters around as fields
+// of uint64_t / 128-bit integers instead of shifting ap_int<64> values
+// one filter at a time:
+// - 7 consecutive filters starting at any filter index are one 128-bit
+//   shift of two adjacent source words
+// - the CONVOLVERS banks are filled from CONVOLVERS such groups, filter
+//   k*CONVOLVERS+m of the batch going to field k of bank m
+// Words are converted to and from ap_int once each.
+//------------------------------------------------------------------------
+void repack_conv1_weights(const Word* wt, Word* wt_o,
+                          unsigned o, unsigned n_out);
+void repack_conv_weights(const Word* wt, Word* wt_o,
+                         unsigned o, unsigned n_in, unsigned n_out);
+void repack_dense_weights(const Word* wt, Word* wt_o,
+                          unsigned o, unsigned n_in, unsigned n_out);
+
+#endif
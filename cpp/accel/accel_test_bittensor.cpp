@@ -0,0 +1,179 @@
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Accel.h"
+#include "BitTensor.h"
+
+//------------------------------------------------------------------------
+// Test of BitTensor layouts and conversions.
+//
+//   accel_test_bittensor.exe [<seed>]
+//
+// For every layer shape of the network and some odd ones, fills a
+// tensor of each layout with random bits through set(), checks where
+// they landed against the layout's own formula, then converts it to
+// every layout and checks each element with get(). This covers all
+// paths of convert_from: the plain copy, the banked word permutation,
+// the 64x64 channel transpose and the bit by bit fallback. Float
+// packing and count_diffs are checked on the same tensors.
+//------------------------------------------------------------------------
+struct Shape {
+  unsigned planes, height, width;
+};
+
+static const Shape shapes[] = {
+  // layer inputs and outputs
+  {   3, 32, 32 }, { 128, 32, 32 }, { 128, 16, 16 }, { 256, 16, 16 },
+  { 256,  8,  8 }, { 512,  8,  8 }, { 512,  4,  4 }, { 8192, 1, 1 },
+  { 1024, 1,  1 }, {  10,  1,  1 },
+  // channel transpose with more than one tile each way
+  { 192,  8, 16 },
+  // partial words and planes, bit by bit conversions
+  {   1,  1,  1 }, {   5,  7,  9 }, {  70,  4,  4 }, {  65,  8,  8 },
+  { 100,  1,  1 }, {  64,  3,  3 }
+};
+
+static const BitLayout layouts[] = { BITS_ROW_MAJOR, BITS_BANKED, BITS_CHANNELS };
+static const char* const layout_names[] = { "row-major", "banked", "channels" };
+static const unsigned MAX_REPORTS = 10;
+
+static unsigned n_failed = 0;
+
+static void fail(const Shape& s, const char* what, unsigned p, unsigned r,
+                 unsigned c) {
+  if (n_failed++ < MAX_REPORTS)
+    printf ("  %ux%ux%u: %s at (%u,%u,%u)\n", s.planes, s.height, s.width,
+        what, p, r, c);
+}
+
+// The banked layout needs whole planes in whole words
+static bool layout_fits(const Shape& s, BitLayout layout) {
+  const unsigned pixels = s.height*s.width;
+  return layout != BITS_BANKED || pixels < WORD_SIZE || pixels % WORD_SIZE == 0;
+}
+
+// Storage word and bit of (p,r,c), computed here from the layout rules
+// rather than by BitTensor::locate
+static size_t expected_word(const Shape& s, BitLayout layout, unsigned p,
+                            unsigned r, unsigned c, unsigned& bit) {
+  const size_t pixels = size_t(s.height)*s.width;
+  if (layout == BITS_CHANNELS) {
+    bit = p % WORD_SIZE;
+    return (r*s.width + c) * ((s.planes + WORD_SIZE-1) / WORD_SIZE) + p / WORD_SIZE;
+  }
+  const size_t i = (p*pixels + r*s.width + c);
+  bit = i % WORD_SIZE;
+  if (layout == BITS_ROW_MAJOR)
+    return i / WORD_SIZE;
+  // LOOP_DMEM_I: unit u of a plane (or a word) goes to bank u%CONVOLVERS
+  const size_t unit = (pixels < WORD_SIZE) ? 1 : pixels / WORD_SIZE;
+  const size_t rm_words = (s.planes*pixels + WORD_SIZE-1) / WORD_SIZE;
+  const size_t units = (rm_words + unit-1) / unit;
+  const size_t bank_words = (units + CONVOLVERS-1) / CONVOLVERS * unit;
+  const size_t u = (i / WORD_SIZE) / unit;
+  return (u % CONVOLVERS)*bank_words + (u / CONVOLVERS)*unit + (i / WORD_SIZE) % unit;
+}
+
+// Every element of [t] must equal [ref], read both with get() and from
+// the storage word
+static void check_tensor(const Shape& s, const BitTensor& t,
+                         const std::vector<bool>& ref, const char* what) {
+  unsigned i = 0;
+  for (unsigned p = 0; p < s.planes; ++p)
+    for (unsigned r = 0; r < s.height; ++r)
+      for (unsigned c = 0; c < s.width; ++c, ++i) {
+        unsigned bit;
+        const size_t w = expected_word(s, t.layout(), p, r, c, bit);
+        const bool stored = (t.words()[w].to_uint64() >> bit) & 1;
+        if ((t.get(p, r, c) != 0) != ref[i] || stored != ref[i]) {
+          fail(s, what, p, r, c);
+          return;
+        }
+      }
+}
+
+static void test_shape(const Shape& s, BitArena& arena) {
+  const unsigned n = s.planes*s.height*s.width;
+  std::vector<bool> ref(n);
+  std::vector<float> floats(n), back(n);
+  char what[96];
+
+  for (unsigned a = 0; a < 3; ++a) {
+    const BitLayout from = layouts[a];
+    if (!layout_fits(s, from))
+      continue;
+
+    // random bits written one at a time
+    arena.reset();
+    BitTensor src(arena, s.planes, s.height, s.width, from);
+    unsigned i = 0;
+    for (unsigned p = 0; p < s.planes; ++p)
+      for (unsigned r = 0; r < s.height; ++r)
+        for (unsigned c = 0; c < s.width; ++c, ++i) {
+          ref[i] = rand() & 1;
+          src.set(p, r, c, ref[i] ? Bit(-1) : Bit(0));
+        }
+    snprintf(what, sizeof(what), "set() on %s", layout_names[a]);
+    check_tensor(s, src, ref, what);
+
+    // every conversion, into storage filled with ones so that missed
+    // words show up
+    for (unsigned b = 0; b < 3; ++b) {
+      const BitLayout to = layouts[b];
+      if (!layout_fits(s, to))
+        continue;
+      const size_t words = BitTensor::num_words(s.planes, s.height, s.width, to);
+      std::vector<Word> buf(words, Word(-1));
+      BitTensor dst(&buf[0], s.planes, s.height, s.width, to);
+      dst.convert_from(src);
+      snprintf(what, sizeof(what), "convert_from %s to %s",
+          layout_names[a], layout_names[b]);
+      check_tensor(s, dst, ref, what);
+
+      snprintf(what, sizeof(what), "count_diffs %s and %s",
+          layout_names[a], layout_names[b]);
+      if (dst.count_diffs(src) != 0)
+        fail(s, what, 0, 0, 0);
+      dst.set(s.planes-1, s.height-1, s.width-1, ref[n-1] ? Bit(0) : Bit(-1));
+      if (dst.count_diffs(src) != 1 || src.count_diffs(dst) != 1)
+        fail(s, what, s.planes-1, s.height-1, s.width-1);
+    }
+
+    // floats round trip through any layout
+    for (unsigned j = 0; j < n; ++j)
+      floats[j] = ref[j] ? -0.5f - j : 0.5f + j;
+    BitTensor packed(arena, s.planes, s.height, s.width, from);
+    packed.from_floats(&floats[0]);
+    snprintf(what, sizeof(what), "from_floats on %s", layout_names[a]);
+    check_tensor(s, packed, ref, what);
+    packed.to_floats(&back[0]);
+    for (unsigned j = 0; j < n; ++j) {
+      if (back[j] != (ref[j] ? -1.0f : 1.0f)) {
+        snprintf(what, sizeof(what), "to_floats on %s, element %u",
+            layout_names[a], j);
+        fail(s, what, 0, 0, 0);
+        break;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  const unsigned seed = (argc > 1) ? std::stoi(argv[1]) : 1;
+  srand(seed);
+
+  const unsigned n_shapes = sizeof(shapes) / sizeof(shapes[0]);
+  printf ("## Checking BitTensor layouts on %u shapes, seed %u ##\n",
+      n_shapes, seed);
+
+  // room for the two arena tensors of the largest shape in any layout
+  BitArena arena(3 * (128*32*32 / WORD_SIZE + 2*CONVOLVERS*16) + 64);
+  for (unsigned k = 0; k < n_shapes; ++k)
+    test_shape(shapes[k], arena);
+
+  printf ("%u checks failed\n", n_failed);
+  printf ("%s\n", n_failed ? "Tests failed!" : "Tests passed!");
+  return n_failed ? 1 : 0;
+}
@@ -1,178 +1,216 @@
+#include <algorithm>
 #include <cstddef>
 #include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
 #include <hls_video.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "Accel.h"
 #include "AccelSchedule.h"
 #include "AccelTest.h"
-#include "Dense.h"
+#include "BnnModel.h"
+#include "BnnProtocol.h"
+#include "BufferPool.h"
+#include "InputStage.h"
+#include "LatencyStats.h"
+#include "LowJitter.h"
+#include "MemTrack.h"
+#include "Metrics.h"
+#include "PerfCounters.h"
 #include "ZipIO.h"
 #include "ParamIO.h"
 #include "DataIO.h"
+#include "Common.h"
 #include "Timer.h"
 
+//------------------------------------------------------------------------
+// Runs the model over all images, returns the number of errors. The
+// latency of each predict() call goes to [latency] and the predictions
+// to [predictions] if not NULL.
+//------------------------------------------------------------------------
+static unsigned run_images(
+    BnnModel& model, const Cifar10TestInputs& X, const Cifar10TestLabels& y,
+    unsigned n_imgs, unsigned stage_depth, int stage_cpu,
+    LatencyStats& latency, bool verbose, std::vector<int>* predictions = NULL
+) {
+  typedef std::chrono::steady_clock Clock;
+  unsigned n_errors = 0;
+  static MetricCounter* m_labeled = metric_counter("bnn_labeled_images_total",
+      "Images run with a known label");
+  static MetricCounter* m_errors = metric_counter("bnn_errors_total",
+      "Predictions that differ from the label");
+  static MetricHistogram* m_latency = metric_histogram("bnn_image_latency_seconds",
+      "Latency of each predict() call");
+
+  // binarizes upcoming images while the current one runs
+  InputStager stager(X.data, n_imgs, stage_depth);
+  if (stage_cpu >= 0)
+    stager.pin(stage_cpu);
+
+  for (unsigned n = 0; n < n_imgs; ++n) {
+    Word* img_i = stager.acquire(n);
+    Clock::time_point t0 = Clock::now();
+    int prediction = model.predict(img_i);
+    const float us = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - t0).count();
+    latency.add(us);
+    m_latency->observe(us * 1e-6);
+    stager.release(n);
+
+    //assert(prediction >= 0 && prediction <= 9);
+    int label = y.data[n];
+    if (predictions)
+      predictions->push_back(prediction);
+
+    if (verbose)
+      printf ("  Pred/Label:\t%2u/%2d\t[%s]\n", prediction, label,
+          ((prediction==label)?" OK ":"FAIL"));
+
+    n_errors += (prediction!=label);
+    m_labeled->inc();
+    m_errors->inc(prediction != label);
+  }
+  return n_errors;
+}
+
+// Untimed images run before each pass of the low-jitter comparison, so
+// that neither pass alone pays for the first touches of the process
+static const unsigned LJ_WARMUP_IMAGES = 4;
+
+static void warm_up(BnnModel& model, const Cifar10TestInputs& X,
+                    const Cifar10TestLabels& y, unsigned n_imgs,
+                    unsigned stage_depth, int stage_cpu) {
+  LatencyStats discard;
+  run_images(model, X, y, std::min(n_imgs, LJ_WARMUP_IMAGES), stage_depth,
+             stage_cpu, discard, false);
+}
+
+//------------------------------------------------------------------------
+// Sends the results of this shard to the bnn_shard coordinator listening
+// on the Unix socket [path], see BnnShardHeader
+//------------------------------------------------------------------------
+static bool send_shard_report(const char* path, const BnnShardHeader& hdr,
+                              const std::vector<int>& predictions) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return false;
+  }
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror(path);
+    close(fd);
+    return false;
+  }
+  std::vector<int8_t> p(predictions.begin(), predictions.end());
+  const bool ok = write_full(fd, &hdr, sizeof(hdr)) &&
+                  write_full(fd, p.data(), p.size());
+  close(fd);
+  return ok;
+}
+
 int main(int argc, char** argv) {
   if (argc < 2) {
     printf ("Give number of images to test as 1st arg\n");
+    printf ("and optionally the index of the first image as 2nd arg\n");
     return 0;
   }
   const unsigned n_imgs = std::stoi(argv[1]);
+  const unsigned start = (argc > 2) ? std::stoi(argv[2]) : 0;
+  // set by bnn_shard, where to send the shard report
+  const char* report_path = getenv("BNN_SHARD_REPORT");
+
+  // number of images binarized ahead of the accelerator, 0 = no staging thread
+  const char* stage_env = getenv("BNN_STAGE_DEPTH");
+  const int stage_depth = stage_env ? std::stoi(stage_env) : 2;
+  if (stage_depth < 0) {
+    fprintf (stderr, "**** ERROR: BNN_STAGE_DEPTH must be >= 0, got %d\n", stage_depth);
+    return -1;
+  }
+  const unsigned STAGE_DEPTH = stage_depth;
+  printf ("## Input staging depth %u ##\n", STAGE_DEPTH);
 
-  const unsigned lconv  = 6;  // last conv
-  const unsigned ldense = 8;  // last dense
-  const bool DENSE_LAYER_CPU = getenv("BNN_DENSE_LAYER_CPU") != NULL;
-  const bool LAST_LAYER_CPU = getenv("BNN_LAST_LAYER_CPU") != NULL;
-  if (DENSE_LAYER_CPU)
-    printf ("## Dense layer CPU is turned on ##\n");
-  if (LAST_LAYER_CPU)
-    printf ("## Last layer CPU is turned on ##\n");
+  const LowJitterConfig LJ = low_jitter_from_env();
 
   // print some config numbers
   printf ("* WT_WORDS   = %u\n", WT_WORDS);
   printf ("* KH_WORDS   = %u\n", KH_WORDS);
 
   // Load input data
-  printf ("## Loading input data ##\n");
-  Cifar10TestInputs X(n_imgs);
-  Cifar10TestLabels y(n_imgs);
-
-  // Load parameters
-  printf ("## Loading parameters ##\n");
-  Params params(get_root_dir() + "/params/cifar10_parameters_nb.zip");
-
-  // ---------------------------------------------------------------------
-  // allocate and binarize all weights
-  // ---------------------------------------------------------------------
-  Word* wt[N_LAYERS];
-  Word* kh[N_LAYERS];
-  for (unsigned l = 0; l < N_LAYERS; ++l) {
-    const unsigned M = M_tab[l];
-    const unsigned N = N_tab[l];
-    if (layer_is_conv(l+1))
-      wt[l] = new Word[WTS_TO_WORDS(M*N)];
-    else
-      wt[l] = new Word[M*N / WORD_SIZE];
-    const float* weights = params.float_data(widx_tab[l]);
-    set_weight_array(wt[l], weights, l+1);
-
-    kh[l] = new Word[N/KH_PER_WORD * sizeof(Word)];
-    const float* k = params.float_data(kidx_tab[l]);
-    const float* h = params.float_data(hidx_tab[l]);
-    set_bnorm_array(kh[l], k, h, l+1);
-  }
+  // mem_report below prints the RSS of each startup phase
+  mem_enable_phases();
 
-  // ---------------------------------------------------------------------
-  // // compute accelerator schedule (divides up weights)
-  // ---------------------------------------------------------------------
-  AccelSchedule layer_sched[N_LAYERS];
-  for (unsigned l = 0; l < N_LAYERS; ++l) {
-    compute_accel_schedule(
-        wt[l], kh[l],
-        M_tab[l], N_tab[l], S_tab[l], T_tab[l], pool_tab[l],
-        layer_sched[l]
-    );
+  printf ("## Loading input data ##\n");
+  Cifar10TestInputs X(n_imgs, start);
+  Cifar10TestLabels y(n_imgs, start);
+  mem_phase("data");
+
+  const std::string param_file = default_param_file();
+
+  // In low-jitter mode first run all images with the mode off, from a
+  // fresh model and an empty pool, as the baseline for the comparison.
+  // Both passes start with the same untimed warm-up.
+  LatencyStats latency_off;
+  if (LJ.enabled) {
+    printf ("## Low-jitter mode: baseline run with the mode off ##\n");
+    {
+      BnnModel model(param_file);
+      model.read_env();
+      warm_up(model, X, y, n_imgs, STAGE_DEPTH, -1);
+      run_images(model, X, y, n_imgs, STAGE_DEPTH, -1, latency_off, false);
+    }
+    dma_pool().trim();
   }
 
-  // allocate memories for data i/o for the accelerator
-  Word* data_i  = (Word*) MEM_ALLOC( DMEM_WORDS * sizeof(Word) );
-  Word* data_o  = (Word*) MEM_ALLOC( DMEM_O_WORDS * sizeof(Word) );
-  if (!data_i || !data_o) {
-    fprintf (stderr, "**** ERROR: Alloc failed in %s\n", __FILE__);
-    return (-2);
+  // Load parameters, binarize them and compute the layer schedules
+  printf ("## Loading parameters ##\n");
+  BnnModel model(param_file);
+  model.startup.print();
+  const size_t rss_loaded = resident_bytes();
+  model.read_env();
+  if (model.compacted)
+    printf ("## Compact model: RSS %.1f MB after load, %.1f MB compacted ##\n",
+        rss_loaded / float(1 << 20), resident_bytes() / float(1 << 20));
+  if (model.cpu_dense)
+    printf ("## Dense layer CPU is turned on ##\n");
+  if (model.cpu_last)
+    printf ("## Last layer CPU is turned on ##\n");
+  if (model.cache.capacity() > 0 || model.memo[0].capacity() > 0)
+    printf ("## Result cache %u images, conv memos %u entries%s ##\n",
+        model.cache.capacity(), model.memo[0].capacity(),
+        getenv("BNN_CACHE_BYPASS") ? " (bypassed)" : "");
+  if (model.delta)
+    printf ("## Delta mode is turned on ##\n");
+  mem_report(name_tab, N_LAYERS);
+
+  if (LJ.enabled) {
+    const size_t locked = model.lock_resident();
+    apply_low_jitter(LJ, 0);
+    printf ("## Low-jitter mode: %.1f MB locked, inference on cpu %d, "
+            "staging on cpu %d, SCHED_FIFO %d ##\n",
+        locked / float(1 << 20), LJ.cpu(0), LJ.cpu(1), LJ.fifo_prio);
+    warm_up(model, X, y, n_imgs, STAGE_DEPTH, LJ.cpu(1));
   }
 
-  unsigned n_errors = 0;
-
-  printf ("## Running BNN for %d images\n", n_imgs);
+  printf ("## Running BNN for %d images from image %u\n", n_imgs, start);
 
   //--------------------------------------------------------------
   // Run BNN
   //--------------------------------------------------------------
-  for (unsigned n = 0; n < n_imgs; ++n) {
-    float* data = X.data + n*3*32*32;
-    binarize_input_images(data_i, data, 32);
-
-    //------------------------------------------------------------
-    // Execute conv layers
-    //------------------------------------------------------------
-    for (unsigned l = 1; l <= lconv; ++l) {
-      const unsigned M = M_tab[l-1];
-      const unsigned N = N_tab[l-1];
-      const unsigned S = S_tab[l-1];
-      unsigned input_words = (l==1) ? S*S : M*S*S/WORD_SIZE;
-      unsigned output_words = (pool_tab[l-1]) ? N*S*S/WORD_SIZE/4 : N*S*S/WORD_SIZE;
-
-      run_accel_schedule(
-          data_i, data_o,
-          l-1,        // layer_idx
-          (l==1) ? input_words : 0,
-          (l==lconv && DENSE_LAYER_CPU) ? output_words : 0,
-          l % 2,      // mem_mode
-          layer_sched[l-1]
-      );
-    }
-
-    //------------------------------------------------------------
-    // Execute dense layers
-    //------------------------------------------------------------
-    for (unsigned l = lconv+1; l <= ldense; ++l) {
-      const unsigned M = M_tab[l-1];
-      const unsigned N = N_tab[l-1];
-
-      if (DENSE_LAYER_CPU) {
-        for (unsigned i = 0; i < M/WORD_SIZE; ++i)
-          data_i[i] = data_o[i];
-
-        dense_layer_cpu(
-            wt[l-1], params.float_data(3*l-2), params.float_data(3*l-1),
-            data_i, data_o, M, N
-        );
-
-      } else {
-        run_accel_schedule(
-            data_i, data_o,
-            l-1,
-            0,    // input_words
-            (l==ldense && LAST_LAYER_CPU) ? 1024/WORD_SIZE : 0,
-            l % 2,
-            layer_sched[l-1]
-        );
-      }
-    }
-
-    //------------------------------------------------------------
-    // Execute last layer
-    //------------------------------------------------------------
-    int prediction = -1;
-    if (DENSE_LAYER_CPU || LAST_LAYER_CPU) {
-      prediction = last_layer_cpu(
-          wt[ldense],
-          params.float_data(kidx_tab[ldense]),
-          params.float_data(hidx_tab[ldense]),
-          data_o,
-          M_tab[ldense], N_tab[ldense]
-      );
-    } else {
-      run_accel_schedule(
-          data_i, data_o,
-          ldense,
-          0, 1,
-          1,
-          layer_sched[ldense]
-      );
-      ap_int<8> p = 0;
-      p(7,0) = data_o[0](7,0);
-      prediction = p.to_int();
-    }
-
-    //assert(prediction >= 0 && prediction <= 9);
-    int label = y.data[n];
-
-    printf ("  Pred/Label:\t%2u/%2d\t[%s]\n", prediction, label,
-        ((prediction==label)?" OK ":"FAIL"));
-
-    n_errors += (prediction!=label);
-  }
+  LatencyStats latency;
+  std::vector<int> predictions;
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  unsigned n_errors = run_images(model, X, y, n_imgs, STAGE_DEPTH,
+                                 LJ.enabled ? LJ.cpu(1) : -1, latency, true,
+                                 &predictions);
+  const float run_secs = std::chrono::duration<float>(
+      std::chrono::steady_clock::now() - t0).count();
 
   printf ("\n");
   printf ("Errors: %u (%4.2f%%)\n", n_errors, float(n_errors)*100/n_imgs);
@@ -180,11 +218,32 @@ int main(int argc, char** argv) {
   printf ("Total accel runtime = %10.4f seconds\n", total_time());
   printf ("\n");
 
-  MEM_FREE( data_o );
-  MEM_FREE( data_i );
-  for (unsigned n = 0; n < N_LAYERS; ++n) {
-    delete[] wt[n];
-    delete[] kh[n];
+  latency.print("image latency");
+  if (LJ.enabled) {
+    latency_off.print("image latency (off)");
+    const float on = latency.percentile(99.9);
+    const float off = latency_off.percentile(99.9);
+    printf ("Low-jitter p99.9: %.1f usecs on vs %.1f usecs off (%+.1f usecs)\n",
+        on, off, on - off);
+  }
+  dma_pool().print_stats();
+  model.print_stats();
+  perf_print_timers(n_imgs);
+
+  if (report_path) {
+    BnnShardHeader hdr;
+    hdr.magic = BNN_SHARD_MAGIC;
+    hdr.start = start;
+    hdr.count = n_imgs;
+    hdr.n_errors = n_errors;
+    hdr.startup_s = model.startup.total();
+    hdr.run_s = run_secs;
+    hdr.p50_us = latency.percentile(50);
+    hdr.p99_us = latency.percentile(99);
+    if (!send_shard_report(report_path, hdr, predictions)) {
+      fprintf (stderr, "**** ERROR: cannot send the shard report to %s\n", report_path);
+      return -1;
+    }
   }
   return 0;
 }
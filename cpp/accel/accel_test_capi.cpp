@@ -0,0 +1,134 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bnn.h"
+#include "Common.h"
+#include "DataIO.h"
+
+//------------------------------------------------------------------------
+// Test of the C API, linked against libbnn.so like an embedding
+// program. Loads the model through bnn_load, checks that bnn_infer and
+// bnn_infer_batch agree on [n] test images, and that bad arguments and
+// missing, truncated or corrupted archives are reported as errors
+// instead of ending the process.
+//------------------------------------------------------------------------
+static const unsigned IMG_SIZE = 3*32*32;
+
+static unsigned n_failed = 0;
+
+static void check(bool ok, const char* what) {
+  printf ("  %-48s %s\n", what, ok ? "ok" : "FAILED");
+  n_failed += !ok;
+}
+
+static std::vector<char> read_file(const std::string& path) {
+  std::vector<char> buf;
+  FILE* f = fopen(path.c_str(), "rb");
+  if (f == NULL)
+    return buf;
+  fseek(f, 0, SEEK_END);
+  buf.resize(ftell(f));
+  fseek(f, 0, SEEK_SET);
+  if (fread(buf.data(), 1, buf.size(), f) != buf.size())
+    buf.clear();
+  fclose(f);
+  return buf;
+}
+
+// Writes [bytes] to a new temporary file and returns its name
+static std::string write_temp(const std::vector<char>& bytes) {
+  char name[] = "/tmp/bnn_capi_XXXXXX";
+  const int fd = mkstemp(name);
+  if (fd < 0) {
+    perror("mkstemp");
+    exit(-1);
+  }
+  const bool ok = write(fd, bytes.data(), bytes.size()) == (ssize_t)bytes.size();
+  close(fd);
+  if (!ok) {
+    fprintf (stderr, "**** ERROR: cannot write %s\n", name);
+    exit(-1);
+  }
+  return name;
+}
+
+// bnn_load must fail on [bytes] and leave the process running
+static void check_load_fails(const std::vector<char>& bytes, const char* what) {
+  const std::string path = write_temp(bytes);
+  bnn_ctx* ctx = bnn_load(path.c_str());
+  check(ctx == NULL, what);
+  bnn_free(ctx);
+  unlink(path.c_str());
+}
+
+int main(int argc, char** argv) {
+  const unsigned n_imgs = (argc > 1) ? std::stoi(argv[1]) : 4;
+  const char* env = getenv("BNN_PARAMS");
+  const std::string param_file = (argc > 2) ? argv[2] :
+      env ? env : get_root_dir() + "/params/cifar10_parameters_nb.zip";
+
+  printf ("## Bad arguments and archives ##\n");
+  check(bnn_load(NULL) == NULL, "bnn_load(NULL)");
+  check(bnn_load("/nonexistent/params.zip") == NULL, "bnn_load of a missing file");
+  bnn_free(NULL);
+
+  const std::vector<char> archive = read_file(param_file);
+  if (archive.size() < 64) {
+    fprintf (stderr, "**** ERROR: cannot read %s\n", param_file.c_str());
+    return -1;
+  }
+  const bool packed = memcmp(archive.data(), "BNNPACK", 8) == 0;
+
+  std::vector<char> bad(archive.begin(), archive.begin() + archive.size()/2);
+  check_load_fails(bad, "bnn_load of a truncated archive");
+
+  // a zip fails its CRC check, a packed archive loses the first array
+  // of its table (the layer field)
+  bad = archive;
+  const size_t at = packed ? 32 : archive.size()/2;
+  for (size_t i = at; i < at + 8; ++i)
+    bad[i] ^= 0x5a;
+  check_load_fails(bad, "bnn_load of a corrupted archive");
+
+  // a valid zip that does not hold the model's arrays
+  check_load_fails(read_file(get_root_dir() + Cifar10TestLabels::filename),
+                   "bnn_load of an archive with wrong shapes");
+
+  printf ("## Inference on %u images ##\n", n_imgs);
+  Cifar10TestInputs X(n_imgs);
+  Cifar10TestLabels y(n_imgs);
+
+  bnn_ctx* ctx = bnn_load(param_file.c_str());
+  check(ctx != NULL, "bnn_load of the model");
+  if (ctx == NULL)
+    return 1;
+
+  int p = 0;
+  check(bnn_infer(NULL, X.data, &p) == -1, "bnn_infer without a context");
+  check(bnn_infer(ctx, NULL, &p) == -1, "bnn_infer without an image");
+  check(bnn_infer(ctx, X.data, NULL) == -1, "bnn_infer without an output");
+
+  std::vector<int> single(n_imgs, -1), batch(n_imgs, -1);
+  bool ok = true;
+  for (unsigned i = 0; i < n_imgs; ++i)
+    ok &= bnn_infer(ctx, X.data + i*IMG_SIZE, &single[i]) == 0;
+  check(ok, "bnn_infer of every image");
+  check(bnn_infer_batch(ctx, X.data, n_imgs, batch.data()) == 0, "bnn_infer_batch");
+  check(single == batch, "bnn_infer and bnn_infer_batch agree");
+
+  unsigned n_errors = 0;
+  for (unsigned i = 0; i < n_imgs; ++i)
+    n_errors += single[i] != int(y.data[i]);
+  printf ("  Errors: %u (%4.2f%%)\n", n_errors, float(n_errors)*100/n_imgs);
+
+  bnn_free(ctx);
+
+  printf ("%u checks failed\n", n_failed);
+  return n_failed ? 1 : 0;
+}
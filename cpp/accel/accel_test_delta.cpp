@@ -0,0 +1,125 @@
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "Accel.h"
+#include "AccelTest.h"
+#include "BnnModel.h"
+#include "DeltaInference.h"
+#include "GoldenModel.h"
+#include "DataIO.h"
+
+//------------------------------------------------------------------------
+// Differential test of delta mode.
+//
+//   accel_test_delta.exe [<n_frames>] [<n_images>]
+//
+// Builds a stream of n_frames frames from the first n_images test images:
+// each frame is the previous one with 1-3 random rectangular patches
+// copied in from another image, with an occasional unchanged frame or
+// whole new image. Every frame goes through DeltaInference and through
+// a full run of GoldenModel, and the prediction, the output maps of all
+// conv layers and the inputs of all dense layers must be equal.
+//------------------------------------------------------------------------
+static const unsigned C = 3;
+static const unsigned S = 32;
+static const unsigned IMG_SIZE = C*S*S;
+static const unsigned MAX_REPORTS = 10;  // mismatches printed
+
+static const char* const frame_kinds[] = { "patched", "unchanged", "new" };
+
+// Copies a random rectangle of [src] into [dst], at a random position
+static void apply_patch(float* dst, const float* src) {
+  const unsigned h = 1 + rand() % 10;
+  const unsigned w = 1 + rand() % 10;
+  const unsigned r0 = rand() % (S - h + 1), c0 = rand() % (S - w + 1);
+  const unsigned sr = rand() % (S - h + 1), sc = rand() % (S - w + 1);
+  for (unsigned m = 0; m < C; ++m)
+    for (unsigned r = 0; r < h; ++r)
+      for (unsigned c = 0; c < w; ++c)
+        dst[(m*S + r0+r)*S + c0+c] = src[(m*S + sr+r)*S + sc+c];
+}
+
+// Compares one map, reports the first difference
+static bool same_map(const std::vector<uint64_t>& got,
+                     const std::vector<uint64_t>& exp,
+                     unsigned frame, const char* layer, unsigned& n_reports) {
+  if (got == exp)
+    return true;
+  if (n_reports++ < MAX_REPORTS) {
+    unsigned i = 0;
+    while (i < got.size() && i < exp.size() && got[i] == exp[i])
+      ++i;
+    printf ("  Frame %u %s: word %u of %u differs\n", frame, layer, i,
+        (unsigned)exp.size());
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  const unsigned n_frames = (argc > 1) ? std::stoi(argv[1]) : 200;
+  const unsigned n_imgs = (argc > 2) ? std::stoi(argv[2]) : 16;
+  srand(1);
+
+  printf ("## Loading input data ##\n");
+  Cifar10TestInputs X(n_imgs);
+
+  printf ("## Loading parameters ##\n");
+  BnnModel model(default_param_file());
+  DeltaInference delta(model.wt, model.kh);
+  GoldenModel golden(model.wt, model.kh);
+
+  printf ("## Checking %u frames ##\n", n_frames);
+  std::vector<float> frame(X.data, X.data + IMG_SIZE);
+  std::vector<Word> img_i(S*S);
+  GoldenModel::Maps maps;
+  unsigned n_bad = 0, n_reports = 0;
+  unsigned kind_count[3] = {0}, kind_bad[3] = {0};
+
+  for (unsigned f = 0; f < n_frames; ++f) {
+    // the first frame is image 0
+    const unsigned r = rand() % 100;
+    const unsigned kind = (f == 0) ? 0 : (r < 10) ? 1 : (r < 15) ? 2 : 0;
+    const float* src = X.data + (rand() % n_imgs)*IMG_SIZE;
+    if (kind == 0 && f > 0) {
+      const unsigned n_patches = 1 + rand() % 3;
+      for (unsigned p = 0; p < n_patches; ++p)
+        apply_patch(&frame[0], src);
+    } else if (kind == 2) {
+      memcpy(&frame[0], src, IMG_SIZE*sizeof(float));
+    }
+    binarize_input_images(&img_i[0], &frame[0], S);
+
+    const int pred = delta.predict(&img_i[0]);
+    golden.run(&img_i[0], maps);
+
+    bool ok = true;
+    if (pred != maps.prediction) {
+      ok = false;
+      if (n_reports++ < MAX_REPORTS)
+        printf ("  Frame %u: prediction %d != %d\n", f, pred, maps.prediction);
+    }
+    char name[32];
+    for (unsigned l = 0; l < L_CONV; ++l) {
+      snprintf(name, sizeof(name), "%s output", name_tab[l]);
+      ok &= same_map(delta.conv_out(l), maps.conv[l], f, name, n_reports);
+    }
+    for (unsigned d = 0; L_CONV + d < N_LAYERS; ++d) {
+      snprintf(name, sizeof(name), "%s input", name_tab[L_CONV + d]);
+      ok &= same_map(delta.dense_in(d), maps.out[L_CONV-1 + d], f, name, n_reports);
+    }
+
+    kind_count[kind]++;
+    kind_bad[kind] += !ok;
+    n_bad += !ok;
+  }
+
+  printf ("\n");
+  for (unsigned k = 0; k < 3; ++k)
+    printf ("  %-9s frames: %4u, %u mismatching\n", frame_kinds[k],
+        kind_count[k], kind_bad[k]);
+  delta.print_stats();
+  printf ("%s\n", n_bad ? "Tests failed!" : "Tests passed!");
+  return n_bad ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+#include <cstddef>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+
+#include "Accel.h"
+#include "AccelSchedule.h"
+#include "AccelTest.h"
+#include "BnnModel.h"
+#include "GoldenModel.h"
+#include "ParallelFor.h"
+#include "DataIO.h"
+#include "Common.h"
+
+//------------------------------------------------------------------------
+// Verifies the accelerator model against the golden CPU model.
+//
+//   accel_test_golden.exe <n_images> [<n_accel>]
+//
+// The golden model runs all n_images on BNN_THREADS threads and its
+// predictions are scored against the labels. The first n_accel images
+// (default all) also go through the accelerator one layer at a time.
+// Each layer gets the golden output of the previous layer as its input,
+// so a mismatch points at the layer that caused it, and its dmem_o
+// words are compared with the golden maps.
+//------------------------------------------------------------------------
+typedef std::chrono::steady_clock Clock;
+
+static const unsigned BATCH = 64;       // images per golden batch
+static const unsigned MAX_REPORTS = 10; // mismatches printed in full
+
+static float seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<float>(Clock::now() - t0).count();
+}
+
+// Words of the accelerator input of layer l (1-based)
+static unsigned input_words(unsigned l) {
+  const unsigned M = M_tab[l-1];
+  const unsigned S = S_tab[l-1];
+  if (l == 1)
+    return S*S;
+  return layer_is_conv(l) ? M*S*S/WORD_SIZE : M/WORD_SIZE;
+}
+
+// Prints the first differing bit of layer l (1-based) at word [i]
+static void report(unsigned img, unsigned l, unsigned i, uint64_t got,
+                   uint64_t exp, unsigned n_diff, unsigned n_words) {
+  const unsigned S = (layer_is_conv(l) && pool_tab[l-1]) ? S_tab[l-1]/2 : S_tab[l-1];
+  const unsigned P = layer_is_conv(l) ? S*S : 1;
+  const unsigned k = i*WORD_SIZE + __builtin_ctzll(got ^ exp);
+  printf ("  Image %u layer %u: %u of %u words differ, first at word %u "
+          "(output %u, row %u, col %u): %016llx != %016llx\n",
+      img, l, n_diff, n_words, i, k / P, (k % P) / S, k % S,
+      (unsigned long long)got, (unsigned long long)exp);
+}
+
+//------------------------------------------------------------------------
+// Runs one image through the accelerator layer by layer. Returns a mask
+// with bit l-1 set for each layer l whose output differs from [ref].
+//------------------------------------------------------------------------
+static unsigned check_image(BnnModel& model, Word* img_i,
+                            const GoldenModel::Maps& ref, unsigned img,
+                            unsigned& n_reports) {
+  unsigned bad = 0;
+  for (unsigned l = 1; l <= N_LAYERS; ++l) {
+    const bool last = layer_is_last(l);
+    const unsigned n_out = last ? 1 : GoldenModel::output_words(l-1);
+
+    if (l > 1) {
+      const std::vector<uint64_t>& in = ref.out[l-2];
+      for (unsigned i = 0; i < input_words(l); ++i)
+        model.data_i[i] = in[i];
+    }
+    run_accel_schedule(
+        (l==1) ? img_i : model.data_i, model.data_o,
+        l-1,
+        input_words(l),
+        n_out,
+        l % 2,
+        model.sched[l-1]
+    );
+
+    if (last) {
+      ap_int<8> p = 0;
+      p(7,0) = model.data_o[0](7,0);
+      if (p.to_int() != ref.prediction) {
+        bad |= 1 << (l-1);
+        if (n_reports++ < MAX_REPORTS)
+          printf ("  Image %u layer %u: prediction %d != %d\n",
+              img, l, p.to_int(), ref.prediction);
+      }
+      continue;
+    }
+
+    unsigned n_diff = 0, first = 0;
+    for (unsigned i = 0; i < n_out; ++i) {
+      if (model.data_o[i].to_uint64() != ref.out[l-1][i]) {
+        if (n_diff++ == 0)
+          first = i;
+      }
+    }
+    if (n_diff) {
+      bad |= 1 << (l-1);
+      if (n_reports++ < MAX_REPORTS)
+        report(img, l, first, model.data_o[first].to_uint64(),
+               ref.out[l-1][first], n_diff, n_out);
+    }
+  }
+  return bad;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf ("Give number of images to test as 1st arg\n");
+    return 0;
+  }
+  const unsigned n_imgs = std::stoi(argv[1]);
+  const unsigned n_accel = (argc > 2) ? std::stoi(argv[2]) : n_imgs;
+  const unsigned n_threads = default_threads();
+  const unsigned img_words = S_tab[0]*S_tab[0];
+
+  printf ("## Loading input data ##\n");
+  Cifar10TestInputs X(n_imgs);
+  Cifar10TestLabels y(n_imgs);
+
+  printf ("## Loading parameters ##\n");
+  BnnModel model(default_param_file());
+  model.startup.print();
+
+  Clock::time_point t0 = Clock::now();
+  GoldenModel golden(model.wt, model.kh);
+  printf ("## Golden model built in %.3f s ##\n", seconds_since(t0));
+
+  printf ("## Checking %u images, %u through the accelerator, %u threads ##\n",
+      n_imgs, n_accel < n_imgs ? n_accel : n_imgs, n_threads);
+
+  std::vector<Word> imgs(BATCH*img_words);
+  std::vector<GoldenModel::Maps> maps(BATCH);
+  unsigned n_errors = 0, n_checked = 0, n_bad = 0, n_reports = 0;
+  unsigned layer_bad[N_LAYERS] = {0};
+  float t_golden = 0, t_accel = 0;
+
+  for (unsigned b = 0; b < n_imgs; b += BATCH) {
+    const unsigned n = (n_imgs - b < BATCH) ? n_imgs - b : BATCH;
+
+    t0 = Clock::now();
+    parallel_for(n, n_threads, [&](unsigned i) {
+      binarize_input_images(&imgs[i*img_words], X.data + (b+i)*3*img_words, S_tab[0]);
+    });
+    golden.run_batch(&imgs[0], n, &maps[0], n_threads);
+    t_golden += seconds_since(t0);
+
+    for (unsigned i = 0; i < n; ++i)
+      n_errors += (maps[i].prediction != y.data[b+i]);
+
+    t0 = Clock::now();
+    for (unsigned i = 0; i < n && b+i < n_accel; ++i) {
+      const unsigned bad = check_image(model, &imgs[i*img_words], maps[i],
+                                       b+i, n_reports);
+      for (unsigned l = 0; l < N_LAYERS; ++l)
+        layer_bad[l] += (bad >> l) & 1;
+      n_bad += (bad != 0);
+      n_checked++;
+    }
+    t_accel += seconds_since(t0);
+  }
+
+  printf ("\n");
+  printf ("Golden: %u images in %.3f s (%.1f images/s), errors: %u (%4.2f%%)\n",
+      n_imgs, t_golden, n_imgs / t_golden, n_errors, float(n_errors)*100/n_imgs);
+  if (n_checked) {
+    printf ("Accelerator: %u images in %.3f s (%.2f images/s), %u mismatching\n",
+        n_checked, t_accel, n_checked / t_accel, n_bad);
+    for (unsigned l = 0; l < N_LAYERS; ++l)
+      printf ("  Layer %u: %u images differ\n", l+1, layer_bad[l]);
+  }
+  printf ("%s\n", n_bad ? "Tests failed!" : "Tests passed!");
+  return n_bad ? 1 : 0;
+}
@@ -4,6 +4,8 @@
 #include "Accel.h"
 #include "AccelSchedule.h"
 #include "AccelTest.h"
+#include "BitTensor.h"
+#include "BufferPool.h"
 #include "Dense.h"
 #include "ZipIO.h"
 #include "ParamIO.h"
@@ -33,8 +35,9 @@ int main(int argc, char** argv) {
 
   Word* wt      = new Word[wt_size];
   Word* kh      = new Word[kh_size];
-  Word* data_i  = (Word*) MEM_ALLOC( DMEM_WORDS * sizeof(Word) );
-  Word* data_o  = (Word*) MEM_ALLOC( N*So*So/WORD_SIZE * sizeof(Word) );
+  Word* data_i  = (Word*) dma_pool().acquire( DMEM_WORDS * sizeof(Word) );
+  BitTensor maps_i(data_i, M, Si, Si);
+  Word* data_o  = (Word*) dma_pool().acquire( N*So*So/WORD_SIZE * sizeof(Word) );
   if (!wt || !kh || !data_i || !data_o) {
     fprintf (stderr, "**** ERROR: Alloc failed in %s\n", __FILE__);
     return (-2);
@@ -57,7 +60,7 @@ int main(int argc, char** argv) {
     unsigned l_num = layer_is_conv(l) ? l-1 : l-L_CONV-1;
     std::string input_file = get_root_dir() + l_type + std::to_string(l_num) + "_maps.zip";
     unzip_to_array(input_file, input_maps);
-    set_bit_array(data_i, input_maps, M*Si*Si);
+    maps_i.from_floats(input_maps);
     delete[] input_maps;
   }
 
@@ -73,16 +76,16 @@ int main(int argc, char** argv) {
   set_bnorm_array(kh, k, h, l);
 
   // Load binary ref
-  Word* bin_ref = new Word[N*So*So/WORD_SIZE];
+  BitTensor bin_ref(N, So, So);
   if (layer_is_last(l)) {
-    bin_ref[0] = 3;
+    bin_ref.words()[0] = 3;
   } else {
     const float* output_maps = new float[N*So*So];
     std::string l_type = layer_is_conv(l) ? "/data/cpp_conv" : "/data/cpp_dense";
     unsigned l_num = layer_is_conv(l) ? l : l-L_CONV;
     std::string output_file = get_root_dir() + l_type + std::to_string(l_num) + "_maps.zip";
     unzip_to_array(output_file, output_maps);
-    set_bit_array(bin_ref, output_maps, N*So*So);
+    bin_ref.from_floats(output_maps);
     delete[] output_maps;
   }
 
@@ -90,7 +93,7 @@ int main(int argc, char** argv) {
   if (layer_is_conv(l)) {
     test_conv_layer(
         wt, kh, data_i, data_o,
-        NULL, bin_ref,
+        NULL, bin_ref.words(),
         M, N, Si,
         (l==1) ? 0 : 1,   // conv_mode
         pool_tab[l-1]     // max_pool
@@ -98,16 +101,15 @@ int main(int argc, char** argv) {
   } else {
     test_dense_layer(
         wt, kh, data_i, data_o,
-        bin_ref,
+        bin_ref.words(),
         M, N
       );
   }
 
   printf ("Tests passed!\n");
 
-  delete[] bin_ref;
-  MEM_FREE( data_o );
-  MEM_FREE( data_i );
+  dma_pool().release( data_o );
+  dma_pool().release( data_i );
   delete[] kh;
   delete[] wt;
   return 0;
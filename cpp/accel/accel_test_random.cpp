@@ -1,9 +1,15 @@
 #include <cstddef>
+#include <cstdlib>
+#include <chrono>
+#include <stdint.h>
+#include <vector>
 #include <hls_video.h>
 
 #include "Accel.h"
 #include "AccelSchedule.h"
+#include "AccelSw.h"
 #include "AccelTest.h"
+#include "BufferPool.h"
 
 // used to generate test data
 unsigned simple_hash(unsigned x) {
@@ -11,6 +17,22 @@ unsigned simple_hash(unsigned x) {
   return temp ^ (temp >> 2) ^ (temp >> 4) ^ (temp >> 6) & 1;
 }
 
+// A Word of test data, bit i is simple_hash(bit0 + i)
+Word simple_hash_word(unsigned bit0) {
+  uint64_t w = 0;
+  for (unsigned i = 0; i < WORD_SIZE; ++i)
+    w |= uint64_t(simple_hash(bit0 + i) & 1) << i;
+  return w;
+}
+
+// 64-bit mixing version of simple_hash for the differential cases
+uint64_t simple_hash64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
 //------------------------------------------------------------------------
 // Helper test function for the accelerator, random data
 //------------------------------------------------------------------------
@@ -23,15 +45,12 @@ void test_conv_layer_random(
 
   // Generate the input data
   assert (M*S*S <= DMEM_WORDS*WORD_SIZE);
-  Word* data_i = (Word*) MEM_ALLOC( DMEM_WORDS * sizeof(Word) );
-  for (unsigned m = 0; m < M; ++m) {
-    for (unsigned r = 0; r < S; ++r) {
-      for (unsigned c = 0; c < S; ++c) {
-        set_bit(data_i, m*S*S+r*S+c, simple_hash(m*S*S+r*S+c));
-  }  }  }
+  Word* data_i = (Word*) dma_pool().acquire( DMEM_WORDS * sizeof(Word) );
+  for (unsigned i = 0; i*WORD_SIZE < M*S*S; ++i)
+    data_i[i] = simple_hash_word(i*WORD_SIZE);
 
   assert (S*S <= DMEM_O_WORDS*WORD_SIZE);
-  Word* data_o = (Word*) MEM_ALLOC( DMEM_O_WORDS * sizeof(Word) );
+  Word* data_o = (Word*) dma_pool().acquire( DMEM_O_WORDS * sizeof(Word) );
 
   DB(2,
     printf ("*data*:\n");
@@ -47,9 +66,11 @@ void test_conv_layer_random(
   Word khword = kh[0];
   NormComp nc;  nc(15,0) = khword(15,0);
   Word bin_ref[S*S];
-  for (unsigned i = 0; i < S*S; ++i) {
-    Bit b = (conv_ref[i] < nc) ? -1 : 0;
-    set_bit(bin_ref, i, b);
+  for (unsigned i = 0; i*WORD_SIZE < S*S; ++i) {
+    uint64_t b = 0;
+    for (unsigned j = 0; j < WORD_SIZE && i*WORD_SIZE+j < S*S; ++j)
+      b |= uint64_t(conv_ref[i*WORD_SIZE+j] < nc) << j;
+    bin_ref[i] = b;
   }
 
   test_conv_layer(
@@ -57,24 +78,253 @@ void test_conv_layer_random(
       M, 1, S
     );
 
-  MEM_FREE( data_i );
-  MEM_FREE( data_o );
+  dma_pool().release( data_i );
+  dma_pool().release( data_o );
+}
+
+//------------------------------------------------------------------------
+// Differential test of the accelerator backends: random layers are
+// scheduled once and the schedule is run on top() and on top_sw(),
+// every dmem_o word must match. Each case draws its shape, params and
+// input from its own seed, so a failing case can be rerun alone.
+//------------------------------------------------------------------------
+struct CaseRng {
+  uint64_t seed;
+  uint64_t count;
+
+  CaseRng(uint64_t s) : seed(simple_hash64(s)), count(0) {}
+  uint64_t next() { return simple_hash64(seed + count++); }
+  unsigned below(unsigned n) { return next() % n; }
+};
+
+struct RandomLayer {
+  unsigned layer_type;
+  unsigned M, N, S;   // inputs, outputs, input width
+  unsigned pool;
+  unsigned norm_mode;
+  unsigned batch;     // outputs per schedule entry
+  unsigned dmem_mode;
+  unsigned density;   // input bits set: 0=25%, 1=50%, 2=75%
+};
+
+static const char* layer_type_names[] = { "conv1", "conv", "dense", "last" };
+
+// Draws a layer the accelerator can run in one schedule. Conv inputs
+// must fill whole phases, dense inputs whole words in every bank. Now
+// and then M is large enough to wrap the 12-bit conv sums.
+static RandomLayer random_layer(CaseRng& rng) {
+  RandomLayer L;
+  const unsigned t = rng.below(8);
+  L.layer_type = (t == 0) ? LAYER_CONV1 : (t <= 4) ? LAYER_CONV :
+                 (t <= 6) ? LAYER_DENSE : LAYER_LAST;
+  L.pool = 0;
+  L.norm_mode = 1;
+
+  unsigned max_batch;
+  if (L.layer_type == LAYER_CONV1) {
+    L.M = 3;
+    L.S = 32;
+    L.N = 1 + rng.below(16);
+    max_batch = L.N;
+  } else if (L.layer_type == LAYER_CONV) {
+    L.S = 8 << rng.below(3);
+    const unsigned unit = CONVOLVERS*PIX_PER_PHASE / (L.S*L.S);
+    // inputs fit in dmem and bin_conv counts phases in 10 bits
+    unsigned max_units = DMEM_WORDS*WORD_SIZE / (L.S*L.S) / unit;
+    if (max_units*unit / CONVOLVERS > 1023)
+      max_units = 1023*CONVOLVERS / unit;
+    L.M = unit * (1 + rng.below(rng.below(16) == 0 ? max_units : 4));
+    L.pool = rng.below(2);
+    L.norm_mode = L.pool + 1;
+    if (!L.pool && rng.below(16) == 0)
+      L.norm_mode = 0;
+    L.N = L.pool ? 4*(1 + rng.below(4)) : 1 + rng.below(16);
+    max_batch = WT_WORDS*CONV_W_PER_WORD / L.M;
+  } else {
+    L.S = 1;
+    L.M = CONVOLVERS*WORD_SIZE * (1 + rng.below(rng.below(16) == 0 ? 64 : 8));
+    L.N = (L.layer_type == LAYER_LAST) ? 10 : 1 + rng.below(256);
+    max_batch = WT_WORDS*WORD_SIZE / L.M;
+  }
+  if (max_batch > KH_WORDS*KH_PER_WORD / 2)
+    max_batch = KH_WORDS*KH_PER_WORD / 2;
+
+  // any divisor of N that fits, pooling needs groups of 4 outputs and
+  // the last layer all 10
+  std::vector<unsigned> sizes;
+  for (unsigned b = 1; b <= L.N && b <= max_batch; ++b) {
+    if (L.N % b == 0 && (L.norm_mode != 2 || b % 4 == 0))
+      sizes.push_back(b);
+  }
+  L.batch = (L.layer_type == LAYER_LAST) ? L.N : sizes[rng.below(sizes.size())];
+  L.dmem_mode = rng.below(2);
+  L.density = rng.below(3);
+  return L;
+}
+
+static unsigned case_input_words(const RandomLayer& L) {
+  if (L.layer_type == LAYER_CONV1)
+    return L.S*L.S;
+  if (L.layer_type == LAYER_CONV)
+    return L.M*L.S*L.S / WORD_SIZE;
+  return L.M / WORD_SIZE;
+}
+
+// width of the output maps, 1 for dense layers
+static unsigned case_output_width(const RandomLayer& L) {
+  if (L.layer_type > LAYER_CONV)
+    return 1;
+  return L.pool ? L.S/2 : L.S;
+}
+
+static unsigned case_output_words(const RandomLayer& L) {
+  if (L.layer_type == LAYER_LAST)
+    return 1;
+  const unsigned So = case_output_width(L);
+  return (L.N*So*So + WORD_SIZE-1) / WORD_SIZE;
+}
+
+static void print_case(unsigned i, uint64_t seed, const RandomLayer& L) {
+  printf ("  Case %u (seed %llu): %s M=%u N=%u S=%u norm_mode=%u batch=%u dmem_mode=%u\n",
+      i, (unsigned long long)seed, layer_type_names[L.layer_type], L.M, L.N,
+      L.S, L.norm_mode, L.batch, L.dmem_mode);
+}
+
+//------------------------------------------------------------------------
+// Runs one case on both backends. Returns the number of differing words,
+// the first one is reported with its output map, row and column.
+//------------------------------------------------------------------------
+static unsigned run_case(unsigned i, uint64_t seed, const RandomLayer& L,
+                         CaseRng& rng, Word* data_i, Word* data_hls,
+                         Word* data_sw) {
+  // params, thresholds near the middle of the range of the sums
+  const unsigned n_filters = (L.layer_type <= LAYER_CONV) ? L.M*L.N : 0;
+  const unsigned wt_words = n_filters ? WTS_TO_WORDS(n_filters) + CONVOLVERS*CONV_W_PER_WORD
+                                      : L.M*L.N / WORD_SIZE;
+  const unsigned n_kh = (L.layer_type == LAYER_LAST) ? 2*L.N : L.N;
+  std::vector<Word> wt(wt_words), kh((n_kh + KH_PER_WORD-1) / KH_PER_WORD + 1);
+  for (unsigned j = 0; j < wt.size(); ++j)
+    wt[j] = rng.next();
+
+  const unsigned fan_in = (L.layer_type == LAYER_CONV) ? K*K*L.M : L.M;
+  unsigned spread = 1;
+  while (spread*spread < fan_in)
+    spread++;
+  for (unsigned n = 0; n < n_kh; ++n) {
+    int v = (int16_t)rng.next();
+    if (L.layer_type == LAYER_CONV || L.layer_type == LAYER_DENSE)
+      v = (int)rng.below(4*spread + 1) - 2*(int)spread;
+    Word w = kh[n/KH_PER_WORD];
+    const unsigned off = n % KH_PER_WORD;
+    w((off+1)*16-1, off*16) = v;
+    kh[n/KH_PER_WORD] = w;
+  }
+
+  const unsigned in_words = case_input_words(L);
+  for (unsigned j = 0; j < in_words; ++j) {
+    const uint64_t a = rng.next(), b = rng.next();
+    data_i[j] = (L.layer_type == LAYER_CONV1 || L.density == 1) ? a :
+                (L.density == 0) ? (a & b) : (a | b);
+  }
+
+  // one schedule for both backends
+  AccelSchedule sched;
+  ap_uint<3> layer_mode = 0;
+  layer_mode(2,1) = L.layer_type;
+  sched.resize(L.N / L.batch);
+  for (unsigned idx = 0; idx < sched.size(); ++idx) {
+    layer_mode[0] = (idx == 0) ? 1 : 0;
+    sched[idx].n_inputs = L.M;
+    sched[idx].n_outputs = L.batch;
+    sched[idx].layer_mode = layer_mode;
+    sched[idx].width_mode = (L.layer_type <= LAYER_CONV) ? L.S >> 4 : 0;
+    sched[idx].norm_mode = L.norm_mode;
+    load_accel_schedule_entry(&wt[0], &kh[0], L.layer_type, sched, idx);
+  }
+
+  // timers and traces are labeled with the closest layer of the network
+  const unsigned out_words = case_output_words(L);
+  const unsigned layer_idx = layer_of_type(L.layer_type, L.M, L.S, L.pool);
+  run_accel_schedule(data_i, data_hls, layer_idx, in_words, out_words, L.dmem_mode, sched);
+  run_accel_schedule(data_i, data_sw, layer_idx, in_words, out_words, L.dmem_mode, sched, top_sw);
+
+  unsigned n_diff = 0, first = 0;
+  for (unsigned j = 0; j < out_words; ++j) {
+    if (data_hls[j] != data_sw[j] && n_diff++ == 0)
+      first = j;
+  }
+  if (n_diff) {
+    const uint64_t got = data_sw[first].to_uint64();
+    const uint64_t exp = data_hls[first].to_uint64();
+    const unsigned So = case_output_width(L);
+    const unsigned k = first*WORD_SIZE + __builtin_ctzll(got ^ exp);
+    print_case(i, seed, L);
+    printf ("  %u of %u words differ, first at word %u (output %u, row %u, col %u): "
+            "top_sw %016llx != top %016llx\n",
+        n_diff, out_words, first, k / (So*So), (k % (So*So)) / So, k % So,
+        (unsigned long long)got, (unsigned long long)exp);
+  }
+  return n_diff;
+}
+
+static int run_differential(unsigned n_cases, uint64_t seed) {
+  printf ("## Comparing top_sw with top on %u random layers, seed %llu ##\n",
+      n_cases, (unsigned long long)seed);
+
+  Word* data_i = (Word*) dma_pool().acquire( DMEM_WORDS * sizeof(Word) );
+  Word* data_hls = (Word*) dma_pool().acquire( DMEM_WORDS * sizeof(Word) );
+  Word* data_sw = (Word*) dma_pool().acquire( DMEM_WORDS * sizeof(Word) );
+
+  unsigned n_type[4] = {0};
+  unsigned n_bad = 0;
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < n_cases && n_bad == 0; ++i) {
+    CaseRng rng(seed + i);
+    const RandomLayer L = random_layer(rng);
+    n_type[L.layer_type]++;
+    if (run_case(i, seed + i, L, rng, data_i, data_hls, data_sw)) {
+      n_bad++;
+      printf ("  Rerun with: accel_test_random.exe 1 %llu\n",
+          (unsigned long long)(seed + i));
+    }
+    if ((i+1) % 10000 == 0)
+      printf ("  %u cases\n", i+1);
+  }
+  const float t = std::chrono::duration<float>(
+      std::chrono::steady_clock::now() - t0).count();
+
+  dma_pool().release( data_i );
+  dma_pool().release( data_hls );
+  dma_pool().release( data_sw );
+
+  unsigned n_run = 0;
+  for (unsigned j = 0; j < 4; ++j) {
+    printf ("  %-5s: %u cases\n", layer_type_names[j], n_type[j]);
+    n_run += n_type[j];
+  }
+  printf ("%u cases in %.3f s (%.1f cases/s)\n", n_run, t, n_run / t);
+  printf ("%s\n", n_bad ? "Tests failed!" : "Tests passed!");
+  return n_bad ? 1 : 0;
 }
 
 //------------------------------------------------------------------------
 // Main
+//   accel_test_random.exe                      fixed conv tests
+//   accel_test_random.exe <n_cases> [<seed>]   differential test
 //------------------------------------------------------------------------
-int main() {
+int main(int argc, char** argv) {
+  if (argc > 1)
+    return run_differential(strtoul(argv[1], NULL, 0),
+                            (argc > 2) ? strtoull(argv[2], NULL, 0) : 1);
+
   const unsigned N = 1;
 
   Word* wt = new Word[WT_WORDS];
   Word* kh = new Word[KH_WORDS];
 
   // initialize the kernel weights
-  for (unsigned m = 0; m < WT_WORDS; ++m) {
-    for (unsigned i = 0; i < WORD_SIZE; ++i)
-      set_bit(wt, m*WORD_SIZE+i, simple_hash(m*WORD_SIZE+i));
-  }
+  for (unsigned m = 0; m < WT_WORDS; ++m)
+    wt[m] = simple_hash_word(m*WORD_SIZE);
   // initialize the batch-norm params
   for (unsigned n = 0; n < N; ++n) {
     NormComp nc = 10 + 10*n;
@@ -0,0 +1,140 @@
+#include <cstddef>
+#include <cstdlib>
+#include <chrono>
+#include <stdint.h>
+
+#include "Accel.h"
+#include "AccelSchedule.h"
+#include "AccelTest.h"
+#include "WeightPack.h"
+
+//------------------------------------------------------------------------
+// Differential test and timing of the native weight repackers in
+// WeightPack.h against the ap_int load_*_weights functions. Uses random
+// packed weight arrays with the shapes of all 9 layers, every batch of
+// their schedules plus random (offset, batch size) pairs.
+//------------------------------------------------------------------------
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t rand64() {
+  return (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ uint64_t(rand());
+}
+
+// Runs the old and the new repacker of a layer type on one batch and
+// compares all WT_WORDS output words, unwritten words included
+static bool check_batch(Word* wt, unsigned layer_type, unsigned o,
+                        unsigned n_in, unsigned n_out, unsigned layer_idx) {
+  static Word ref[WT_WORDS], out[WT_WORDS];
+  for (unsigned i = 0; i < WT_WORDS; ++i) {
+    ref[i] = 0;
+    out[i] = 0;
+  }
+
+  if (layer_type == LAYER_CONV1) {
+    load_conv1_weights(wt, ref, o, n_out);
+    repack_conv1_weights(wt, out, o, n_out);
+  } else if (layer_type == LAYER_CONV) {
+    load_conv_weights(wt, ref, o, n_in, n_out);
+    repack_conv_weights(wt, out, o, n_in, n_out);
+  } else {
+    load_dense_weights(wt, ref, o, n_in, n_out);
+    repack_dense_weights(wt, out, o, n_in, n_out);
+  }
+
+  for (unsigned i = 0; i < WT_WORDS; ++i) {
+    if (ref[i] != out[i]) {
+      printf ("Layer %u, o=%u, n_out=%u: word %u differs\n", layer_idx, o, n_out, i);
+      printf ("  load_*   %016llx\n", (unsigned long long)ref[i].to_uint64());
+      printf ("  repack_* %016llx\n", (unsigned long long)out[i].to_uint64());
+      return false;
+    }
+  }
+  return true;
+}
+
+// Repacks every batch of a schedule with the old or the new functions
+static void repack_all(Word* wt, AccelSchedule& s, unsigned layer_type, bool native) {
+  for (unsigned i = 0; i < s.size(); ++i) {
+    const unsigned n_in = s[i].n_inputs;
+    const unsigned n_out = s[i].n_outputs;
+    const unsigned o = i * n_out;
+    if (layer_type == LAYER_CONV1)
+      native ? repack_conv1_weights(wt, s[i].wt, o, n_out)
+             : load_conv1_weights(wt, s[i].wt, o, n_out);
+    else if (layer_type == LAYER_CONV)
+      native ? repack_conv_weights(wt, s[i].wt, o, n_in, n_out)
+             : load_conv_weights(wt, s[i].wt, o, n_in, n_out);
+    else
+      native ? repack_dense_weights(wt, s[i].wt, o, n_in, n_out)
+             : load_dense_weights(wt, s[i].wt, o, n_in, n_out);
+  }
+}
+
+int main(int argc, char** argv) {
+  const unsigned n_random = (argc > 1) ? std::stoi(argv[1]) : 1000;
+  const unsigned n_reps = (argc > 2) ? std::stoi(argv[2]) : 3;
+  srand(1);
+
+  Word* wt[N_LAYERS];
+  AccelSchedule sched[N_LAYERS];
+  unsigned n_errors = 0;
+  unsigned n_checked = 0;
+
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    const unsigned M = M_tab[l];
+    const unsigned N = N_tab[l];
+    const unsigned T = T_tab[l];
+    // spare words: conv batches read whole groups of filters, past
+    // the end of the layer for the random ones below
+    const unsigned words = (layer_is_conv(l+1) ? WTS_TO_WORDS(M*N) : M*N/WORD_SIZE)
+                         + 2*CONVOLVERS;
+    wt[l] = new Word[words];
+    for (unsigned i = 0; i < words; ++i)
+      wt[l][i] = rand64();
+
+    plan_accel_schedule(M, N, S_tab[l], T, pool_tab[l], sched[l]);
+
+    // every batch of the real schedule
+    for (unsigned i = 0; i < sched[l].size(); ++i, ++n_checked) {
+      const unsigned n_out = sched[l][i].n_outputs;
+      n_errors += !check_batch(wt[l], T, i*n_out, M, n_out, l+1);
+    }
+  }
+
+  // random batch offsets and sizes within each layer
+  for (unsigned r = 0; r < n_random; ++r, ++n_checked) {
+    const unsigned l = rand() % N_LAYERS;
+    const unsigned M = M_tab[l];
+    const unsigned N = N_tab[l];
+    const unsigned max_out = sched[l][0].n_outputs;
+    const unsigned n_out = 1 + rand() % max_out;
+    const unsigned o = rand() % (N - n_out + 1);
+    n_errors += !check_batch(wt[l], T_tab[l], o, M, n_out, l+1);
+  }
+
+  printf ("Checked %u batches, %u mismatches\n", n_checked, n_errors);
+
+  // time each layer's repacking both ways
+  float total[2] = {0, 0};
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    // alternate the two so that neither gets all the warm caches
+    float secs[2] = {0, 0};
+    for (unsigned rep = 0; rep < n_reps; ++rep) {
+      for (unsigned native = 0; native < 2; ++native) {
+        Clock::time_point t0 = Clock::now();
+        repack_all(wt[l], sched[l], T_tab[l], native);
+        secs[native] += std::chrono::duration<float>(Clock::now() - t0).count() / n_reps;
+      }
+    }
+    total[0] += secs[0];
+    total[1] += secs[1];
+    printf ("  Layer %u: load_* %8.3f ms, repack_* %8.3f ms (%.1fx)\n",
+        l+1, secs[0]*1e3, secs[1]*1e3, secs[0] / secs[1]);
+  }
+  printf ("All layers: load_* %.3f ms, repack_* %.3f ms (%.1fx)\n",
+      total[0]*1e3, total[1]*1e3, total[0] / total[1]);
+
+  for (unsigned l = 0; l < N_LAYERS; ++l)
+    delete[] wt[l];
+  return n_errors ? 1 : 0;
+}
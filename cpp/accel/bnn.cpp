@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "bnn.h"
+#include "BnnModel.h"
+#include "BufferPool.h"
+#include "Trace.h"
+
+static const unsigned IMG_SIZE = 3*32*32;
+// images per predict_batch call, bounds the input buffers of a context
+static const unsigned MAX_BATCH = 64;
+
+// top() keeps its state in statics, only one image may be in flight
+static std::mutex accel_mutex;
+
+struct bnn_ctx {
+  BnnModel model;
+  // conv1 input buffers, grown on demand up to MAX_BATCH
+  std::vector<Word*> img_i;
+
+  bnn_ctx(Params* params, PackedParams* packed)
+    : model(params, packed) {}
+
+  // Makes room for [n] images, returns how many buffers there are. A
+  // failed allocation leaves the buffers that exist, at least one.
+  unsigned reserve(unsigned n) {
+    while (img_i.size() < n) {
+      Word* buf = (Word*) dma_pool().acquire( DMEM_WORDS * sizeof(Word) );
+      if (buf == NULL)
+        break;
+      img_i.push_back(buf);
+    }
+    return img_i.size();
+  }
+};
+
+bnn_ctx* bnn_load(const char* path) {
+  if (path == NULL)
+    return NULL;
+  // the tools exit on a missing or corrupt archive, a library caller
+  // gets an error instead
+  Params* params = NULL;
+  PackedParams* packed = NULL;
+  bool ok = false;
+  if (PackedParams::is_packed(path)) {
+    packed = new PackedParams();
+    ok = packed->load(path);
+  } else {
+    params = new Params();
+    ok = params->load(path);
+  }
+  if (!ok || !BnnModel::check_archive(params, packed)) {
+    fprintf(stderr, "bnn_load: cannot load %s\n", path);
+    delete params;
+    delete packed;
+    return NULL;
+  }
+
+  bnn_ctx* ctx = new bnn_ctx(params, packed);
+  ctx->model.read_env();
+  // pinning is left to the caller, its threads run the inference
+  if (getenv("BNN_LOW_JITTER"))
+    ctx->model.lock_resident();
+  if (ctx->reserve(1) == 0) {
+    fprintf(stderr, "bnn_load: alloc failed\n");
+    delete ctx;
+    return NULL;
+  }
+  return ctx;
+}
+
+int bnn_infer(bnn_ctx* ctx, const float* img, int* out) {
+  return bnn_infer_batch(ctx, img, 1, out);
+}
+
+int bnn_infer_batch(bnn_ctx* ctx, const float* imgs, unsigned n, int* out) {
+  if (ctx == NULL || imgs == NULL || out == NULL)
+    return -1;
+
+  std::lock_guard<std::mutex> lock(accel_mutex);
+  // without work to share one buffer will do
+  const unsigned max_batch = ctx->model.batch_shares_work() ?
+      ctx->reserve(std::min(n, MAX_BATCH)) : 1;
+
+  for (unsigned i = 0; i < n; i += max_batch) {
+    const unsigned B = std::min(n - i, max_batch);
+    {
+      TraceScope t("binarize", "host");
+      t.arg("image", i);
+      t.arg("images", B);
+      for (unsigned b = 0; b < B; ++b)
+        binarize_input_images(ctx->img_i[b], imgs + (i+b)*IMG_SIZE, 32);
+    }
+    if (B == 1)
+      out[i] = ctx->model.predict(ctx->img_i[0]);
+    else
+      ctx->model.predict_batch(&ctx->img_i[0], B, out + i);
+  }
+  return 0;
+}
+
+void bnn_free(bnn_ctx* ctx) {
+  if (ctx == NULL)
+    return;
+  for (unsigned b = 0; b < ctx->img_i.size(); ++b)
+    dma_pool().release(ctx->img_i[b]);
+  delete ctx;
+}
@@ -0,0 +1,45 @@
+/*------------------------------------------------------------------------
+ * C API of libbnn.so: load the CIFAR-10 BNN once and run inference from
+ * any C or C++ program.
+ *
+ * Images are 3x32x32 floats in [-1,1], planar RGB (the layout of the
+ * test set archives). Input buffers stay owned by the caller and are
+ * read in place; they are binarized straight into the accelerator's
+ * DMA buffer without an intermediate copy.
+ *
+ * The accelerator is a single device, calls on any context are
+ * serialized internally. The BNN_* environment flags of accel_test_bnn
+ * (CPU layers, result cache and memos, see BnnModel.h) are honored.
+ *----------------------------------------------------------------------*/
+#ifndef ACCEL_BNN_H
+#define ACCEL_BNN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bnn_ctx bnn_ctx;
+
+/* Loads and packs the parameter archive at [path] (float zip or packed).
+ * Returns NULL if it is missing, corrupt or has the wrong shapes */
+bnn_ctx* bnn_load(const char* path);
+
+/* Classifies one image, writes the class index to [out].
+ * Returns 0 on success, -1 on bad arguments */
+int bnn_infer(bnn_ctx* ctx, const float* img, int* out);
+
+/* Classifies [n] images stored back to back at [imgs], writes n class
+ * indices to [out]. With BNN_DENSE_LAYER_CPU the dense layers run once
+ * per group of up to 64 images (BnnModel::predict_batch), otherwise
+ * this is the same as n calls of bnn_infer. Returns 0 on success, -1
+ * on bad arguments */
+int bnn_infer_batch(bnn_ctx* ctx, const float* imgs, unsigned n, int* out);
+
+/* Releases the context and all its buffers */
+void bnn_free(bnn_ctx* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
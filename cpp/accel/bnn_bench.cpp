@@ -0,0 +1,347 @@
+//------------------------------------------------------------------------
+// End-to-end benchmark on the accel_test_bnn flow. Builds the model,
+// runs the images [start, start+n) repeat times and writes the results
+// as JSON (see BenchReport.h):
+//
+//   bnn_bench.exe [options]
+//     -n, --images <n>       images per run (100)
+//     -s, --start <i>        index of the first image (0)
+//     -b, --batch <n>        images binarized and run per batch (1),
+//                            see below
+//     -t, --threads <n>      threads for startup, binarization and the
+//                            golden backend (BNN_THREADS)
+//     -B, --backend <name>   hls: the HLS model top()
+//                            sw: the software backend top_sw()
+//                            golden: GoldenModel on the CPU
+//     -p, --placement <p>    accel: all layers on the backend
+//                            dense: dense and last layers on the CPU
+//                            last: last layer on the CPU
+//     -r, --repeat <n>       measured runs, one sample each (3)
+//     -w, --warmup <n>       images run before the measured runs (1)
+//     -o, --out <file>       JSON output, "-" for stdout (bnn_bench.json),
+//                            the progress output then goes to stderr
+//
+// A batch is binarized on all threads, then the golden backend runs it
+// on all threads, and with the dense layers on the CPU (-p dense or
+// BNN_DENSE_LAYER_CPU) it goes through BnnModel::predict_batch, which
+// runs the dense layers once for the whole batch. Otherwise the
+// accelerator backends run one image at a time (their state is static).
+// The latency of an image runs from the start of its batch to its
+// prediction, so it includes binarizing the batch. Per-layer times come from every Timer
+// that ran during a measured run, with BNN_PERF=1 also their IPC and
+// CPU counters per image. Other BNN_* flags apply as in accel_test_bnn.
+//------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "AccelSw.h"
+#include "AccelTest.h"
+#include "BenchReport.h"
+#include "BnnModel.h"
+#include "GoldenModel.h"
+#include "LatencyStats.h"
+#include "MemTrack.h"
+#include "ParallelFor.h"
+#include "PerfCounters.h"
+#include "DataIO.h"
+#include "Common.h"
+#include "Timer.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static float seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<float>(Clock::now() - t0).count();
+}
+
+static float megabytes(size_t bytes) {
+  return bytes / float(1 << 20);
+}
+
+struct BenchConfig {
+  unsigned n_imgs;
+  unsigned start;
+  unsigned batch;
+  unsigned threads;
+  std::string backend;
+  std::string placement;
+  unsigned repeat;
+  unsigned warmup;
+  std::string out;
+
+  BenchConfig() : n_imgs(100), start(0), batch(1), threads(default_threads()),
+                  backend("hls"), placement("accel"), repeat(3), warmup(1),
+                  out("bnn_bench.json") {}
+};
+
+// Calls, seconds and perf counters of every live timer
+struct TimerSnapshot {
+  std::vector<std::string> names;
+  std::vector<unsigned> calls;
+  std::vector<float> secs;
+  std::vector<double> perf;     // N_PERF_EVENTS per timer
+
+  void take() {
+    names.clear(); calls.clear(); secs.clear(); perf.clear();
+    for (Timer* t = Timer::first(); t; t = t->next()) {
+      names.push_back(t->get_name());
+      calls.push_back(t->get_calls());
+      secs.push_back(t->get_time());
+      for (unsigned e = 0; e < N_PERF_EVENTS; ++e)
+        perf.push_back(t->get_perf(e));
+    }
+  }
+};
+
+//------------------------------------------------------------------------
+// One measured run over images [0, n) of X. Returns the number of
+// errors, the image latencies go to [latency].
+//------------------------------------------------------------------------
+static unsigned run_images(const BenchConfig& cfg, BnnModel& model,
+                           const GoldenModel* golden, const float* X,
+                           const Cifar10TestLabels& y, unsigned n,
+                           LatencyStats& latency) {
+  const unsigned img_words = S_tab[0]*S_tab[0];
+  std::vector<Word> imgs(cfg.batch*img_words);
+  std::vector<GoldenModel::Maps> maps(golden ? cfg.batch : 0);
+  std::vector<Word*> img_ptrs(cfg.batch);
+  std::vector<int> predictions(cfg.batch);
+  for (unsigned i = 0; i < cfg.batch; ++i)
+    img_ptrs[i] = &imgs[i*img_words];
+  unsigned n_errors = 0;
+
+  for (unsigned b = 0; b < n; b += cfg.batch) {
+    const unsigned nb = (n - b < cfg.batch) ? n - b : cfg.batch;
+    Clock::time_point t0 = Clock::now();
+    parallel_for(nb, cfg.threads, [&](unsigned i) {
+      binarize_input_images(&imgs[i*img_words], X + (b+i)*3*img_words, S_tab[0]);
+    });
+
+    if (golden) {
+      golden->run_batch(&imgs[0], nb, &maps[0], cfg.threads);
+      const float us = seconds_since(t0) * 1e6;
+      for (unsigned i = 0; i < nb; ++i) {
+        latency.add(us);
+        n_errors += (maps[i].prediction != y.data[b+i]);
+      }
+    } else if (model.batch_shares_work()) {
+      model.predict_batch(&img_ptrs[0], nb, &predictions[0]);
+      const float us = seconds_since(t0) * 1e6;
+      for (unsigned i = 0; i < nb; ++i) {
+        latency.add(us);
+        n_errors += (predictions[i] != y.data[b+i]);
+      }
+    } else {
+      for (unsigned i = 0; i < nb; ++i) {
+        const int prediction = model.predict(&imgs[i*img_words]);
+        latency.add(seconds_since(t0) * 1e6);
+        n_errors += (prediction != y.data[b+i]);
+      }
+    }
+  }
+  return n_errors;
+}
+
+static void usage(const char* exe) {
+  printf ("Usage: %s [-n images] [-s start] [-b batch] [-t threads]\n"
+          "       [-B hls|sw|golden] [-p accel|dense|last] [-r repeat]\n"
+          "       [-w warmup] [-o out.json]\n", exe);
+}
+
+int main(int argc, char** argv) {
+  BenchConfig cfg;
+  static const option long_opts[] = {
+    { "images",    required_argument, NULL, 'n' },
+    { "start",     required_argument, NULL, 's' },
+    { "batch",     required_argument, NULL, 'b' },
+    { "threads",   required_argument, NULL, 't' },
+    { "backend",   required_argument, NULL, 'B' },
+    { "placement", required_argument, NULL, 'p' },
+    { "repeat",    required_argument, NULL, 'r' },
+    { "warmup",    required_argument, NULL, 'w' },
+    { "out",       required_argument, NULL, 'o' },
+    { "help",      no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "n:s:b:t:B:p:r:w:o:h", long_opts, NULL)) != -1) {
+    switch (c) {
+      case 'n': cfg.n_imgs = std::stoi(optarg); break;
+      case 's': cfg.start = std::stoi(optarg); break;
+      case 'b': cfg.batch = std::stoi(optarg); break;
+      case 't': cfg.threads = std::stoi(optarg); break;
+      case 'B': cfg.backend = optarg; break;
+      case 'p': cfg.placement = optarg; break;
+      case 'r': cfg.repeat = std::stoi(optarg); break;
+      case 'w': cfg.warmup = std::stoi(optarg); break;
+      case 'o': cfg.out = optarg; break;
+      default: usage(argv[0]); return (c == 'h') ? 0 : -1;
+    }
+  }
+  if (cfg.backend != "hls" && cfg.backend != "sw" && cfg.backend != "golden") {
+    fprintf (stderr, "**** ERROR: unknown backend %s\n", cfg.backend.c_str());
+    return -1;
+  }
+  if (cfg.placement != "accel" && cfg.placement != "dense" && cfg.placement != "last") {
+    fprintf (stderr, "**** ERROR: unknown placement %s\n", cfg.placement.c_str());
+    return -1;
+  }
+  if (cfg.n_imgs == 0 || cfg.batch == 0 || cfg.repeat == 0 || cfg.threads == 0) {
+    fprintf (stderr, "**** ERROR: images, batch, repeat and threads must be > 0\n");
+    return -1;
+  }
+  if (cfg.warmup > cfg.n_imgs)
+    cfg.warmup = cfg.n_imgs;
+
+  // with the JSON on stdout, everything the model and the timers print
+  // goes to stderr instead, up to the timer reports at exit
+  FILE* json_out = NULL;
+  if (cfg.out == "-") {
+    json_out = fdopen(dup(1), "w");
+    dup2(2, 1);
+  }
+
+  BenchReport report("bnn_bench");
+
+  //--------------------------------------------------------------
+  // Startup
+  //--------------------------------------------------------------
+  printf ("## Loading input data ##\n");
+  Clock::time_point t0 = Clock::now();
+  Cifar10TestInputs X(cfg.n_imgs, cfg.start);
+  Cifar10TestLabels y(cfg.n_imgs, cfg.start);
+  const float data_s = seconds_since(t0);
+
+  printf ("## Loading parameters ##\n");
+  const std::string param_file = default_param_file();
+  BnnModel model(param_file, cfg.threads);
+  model.startup.print();
+
+  // the golden model unpacks its own copy of wt and kh, which must be
+  // done before BNN_COMPACT frees them in read_env()
+  GoldenModel* golden = NULL;
+  float golden_s = 0;
+  if (cfg.backend == "golden") {
+    t0 = Clock::now();
+    golden = new GoldenModel(model.wt, model.kh);
+    golden_s = seconds_since(t0);
+  }
+
+  model.read_env();
+  if (cfg.backend == "sw")
+    model.accel = top_sw;
+  else if (cfg.backend == "hls")
+    model.accel = top;
+  model.cpu_dense = model.cpu_dense || cfg.placement == "dense";
+  model.cpu_last = model.cpu_last || cfg.placement == "last";
+  const size_t rss_startup = resident_bytes();
+
+  report.set_config("images", cfg.n_imgs);
+  report.set_config("start", cfg.start);
+  report.set_config("batch", cfg.batch);
+  report.set_config("threads", cfg.threads);
+  report.set_config("backend", cfg.backend);
+  report.set_config("placement", cfg.placement);
+  report.set_config("cpu_dense", model.cpu_dense);
+  report.set_config("cpu_last", model.cpu_last);
+  report.set_config("delta", model.delta != NULL);
+  report.set_config("repeat", cfg.repeat);
+  report.set_config("warmup", cfg.warmup);
+  report.set_config("params", param_file);
+
+  report.add_sample("startup_s", data_s + model.startup.total() + golden_s, "s", false);
+  report.add_sample("startup.data_s", data_s, "s", false);
+  report.add_sample("startup.load_s", model.startup.load, "s", false);
+  report.add_sample("startup.pack_s", model.startup.pack, "s", false);
+  report.add_sample("startup.schedule_s", model.startup.schedule, "s", false);
+  if (golden)
+    report.add_sample("startup.golden_s", golden_s, "s", false);
+
+  //--------------------------------------------------------------
+  // Warmup and measured runs
+  //--------------------------------------------------------------
+  printf ("## Benchmarking %u images from image %u, batch %u, %u threads, "
+          "backend %s, placement %s ##\n", cfg.n_imgs, cfg.start, cfg.batch,
+      cfg.threads, cfg.backend.c_str(), cfg.placement.c_str());
+  if (cfg.warmup) {
+    LatencyStats ignored;
+    run_images(cfg, model, golden, X.data, y, cfg.warmup, ignored);
+  }
+
+  for (unsigned r = 0; r < cfg.repeat; ++r) {
+    TimerSnapshot before, after;
+    LatencyStats latency;
+    before.take();
+    t0 = Clock::now();
+    const unsigned n_errors = run_images(cfg, model, golden, X.data, y,
+                                         cfg.n_imgs, latency);
+    const float run_s = seconds_since(t0);
+    after.take();
+
+    report.add_sample("images_per_s", cfg.n_imgs / run_s, "images/s", true);
+    report.add_sample("latency_mean_us", latency.mean(), "us", false);
+    report.add_sample("latency_p50_us", latency.percentile(50), "us", false);
+    report.add_sample("latency_p99_us", latency.percentile(99), "us", false);
+    report.add_sample("error_rate_pct", 100.0 * n_errors / cfg.n_imgs, "%", false);
+
+    // timers are matched by name, a timer created during the run
+    // (function-local statics) counts from zero
+    for (unsigned i = 0; i < after.names.size(); ++i) {
+      unsigned calls = after.calls[i];
+      float secs = after.secs[i];
+      double perf[N_PERF_EVENTS];
+      for (unsigned e = 0; e < N_PERF_EVENTS; ++e)
+        perf[e] = after.perf[i*N_PERF_EVENTS + e];
+      for (unsigned j = 0; j < before.names.size(); ++j) {
+        if (before.names[j] == after.names[i]) {
+          calls -= before.calls[j];
+          secs -= before.secs[j];
+          for (unsigned e = 0; e < N_PERF_EVENTS; ++e)
+            perf[e] -= before.perf[j*N_PERF_EVENTS + e];
+          break;
+        }
+      }
+      if (calls == 0)
+        continue;
+      const std::string prefix = "layer." + after.names[i] + ".";
+      report.add_sample(prefix + "ms_per_image", 1e3 * secs / cfg.n_imgs,
+                        "ms", false);
+      for (unsigned e = 0; e < N_PERF_EVENTS; ++e)
+        if (perf_available(e))
+          report.add_sample(prefix + perf_event_name(e) + "_per_image",
+                            perf[e] / cfg.n_imgs,
+                            e == PERF_TASK_CLOCK ? "ns" : "count", false);
+      if (perf_available(PERF_CYCLES) && perf_available(PERF_INSTRUCTIONS) &&
+          perf[PERF_CYCLES] > 0)
+        report.add_sample(prefix + "ipc", perf[PERF_INSTRUCTIONS] / perf[PERF_CYCLES],
+                          "instr/cycle", true);
+    }
+
+    printf ("  run %u: %.2f images/s, p50 %.0f us, p99 %.0f us, %u errors\n",
+        r, cfg.n_imgs / run_s, latency.percentile(50), latency.percentile(99),
+        n_errors);
+  }
+
+  // the timer totals include the warmup images
+  perf_print_timers(cfg.n_imgs * cfg.repeat + cfg.warmup);
+  report.add_sample("rss_startup_mb", megabytes(rss_startup), "MB", false);
+  for (unsigned c = 0; c < N_MEM_CATEGORIES; ++c)
+    report.add_sample(std::string("mem.") + mem_category_name(MemCategory(c)) + "_mb",
+                      megabytes(mem_tagged_total(MemCategory(c))), "MB", false);
+  report.add_sample("peak_rss_mb", megabytes(peak_resident_bytes()), "MB", false);
+  delete golden;
+
+  const bool written = json_out ? report.write(json_out) : report.write(cfg.out);
+  if (!written) {
+    fprintf (stderr, "**** ERROR: cannot write %s\n", cfg.out.c_str());
+    return -1;
+  }
+  if (cfg.out != "-")
+    printf ("## Wrote %s ##\n", cfg.out.c_str());
+  return 0;
+}
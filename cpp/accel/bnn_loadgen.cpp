@@ -0,0 +1,139 @@
+//------------------------------------------------------------------------
+// Load generator for bnn_server. Opens [concurrency] connections, each
+// of which sends test images in a closed loop (one outstanding request
+// per connection), and reports throughput, client and server side tail
+// latency, the batch sizes the server formed and the prediction error.
+//------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "BnnProtocol.h"
+#include "DataIO.h"
+#include "LatencyStats.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct ClientResult {
+  LatencyStats client_latency;
+  LatencyStats server_latency;
+  unsigned long batch_total;
+  unsigned n_done;
+  unsigned n_errors;
+  unsigned n_failed;
+};
+
+static int connect_socket(const char* path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+  if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror(path);
+    exit(-1);
+  }
+  return fd;
+}
+
+static void run_client(const char* path, const Cifar10TestInputs* X,
+                       const Cifar10TestLabels* y, unsigned n_imgs,
+                       unsigned n_requests, std::atomic<unsigned>* next,
+                       ClientResult* res) {
+  int fd = connect_socket(path);
+  const unsigned IMG = BNN_IMG_PIXELS;
+
+  while (true) {
+    const unsigned i = (*next)++;
+    if (i >= n_requests)
+      break;
+    const unsigned img = i % n_imgs;
+
+    BnnRequestHeader hdr;
+    hdr.magic = BNN_REQUEST_MAGIC;
+    hdr.id = i;
+    hdr.format = BNN_PIX_F32_CHW;
+
+    Clock::time_point t0 = Clock::now();
+    BnnResponse rsp;
+    if (!write_full(fd, &hdr, sizeof(hdr)) ||
+        !write_full(fd, X->data + img*IMG, IMG*sizeof(float)) ||
+        !read_full(fd, &rsp, sizeof(rsp)) ||
+        rsp.magic != BNN_RESPONSE_MAGIC || rsp.id != i) {
+      res->n_failed++;
+      break;
+    }
+    Clock::time_point t1 = Clock::now();
+
+    res->client_latency.add(
+        std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count());
+    res->server_latency.add(rsp.latency_us);
+    res->batch_total += rsp.batch_size;
+    res->n_done++;
+    res->n_errors += (rsp.prediction != (int)y->data[img]);
+  }
+  close(fd);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    printf ("Usage: %s <socket path> <n requests> [concurrency] [n images]\n", argv[0]);
+    return 0;
+  }
+  const char* path = argv[1];
+  const unsigned n_requests = std::stoi(argv[2]);
+  const unsigned concurrency = (argc > 3) ? std::stoi(argv[3]) : 4;
+  const unsigned n_imgs = (argc > 4) ? std::stoi(argv[4]) : 100;
+  assert(concurrency > 0 && n_imgs > 0);
+
+  printf ("## Loading %u test images ##\n", n_imgs);
+  Cifar10TestInputs X(n_imgs);
+  Cifar10TestLabels y(n_imgs);
+
+  printf ("## Sending %u requests over %u connections ##\n", n_requests, concurrency);
+  std::atomic<unsigned> next(0);
+  std::vector<ClientResult> results(concurrency);
+  std::vector<std::thread> clients;
+
+  Clock::time_point start = Clock::now();
+  for (unsigned c = 0; c < concurrency; ++c) {
+    results[c] = ClientResult();
+    clients.push_back(std::thread(run_client, path, &X, &y, n_imgs,
+                                  n_requests, &next, &results[c]));
+  }
+  for (unsigned c = 0; c < concurrency; ++c)
+    clients[c].join();
+  const float secs = std::chrono::duration<float>(Clock::now() - start).count();
+
+  // merge per-connection results
+  ClientResult total = ClientResult();
+  for (unsigned c = 0; c < concurrency; ++c) {
+    total.client_latency.add(results[c].client_latency);
+    total.server_latency.add(results[c].server_latency);
+    total.batch_total += results[c].batch_total;
+    total.n_done += results[c].n_done;
+    total.n_errors += results[c].n_errors;
+    total.n_failed += results[c].n_failed;
+  }
+
+  printf ("\n");
+  printf ("Completed: %u requests (%u failed connections) in %.3f seconds\n",
+      total.n_done, total.n_failed, secs);
+  printf ("Throughput: %.2f images/sec\n", secs > 0 ? total.n_done / secs : 0.0f);
+  printf ("Mean batch size: %.2f\n",
+      total.n_done ? float(total.batch_total) / total.n_done : 0.0f);
+  printf ("Errors: %u (%4.2f%%)\n", total.n_errors,
+      total.n_done ? float(total.n_errors)*100/total.n_done : 0.0f);
+  total.client_latency.print("client latency");
+  total.server_latency.print("server latency");
+  return (total.n_failed == 0) ? 0 : 1;
+}
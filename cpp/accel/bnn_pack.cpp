@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+
+#include "BnnModel.h"
+#include "Common.h"
+
+//------------------------------------------------------------------------
+// Converts a float params archive into a packed archive (see
+// PackedParams in ParamIO.h), then loads both and checks that the
+// packed model has the same weights, kh params and schedules.
+//
+//   bnn_pack.exe [<in.zip> [<out.bnn>]]
+//
+// The defaults are params/cifar10_parameters_nb.zip and the same name
+// with a .bnn extension.
+//------------------------------------------------------------------------
+static size_t file_size(const std::string& f) {
+  struct stat st;
+  return stat(f.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+static unsigned count_diffs(const Word* a, const Word* b, unsigned n) {
+  unsigned diffs = 0;
+  for (unsigned i = 0; i < n; ++i)
+    diffs += (a[i] != b[i]);
+  return diffs;
+}
+
+int main(int argc, char** argv) {
+  const std::string in = (argc > 1) ? argv[1]
+      : get_root_dir() + "/params/cifar10_parameters_nb.zip";
+  std::string out = (argc > 2) ? argv[2] : in;
+  if (argc <= 2) {
+    const size_t dot = out.rfind('.');
+    out = out.substr(0, dot) + ".bnn";
+  }
+
+  if (PackedParams::is_packed(in)) {
+    fprintf (stderr, "%s is already packed\n", in.c_str());
+    return -1;
+  }
+
+  printf ("## Packing %s ##\n", in.c_str());
+  BnnModel model(in);
+  model.startup.print();
+  if (!model.save_packed(out)) {
+    fprintf (stderr, "**** ERROR: cannot write %s\n", out.c_str());
+    return -1;
+  }
+
+  printf ("## Loading %s ##\n", out.c_str());
+  BnnModel packed(out);
+  packed.startup.print();
+
+  unsigned diffs = 0;
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    diffs += count_diffs(model.wt[l], packed.wt[l], model.wt_words[l]);
+    diffs += count_diffs(model.kh[l], packed.kh[l], model.kh_words[l]);
+    for (unsigned i = 0; i < model.sched[l].size(); ++i) {
+      diffs += count_diffs(model.sched[l][i].wt, packed.sched[l][i].wt, WT_WORDS);
+      diffs += count_diffs(model.sched[l][i].kh, packed.sched[l][i].kh, KH_WORDS);
+    }
+  }
+
+  size_t float_bytes = 0;
+  for (unsigned i = 0; i < model.params->num_arrays(); ++i)
+    float_bytes += model.params->array_size(i);
+
+  const size_t in_bytes = file_size(in);
+  const size_t out_bytes = file_size(out);
+  printf ("Float params   %9lu bytes (%.1fx the packed archive)\n",
+      (unsigned long)float_bytes, float(float_bytes) / out_bytes);
+  printf ("Float archive  %9lu bytes, load+pack %.3f s\n",
+      (unsigned long)in_bytes, model.startup.load + model.startup.pack);
+  printf ("Packed archive %9lu bytes, load+pack %.3f s (%.1fx smaller, %.1fx faster)\n",
+      (unsigned long)out_bytes, packed.startup.load + packed.startup.pack,
+      float(in_bytes) / out_bytes,
+      (model.startup.load + model.startup.pack) /
+      (packed.startup.load + packed.startup.pack));
+  printf ("Mismatching words: %u\n", diffs);
+  return diffs ? 1 : 0;
+}
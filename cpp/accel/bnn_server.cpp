@@ -0,0 +1,321 @@
+//------------------------------------------------------------------------
+// Long-running inference server. Loads the model once, then accepts
+// images over a Unix domain socket (or stdin/stdout when the socket
+// path is "-") and runs them in dynamically sized batches: a batch is
+// started when [max batch] requests are queued or when the oldest
+// queued request has waited [max wait] microseconds. Only the CPU dense
+// layers share work between the images of a batch (see
+// BnnModel::predict_batch), without them a batch takes whatever is
+// queued and does not wait.
+// See BnnProtocol.h for the frame format.
+//------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Accel.h"
+#include "AccelTest.h"
+#include "BnnModel.h"
+#include "BnnProtocol.h"
+#include "BufferPool.h"
+#include "LatencyStats.h"
+#include "LowJitter.h"
+#include "MemTrack.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// One client: requests are read from in_fd, responses written to out_fd
+struct Connection {
+  int in_fd;
+  int out_fd;
+  std::mutex write_mutex;
+
+  Connection(int i, int o) : in_fd(i), out_fd(o) {}
+  ~Connection() {
+    close(in_fd);
+    if (out_fd != in_fd)
+      close(out_fd);
+  }
+};
+
+struct Request {
+  std::shared_ptr<Connection> conn;
+  uint32_t id;
+  Clock::time_point arrival;
+  std::vector<float> image;
+};
+
+static std::deque<Request> queue;
+static std::mutex queue_mutex;
+static std::condition_variable queue_cv;
+static bool readers_done = false;     // stdio mode: input reached EOF
+static volatile sig_atomic_t stop_flag = 0;
+
+static void handle_signal(int) {
+  stop_flag = 1;
+}
+
+// registry metrics of the queue and the batches
+static MetricGauge* m_queue_depth = metric_gauge("bnn_server_queue_depth",
+    "Requests waiting for a batch");
+static MetricCounter* m_requests = metric_counter("bnn_server_requests_total",
+    "Requests received");
+static MetricCounter* m_batches = metric_counter("bnn_server_batches_total",
+    "Batches run");
+static MetricHistogram* m_batch_size = metric_histogram("bnn_server_batch_size",
+    "Requests per batch", "", std::vector<double>{1, 2, 4, 8, 16, 32, 64});
+static MetricHistogram* m_latency = metric_histogram("bnn_server_latency_seconds",
+    "Time from the arrival of a request to its response");
+
+static void respond(const Request& r, int32_t prediction, unsigned batch_size) {
+  BnnResponse rsp;
+  rsp.magic = BNN_RESPONSE_MAGIC;
+  rsp.id = r.id;
+  rsp.prediction = prediction;
+  rsp.latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - r.arrival).count();
+  rsp.batch_size = batch_size;
+
+  std::lock_guard<std::mutex> lock(r.conn->write_mutex);
+  write_full(r.conn->out_fd, &rsp, sizeof(rsp));
+}
+
+// -----------------------------------------------------------------------
+// Reader: decode frames from one connection and queue them
+// -----------------------------------------------------------------------
+static void read_requests(std::shared_ptr<Connection> conn) {
+  std::vector<uint8_t> raw(BNN_IMG_PIXELS * sizeof(float));
+
+  while (true) {
+    BnnRequestHeader hdr;
+    if (!read_full(conn->in_fd, &hdr, sizeof(hdr)))
+      break;
+
+    Request r;
+    r.conn = conn;
+    r.id = hdr.id;
+    r.image.resize(BNN_IMG_PIXELS);
+
+    if (hdr.magic != BNN_REQUEST_MAGIC ||
+        (hdr.format != BNN_PIX_F32_CHW && hdr.format != BNN_PIX_U8_HWC)) {
+      // the stream can not be resynchronized, reject and drop the client
+      r.arrival = Clock::now();
+      respond(r, -1, 0);
+      break;
+    }
+    if (!read_full(conn->in_fd, raw.data(), BNN_IMG_PIXELS * bnn_pixel_bytes(hdr.format)))
+      break;
+    r.arrival = Clock::now();
+
+    if (hdr.format == BNN_PIX_U8_HWC)
+      bnn_u8_hwc_to_f32_chw(raw.data(), r.image.data());
+    else
+      memcpy(r.image.data(), raw.data(), BNN_IMG_PIXELS * sizeof(float));
+
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      queue.push_back(std::move(r));
+      m_queue_depth->set(queue.size());
+    }
+    m_requests->inc();
+    queue_cv.notify_one();
+  }
+}
+
+// -----------------------------------------------------------------------
+// Accept clients on the socket until a signal arrives
+// -----------------------------------------------------------------------
+static int open_socket(const char* path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    exit(-1);
+  }
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+  unlink(path);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+    perror(path);
+    exit(-1);
+  }
+  return fd;
+}
+
+static void accept_clients(int listen_fd) {
+  while (!stop_flag) {
+    pollfd p = { listen_fd, POLLIN, 0 };
+    if (poll(&p, 1, 200) <= 0)
+      continue;
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+      continue;
+    std::shared_ptr<Connection> conn(new Connection(fd, fd));
+    std::thread(read_requests, conn).detach();
+  }
+}
+
+// -----------------------------------------------------------------------
+// Batcher: the only thread that touches the model and the accelerator
+// -----------------------------------------------------------------------
+static void serve_batches(BnnModel& model, unsigned max_batch,
+                          unsigned max_wait_us, LatencyStats& latency,
+                          unsigned long& n_batches) {
+  trace_thread_name("batcher");
+  std::vector<Word*> img_i(max_batch);
+  for (unsigned b = 0; b < max_batch; ++b) {
+    img_i[b] = (Word*) dma_pool().acquire( DMEM_WORDS * sizeof(Word) );
+    if (!img_i[b]) {
+      fprintf (stderr, "**** ERROR: Alloc failed in %s\n", __FILE__);
+      exit(-2);
+    }
+  }
+
+  std::vector<Request> batch;
+  std::vector<int> predictions(max_batch);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      queue_cv.wait_for(lock, std::chrono::milliseconds(200), [&]{
+          return !queue.empty() || stop_flag || readers_done; });
+      if (queue.empty()) {
+        if (stop_flag || readers_done)
+          break;
+        continue;
+      }
+
+      // wait for a full batch or until the oldest request hits its deadline
+      const Clock::time_point deadline =
+          queue.front().arrival + std::chrono::microseconds(max_wait_us);
+      queue_cv.wait_until(lock, deadline, [&]{
+          return queue.size() >= max_batch || stop_flag || readers_done; });
+
+      batch.clear();
+      while (!queue.empty() && batch.size() < max_batch) {
+        batch.push_back(std::move(queue.front()));
+        queue.pop_front();
+      }
+      m_queue_depth->set(queue.size());
+    }
+
+    // binarize the whole batch, then run it
+    const unsigned B = batch.size();
+    {
+      TraceScope t("binarize", "host");
+      t.arg("images", B);
+      for (unsigned b = 0; b < B; ++b)
+        binarize_input_images(img_i[b], batch[b].image.data(), 32);
+    }
+
+    model.predict_batch(&img_i[0], B, &predictions[0]);
+    for (unsigned b = 0; b < B; ++b) {
+      respond(batch[b], predictions[b], B);
+      const float us = std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - batch[b].arrival).count();
+      latency.add(us);
+      m_latency->observe(us * 1e-6);
+    }
+    n_batches++;
+    m_batches->inc();
+    m_batch_size->observe(B);
+  }
+
+  for (unsigned b = 0; b < max_batch; ++b)
+    dma_pool().release(img_i[b]);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf ("Usage: %s <socket path | -> [max batch] [max wait usecs]\n", argv[0]);
+    return 0;
+  }
+  const bool use_stdio = std::string(argv[1]) == "-";
+  const unsigned max_batch = (argc > 2) ? std::stoi(argv[2]) : 8;
+  const unsigned max_wait_us = (argc > 3) ? std::stoi(argv[3]) : 2000;
+  assert(max_batch > 0);
+
+  // in stdio mode stdout carries the response frames, so everything the
+  // model and the timers print goes to stderr instead
+  int rsp_fd = 1;
+  if (use_stdio) {
+    rsp_fd = dup(1);
+    dup2(2, 1);
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
+  printf ("## Loading parameters ##\n");
+  mem_enable_phases();
+  BnnModel model(default_param_file());
+  model.read_env();
+  mem_report(name_tab, N_LAYERS);
+
+  const LowJitterConfig LJ = low_jitter_from_env();
+  if (LJ.enabled) {
+    const size_t locked = model.lock_resident();
+    printf ("## Low-jitter mode: %.1f MB locked, batcher on cpu %d, SCHED_FIFO %d ##\n",
+        locked / float(1 << 20), LJ.cpu(0), LJ.fifo_prio);
+  }
+
+  // waiting for a fuller batch only pays off if the batch shares work
+  unsigned wait_us = max_wait_us;
+  if (model.batch_shares_work())
+    printf ("## Dense layers run across each batch on the CPU ##\n");
+  else if (max_batch > 1 && max_wait_us > 0) {
+    printf ("## Batches share no work without BNN_DENSE_LAYER_CPU, max wait set to 0 ##\n");
+    wait_us = 0;
+  }
+
+  printf ("## Serving on %s, max batch %u, max wait %u us ##\n",
+      use_stdio ? "stdin/stdout" : argv[1], max_batch, wait_us);
+  fflush(stdout);
+
+  LatencyStats latency;
+  unsigned long n_batches = 0;
+  std::thread batcher(serve_batches, std::ref(model), max_batch, wait_us,
+                      std::ref(latency), std::ref(n_batches));
+  apply_low_jitter(LJ, 0, batcher.native_handle());
+
+  if (use_stdio) {
+    std::shared_ptr<Connection> conn(new Connection(0, rsp_fd));
+    read_requests(conn);
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      readers_done = true;
+    }
+    queue_cv.notify_all();
+  } else {
+    int listen_fd = open_socket(argv[1]);
+    accept_clients(listen_fd);
+    close(listen_fd);
+    unlink(argv[1]);
+    queue_cv.notify_all();
+  }
+  batcher.join();
+
+  printf ("\n## Served %u requests in %lu batches (%.2f per batch) ##\n",
+      latency.count(), n_batches,
+      n_batches ? float(latency.count()) / n_batches : 0.0f);
+  latency.print("server latency");
+  printf ("Total accel runtime = %10.4f seconds\n", total_time());
+  model.print_stats();
+  return 0;
+}
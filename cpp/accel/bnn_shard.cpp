@@ -0,0 +1,264 @@
+//------------------------------------------------------------------------
+// Sharded test set evaluation. Splits images [start, start+N) into P
+// contiguous shards, runs each in an accel_test_bnn worker process and
+// merges the shard reports (see BnnShardHeader) into one report with
+// the error rate and the aggregate throughput:
+//
+//   bnn_shard.exe <N> <P> [<start> [<predictions file>]]
+//
+// Workers find the coordinator through the Unix socket in their
+// BNN_SHARD_REPORT variable. With BNN_SHARD_EXTERNAL=1 no workers are
+// spawned, the commands are printed instead so that they can be run
+// elsewhere (e.g. on other hosts with the socket forwarded), and the
+// coordinator waits for P reports. Worker output goes to
+// <socket>.<shard>.log, BNN_THREADS defaults to 1 in each worker.
+//------------------------------------------------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "BnnProtocol.h"
+#include "DataIO.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Shard {
+  unsigned start, count;
+  pid_t pid;
+  bool reported;
+  BnnShardHeader hdr;
+};
+
+static int open_socket(const char* path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    exit(-1);
+  }
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+  unlink(path);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+    perror(path);
+    exit(-1);
+  }
+  return fd;
+}
+
+// accel_test_bnn.exe next to this executable
+static std::string worker_exe(const char* argv0) {
+  std::string dir(argv0);
+  const size_t slash = dir.rfind('/');
+  dir = (slash == std::string::npos) ? "." : dir.substr(0, slash);
+  return dir + "/accel_test_bnn.exe";
+}
+
+static pid_t spawn_worker(const std::string& exe, const Shard& s,
+                          const std::string& sock, unsigned k) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(-1);
+  }
+  if (pid > 0)
+    return pid;
+
+  const std::string log = sock + "." + std::to_string(k) + ".log";
+  int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0) {
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+  }
+  setenv("BNN_SHARD_REPORT", sock.c_str(), 1);
+  setenv("BNN_THREADS", "1", 0);
+  const std::string count = std::to_string(s.count);
+  const std::string start = std::to_string(s.start);
+  execl(exe.c_str(), exe.c_str(), count.c_str(), start.c_str(), (char*)NULL);
+  perror(exe.c_str());
+  _exit(127);
+}
+
+//------------------------------------------------------------------------
+// Reads one report, stores its predictions in [predictions] (indexed
+// from [start]). Returns the shard it belongs to or -1.
+//------------------------------------------------------------------------
+static int read_report(int fd, std::vector<Shard>& shards, unsigned start,
+                       std::vector<int>& predictions) {
+  BnnShardHeader hdr;
+  if (!read_full(fd, &hdr, sizeof(hdr)) || hdr.magic != BNN_SHARD_MAGIC) {
+    fprintf (stderr, "**** ERROR: malformed shard report\n");
+    return -1;
+  }
+  for (unsigned k = 0; k < shards.size(); ++k) {
+    Shard& s = shards[k];
+    if (s.start != hdr.start || s.count != hdr.count)
+      continue;
+    if (s.reported) {
+      fprintf (stderr, "**** ERROR: shard %u reported twice\n", k);
+      return -1;
+    }
+    std::vector<int8_t> p(hdr.count);
+    if (!read_full(fd, p.data(), p.size())) {
+      fprintf (stderr, "**** ERROR: truncated report of shard %u\n", k);
+      return -1;
+    }
+    for (unsigned i = 0; i < hdr.count; ++i)
+      predictions[s.start - start + i] = p[i];
+    s.hdr = hdr;
+    s.reported = true;
+    return k;
+  }
+  fprintf (stderr, "**** ERROR: report for unknown shard [%u, %u)\n",
+      hdr.start, hdr.start + hdr.count);
+  return -1;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    printf ("Usage: %s <n images> <n shards> [<start> [<predictions file>]]\n", argv[0]);
+    return 0;
+  }
+  const unsigned n_imgs = std::stoi(argv[1]);
+  const unsigned n_shards = std::stoi(argv[2]);
+  const unsigned start = (argc > 3) ? std::stoi(argv[3]) : 0;
+  const char* pred_file = (argc > 4) ? argv[4] : NULL;
+  const bool external = getenv("BNN_SHARD_EXTERNAL") && atoi(getenv("BNN_SHARD_EXTERNAL"));
+  if (n_shards == 0 || n_shards > n_imgs) {
+    fprintf (stderr, "**** ERROR: need 1 to %u shards\n", n_imgs);
+    return -1;
+  }
+
+  // contiguous shards, the first n_imgs % n_shards get one more image
+  std::vector<Shard> shards(n_shards);
+  for (unsigned k = 0, s = start; k < n_shards; ++k) {
+    shards[k].start = s;
+    shards[k].count = n_imgs / n_shards + (k < n_imgs % n_shards);
+    shards[k].pid = -1;
+    shards[k].reported = false;
+    s += shards[k].count;
+  }
+
+  const std::string sock = "/tmp/bnn_shard." + std::to_string(getpid()) + ".sock";
+  int listen_fd = open_socket(sock.c_str());
+  const std::string exe = worker_exe(argv[0]);
+
+  printf ("## Evaluating images %u to %u in %u shards ##\n",
+      start, start + n_imgs - 1, n_shards);
+  Clock::time_point t0 = Clock::now();
+  for (unsigned k = 0; k < n_shards; ++k) {
+    if (external)
+      printf ("BNN_SHARD_REPORT=%s %s %u %u\n", sock.c_str(), exe.c_str(),
+          shards[k].count, shards[k].start);
+    else
+      shards[k].pid = spawn_worker(exe, shards[k], sock, k);
+  }
+
+  //--------------------------------------------------------------
+  // Collect the reports, a worker that exits without reporting
+  // fails the run
+  //--------------------------------------------------------------
+  std::vector<int> predictions(n_imgs, -1);
+  unsigned n_reported = 0;
+  bool failed = false;
+  while (n_reported < n_shards && !failed) {
+    pollfd p = { listen_fd, POLLIN, 0 };
+    if (poll(&p, 1, 200) > 0) {
+      int fd = accept(listen_fd, NULL, NULL);
+      if (fd >= 0) {
+        const int k = read_report(fd, shards, start, predictions);
+        close(fd);
+        if (k < 0) {
+          failed = true;
+        } else {
+          n_reported++;
+          printf ("  shard %d done after %.1f s\n", k,
+              std::chrono::duration<float>(Clock::now() - t0).count());
+        }
+      }
+    }
+
+    int status;
+    pid_t pid;
+    while (!external && (pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      for (unsigned k = 0; k < n_shards; ++k) {
+        if (shards[k].pid != pid)
+          continue;
+        shards[k].pid = -1;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+          fprintf (stderr, "**** ERROR: worker of shard %u failed, see %s.%u.log\n",
+              k, sock.c_str(), k);
+          failed = true;
+        }
+      }
+    }
+  }
+  const float wall_s = std::chrono::duration<float>(Clock::now() - t0).count();
+  close(listen_fd);
+  unlink(sock.c_str());
+
+  for (unsigned k = 0; k < n_shards; ++k) {
+    if (shards[k].pid > 0) {
+      if (failed)
+        kill(shards[k].pid, SIGTERM);
+      waitpid(shards[k].pid, NULL, 0);
+    }
+  }
+  if (failed)
+    return -1;
+
+  //--------------------------------------------------------------
+  // Merge
+  //--------------------------------------------------------------
+  Cifar10TestLabels y(n_imgs, start);
+  unsigned n_errors = 0, worker_errors = 0;
+  float startup_s = 0, max_run_s = 0;
+  printf ("\n");
+  printf ("%5s %6s %6s %6s %9s %9s %9s %9s %9s\n", "shard", "start", "count",
+      "errors", "startup_s", "run_s", "images/s", "p50_us", "p99_us");
+  for (unsigned k = 0; k < n_shards; ++k) {
+    const BnnShardHeader& h = shards[k].hdr;
+    printf ("%5u %6u %6u %6u %9.3f %9.3f %9.2f %9.0f %9.0f\n", k, h.start,
+        h.count, h.n_errors, h.startup_s, h.run_s, h.count / h.run_s,
+        h.p50_us, h.p99_us);
+    worker_errors += h.n_errors;
+    startup_s = std::max(startup_s, h.startup_s);
+    max_run_s = std::max(max_run_s, h.run_s);
+  }
+  for (unsigned i = 0; i < n_imgs; ++i)
+    n_errors += (predictions[i] != y.data[i]);
+  if (n_errors != worker_errors)
+    fprintf (stderr, "**** WARNING: workers counted %u errors, merged predictions %u\n",
+        worker_errors, n_errors);
+
+  printf ("\n");
+  printf ("Errors: %u (%4.2f%%)\n", n_errors, float(n_errors)*100/n_imgs);
+  printf ("Aggregate: %u images in %.3f s wall (%.2f images/s), "
+          "%.2f images/s excluding startup\n",
+      n_imgs, wall_s, n_imgs / wall_s, n_imgs / max_run_s);
+
+  if (pred_file) {
+    FILE* f = fopen(pred_file, "w");
+    if (!f) {
+      perror(pred_file);
+      return -1;
+    }
+    for (unsigned i = 0; i < n_imgs; ++i)
+      fprintf (f, "%u %d %d\n", start + i, predictions[i], (int)y.data[i]);
+    fclose(f);
+  }
+  return 0;
+}
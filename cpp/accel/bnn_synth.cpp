@@ -0,0 +1,396 @@
+//------------------------------------------------------------------------
+// Synthetic model and test data, so that the drivers and benchmarks run
+// without the downloaded archives. Writes under <root> (default
+// CRAFT_BNN_ROOT) the same files and formats as get_params.sh and
+// get_data.sh:
+//
+//   params/cifar10_parameters_nb.zip   27 float arrays, the weights, k
+//                                      and h of layer l in arr_{widx,
+//                                      kidx,hidx}_tab[l-1]
+//   data/cifar10_test_inputs.zip       <n images> 3x32x32 images
+//   data/cifar10_test_labels.zip       the class the model predicts
+//   data/cpp_conv{1..6}_maps.zip       layer outputs of image 0 as
+//   data/cpp_dense{0..2}_maps.zip      +1/-1 floats (accel_test_layer)
+//
+//   bnn_synth.exe [-f] [-s <seed>] <n images> [<root>]
+//
+// Everything is a function of the seed. Weights are uniform in [-1,1],
+// images are smooth random fields in [-1,1] like the scaled CIFAR-10
+// inputs. Thresholds are drawn around the middle of each layer's sum
+// distribution (sqrt(fan-in) wide), higher for pooled layers, so about
+// half of the bits of every feature map are set; the densities are
+// printed at the end. The labels are the predictions of the golden
+// model, the error rate of a correct run is 0. The classes are permuted
+// so that image 0 is class 3 as accel_test_layer 9 expects.
+//
+// Existing archives are only overwritten with -f.
+//------------------------------------------------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Accel.h"
+#include "AccelTest.h"
+#include "GoldenModel.h"
+#include "ParallelFor.h"
+#include "BitPack.h"
+#include "ZipIO.h"
+#include "DataIO.h"
+#include "Common.h"
+
+const unsigned N_ARRAYS = 3*N_LAYERS;
+const unsigned N_CLASSES = 10;
+const unsigned IMG_SIZE = 3*32*32;
+// images run through the golden model at a time
+const unsigned CHUNK = 256;
+
+//------------------------------------------------------------------------
+// Deterministic random numbers, stream [id] of [seed]. Normals are the
+// Irwin-Hall sum of 4 uniforms so that no libm call is involved.
+//------------------------------------------------------------------------
+static uint64_t mix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+struct SynthRng {
+  uint64_t state;
+  uint64_t count;
+
+  SynthRng(uint64_t seed, uint64_t id) : state(mix64(seed ^ mix64(id))), count(0) {}
+  uint64_t next() { return mix64(state + count++); }
+  // uniform in [0,1)
+  float uniform() { return (next() >> 40) * (1.0f / (1 << 24)); }
+  float uniform(float lo, float hi) { return lo + (hi - lo) * uniform(); }
+  float normal() {
+    return (uniform() + uniform() + uniform() + uniform() - 2.0f) * 1.7320508f;
+  }
+};
+
+static float clamp(float x, float lo, float hi) {
+  return (x < lo) ? lo : (x > hi) ? hi : x;
+}
+
+//------------------------------------------------------------------------
+// Image i: per channel a 5x5 grid of random values (shared across the
+// channels for the most part) bilinearly upsampled to 32x32, plus noise
+//------------------------------------------------------------------------
+static void synth_image(float* img, uint64_t seed, unsigned i) {
+  const unsigned S = 32, G = 5;
+  SynthRng rng(seed, 1000000 + i);
+  float common[G*G];
+  for (unsigned g = 0; g < G*G; ++g)
+    common[g] = rng.uniform(-0.8f, 0.8f);
+
+  for (unsigned c = 0; c < 3; ++c) {
+    float grid[G*G];
+    for (unsigned g = 0; g < G*G; ++g)
+      grid[g] = common[g] + rng.uniform(-0.3f, 0.3f);
+    for (unsigned r = 0; r < S; ++r) {
+      const float y = r * (G-1) / float(S-1);
+      const unsigned y0 = (y >= G-1) ? G-2 : unsigned(y);
+      const float fy = y - y0;
+      for (unsigned s = 0; s < S; ++s) {
+        const float x = s * (G-1) / float(S-1);
+        const unsigned x0 = (x >= G-1) ? G-2 : unsigned(x);
+        const float fx = x - x0;
+        const float v = (1-fy) * ((1-fx) * grid[y0*G + x0]     + fx * grid[y0*G + x0+1])
+                      +    fy  * ((1-fx) * grid[(y0+1)*G + x0] + fx * grid[(y0+1)*G + x0+1]);
+        img[c*S*S + r*S + s] = clamp(v + 0.05f * rng.normal(), -1.0f, 1.0f);
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------
+// Weights and batch norm params of layer l (1-based). [sigma] is the
+// spread of the layer's sums, the comparison thresholds -h/k are drawn
+// around [center]*sigma. Dense thresholds are odd integers and k a
+// multiple of 1/256, so -h/k is exactly the threshold and k*sum + h
+// is exact in float. The sums over an even fan-in are even and never
+// equal a threshold, so the accelerator's rounded integer compare and
+// the float compare of the CPU dense layers always agree.
+//------------------------------------------------------------------------
+static void synth_layer(std::vector<float> arrays[N_ARRAYS], unsigned l,
+                        uint64_t seed, float sigma, float center) {
+  const unsigned M = M_tab[l-1];
+  const unsigned N = N_tab[l-1];
+  std::vector<float>& w = arrays[widx_tab[l-1]];
+  std::vector<float>& k = arrays[kidx_tab[l-1]];
+  std::vector<float>& h = arrays[hidx_tab[l-1]];
+
+  SynthRng wrng(seed, widx_tab[l-1]);
+  w.resize(layer_is_conv(l) ? M*N*WT_SIZE : M*N);
+  for (unsigned i = 0; i < w.size(); ++i)
+    w[i] = wrng.uniform(-1.0f, 1.0f);
+
+  SynthRng rng(seed, kidx_tab[l-1]);
+  k.resize(N);
+  h.resize(N);
+  for (unsigned n = 0; n < N; ++n) {
+    // the last layer is set by calibrate_last()
+    float t = sigma * (center + 0.3f * rng.normal());
+    k[n] = rng.uniform(0.5f, 1.5f);
+    if (!layer_is_conv(l)) {
+      t = 2.0f * std::floor(t / 2.0f) + 1.0f;
+      k[n] = std::round(k[n] * 256.0f) / 256.0f;
+    }
+    h[n] = -t * k[n];
+  }
+}
+
+//------------------------------------------------------------------------
+// Sets k and h of the last layer from the class sums of images [0, n)
+// of [maps]: every class score k*sum + h gets mean 0 and about the same
+// spread (give or take a little noise), so that no class takes most of
+// the images. k and h are multiples of 2^-10, exact in KType and HType,
+// so the scores are exact both in the accelerator's ap_fixed<20,10> and
+// in float, and the two rank the classes the same.
+//------------------------------------------------------------------------
+static void calibrate_last(std::vector<float> arrays[N_ARRAYS], uint64_t seed,
+                           const GoldenModel::Maps* maps, unsigned n) {
+  const unsigned l = N_LAYERS;
+  const unsigned M = M_tab[l-1];
+  const unsigned N = N_tab[l-1];
+  const std::vector<float>& w = arrays[widx_tab[l-1]];
+  std::vector<float>& k = arrays[kidx_tab[l-1]];
+  std::vector<float>& h = arrays[hidx_tab[l-1]];
+  std::vector<float> in(M);
+  std::vector<double> sum(N, 0.0), sq(N, 0.0);
+
+  for (unsigned i = 0; i < n; ++i) {
+    unpack_signs(&in[0], &maps[i].out[l-2][0], M);
+    for (unsigned c = 0; c < N; ++c) {
+      float s = 0;
+      for (unsigned m = 0; m < M; ++m)
+        s += (w[m*N + c] < 0) ? -in[m] : in[m];
+      sum[c] += s;
+      sq[c] += s*s;
+    }
+  }
+  SynthRng rng(seed, hidx_tab[l-1]);
+  for (unsigned c = 0; c < N; ++c) {
+    const double mean = sum[c] / n;
+    const double sd = std::sqrt(std::max(sq[c] / n - mean*mean, 1.0));
+    // score spread 3, k must fit KType and h HType
+    k[c] = clamp(3.0f / sd * rng.uniform(0.9f, 1.1f), 0.01f, 1.9f);
+    h[c] = clamp(-k[c] * mean + 0.3f * rng.normal(), -7.9f, 7.9f);
+    k[c] = std::round(k[c] * 1024.0f) / 1024.0f;
+    h[c] = std::round(h[c] * 1024.0f) / 1024.0f;
+  }
+}
+
+// Swaps classes a and b of the last layer
+static void swap_classes(std::vector<float> arrays[N_ARRAYS], unsigned a, unsigned b) {
+  const unsigned l = N_LAYERS;
+  const unsigned M = M_tab[l-1];
+  const unsigned N = N_tab[l-1];
+  std::vector<float>& w = arrays[widx_tab[l-1]];
+  for (unsigned m = 0; m < M; ++m)
+    std::swap(w[m*N + a], w[m*N + b]);
+  std::swap(arrays[kidx_tab[l-1]][a], arrays[kidx_tab[l-1]][b]);
+  std::swap(arrays[hidx_tab[l-1]][a], arrays[hidx_tab[l-1]][b]);
+}
+
+static void pack_layer(Word* wt, Word* kh, std::vector<float> arrays[N_ARRAYS],
+                       unsigned l) {
+  set_weight_array(wt, &arrays[widx_tab[l-1]][0], l);
+  set_bnorm_array(kh, &arrays[kidx_tab[l-1]][0], &arrays[hidx_tab[l-1]][0], l);
+}
+
+//------------------------------------------------------------------------
+// Archive writers
+//------------------------------------------------------------------------
+static void write_floats(const std::string& filename, const float* data, unsigned n) {
+  zipFile ar = zipOpen(filename.c_str(), 0);
+  if (!ar) {
+    fprintf (stderr, "**** ERROR: cannot create %s\n", filename.c_str());
+    exit(-1);
+  }
+  write_buffer_to_zip(ar, "arr_0", (void*)data, n*sizeof(float));
+  zipClose(ar, NULL);
+}
+
+// The bits of a feature map as +1/-1 floats
+static void write_map(const std::string& filename, const std::vector<uint64_t>& bits,
+                      unsigned n_bits) {
+  std::vector<float> f(n_bits);
+  unpack_signs(&f[0], &bits[0], n_bits);
+  write_floats(filename, &f[0], n_bits);
+}
+
+static bool file_exists(const std::string& filename) {
+  return access(filename.c_str(), F_OK) == 0;
+}
+
+int main(int argc, char** argv) {
+  uint64_t seed = 1;
+  bool force = false;
+  int c;
+  while ((c = getopt(argc, argv, "fs:")) != -1) {
+    if (c == 'f')
+      force = true;
+    else if (c == 's')
+      seed = std::stoull(optarg);
+    else
+      return -1;
+  }
+  if (optind >= argc) {
+    printf ("Usage: %s [-f] [-s <seed>] <n images> [<root>]\n", argv[0]);
+    return 0;
+  }
+  const unsigned n_imgs = std::stoi(argv[optind]);
+  const std::string root = (optind + 1 < argc) ? argv[optind+1] : get_root_dir();
+  const std::string param_file = root + "/params/cifar10_parameters_nb.zip";
+  const std::string input_file = root + Cifar10TestInputs::filename;
+  const std::string label_file = root + Cifar10TestLabels::filename;
+  if (n_imgs == 0) {
+    fprintf (stderr, "**** ERROR: need at least 1 image\n");
+    return -1;
+  }
+  mkdir(root.c_str(), 0755);
+  mkdir((root + "/params").c_str(), 0755);
+  mkdir((root + "/data").c_str(), 0755);
+  if (!force && (file_exists(param_file) || file_exists(input_file))) {
+    fprintf (stderr, "**** ERROR: %s/params or %s/data already has archives, "
+             "use -f to overwrite them\n", root.c_str(), root.c_str());
+    return -1;
+  }
+
+  //--------------------------------------------------------------
+  // Images, then the layers. The spread of the conv1 sums follows
+  // from the mean square of the pixels, binary sums of M inputs
+  // spread by sqrt(M). Pooling ANDs 4 bits, so pooled layers set
+  // about 84% of their bits before pooling.
+  //--------------------------------------------------------------
+  printf ("## Generating %u images and the parameters, seed %llu ##\n",
+      n_imgs, (unsigned long long)seed);
+  std::vector<float> X(size_t(n_imgs) * IMG_SIZE);
+  parallel_for(n_imgs, 0, [&](unsigned i) {
+    synth_image(&X[size_t(i) * IMG_SIZE], seed, i);
+  });
+  double sq = 0;
+  for (size_t i = 0; i < X.size(); ++i)
+    sq += X[i] * X[i];
+  const float pixel_rms = std::sqrt(sq / X.size());
+
+  std::vector<float> arrays[N_ARRAYS];
+  for (unsigned l = 1; l <= N_LAYERS; ++l) {
+    const unsigned fan_in = layer_is_conv(l) ? M_tab[l-1]*WT_SIZE : M_tab[l-1];
+    const float sigma = std::sqrt(float(fan_in)) * (layer_is_fpconv(l) ? pixel_rms : 1.0f);
+    synth_layer(arrays, l, seed, sigma, pool_tab[l-1] ? 0.7f : 0.0f);
+  }
+
+  Word* wt[N_LAYERS];
+  Word* kh[N_LAYERS];
+  for (unsigned l = 1; l <= N_LAYERS; ++l) {
+    const unsigned M = M_tab[l-1];
+    const unsigned N = N_tab[l-1];
+    // the last layer holds 2 k,h pairs per Word
+    const unsigned kh_words = layer_is_last(l) ? (N+1)/2 : N/KH_PER_WORD;
+    wt[l-1] = new Word[layer_is_conv(l) ? WTS_TO_WORDS(M*N) : M*N / WORD_SIZE];
+    kh[l-1] = new Word[kh_words];
+    for (unsigned i = 0; i < kh_words; ++i)
+      kh[l-1][i] = 0;
+    pack_layer(wt[l-1], kh[l-1], arrays, l);
+  }
+
+  //--------------------------------------------------------------
+  // Calibrate the class scores on the first chunk of images, then
+  // make image 0 class 3
+  //--------------------------------------------------------------
+  const unsigned img_words = S_tab[0]*S_tab[0];
+  std::vector<Word> imgs(CHUNK * img_words);
+  std::vector<GoldenModel::Maps> maps(CHUNK);
+  const unsigned n_calib = (n_imgs < CHUNK) ? n_imgs : CHUNK;
+  parallel_for(n_calib, 0, [&](unsigned i) {
+    binarize_input_images(&imgs[i*img_words], &X[size_t(i) * IMG_SIZE], S_tab[0]);
+  });
+  {
+    GoldenModel golden(wt, kh);
+    golden.run_batch(&imgs[0], n_calib, &maps[0]);
+    calibrate_last(arrays, seed, &maps[0], n_calib);
+    pack_layer(wt[N_LAYERS-1], kh[N_LAYERS-1], arrays, N_LAYERS);
+  }
+  {
+    GoldenModel golden(wt, kh);
+    const unsigned p0 = golden.run(&imgs[0], maps[0]);
+    if (p0 != 3) {
+      swap_classes(arrays, p0, 3);
+      pack_layer(wt[N_LAYERS-1], kh[N_LAYERS-1], arrays, N_LAYERS);
+    }
+  }
+
+  //--------------------------------------------------------------
+  // Labels and bit densities from the golden model, the maps of
+  // image 0 are the layer references
+  //--------------------------------------------------------------
+  printf ("## Running the golden model ##\n");
+  GoldenModel golden(wt, kh);
+  std::vector<float> labels(n_imgs);
+  unsigned class_count[N_CLASSES] = {0};
+  double set_bits[N_LAYERS-1] = {0};
+  for (unsigned b = 0; b < n_imgs; b += CHUNK) {
+    const unsigned nb = (n_imgs - b < CHUNK) ? n_imgs - b : CHUNK;
+    parallel_for(nb, 0, [&](unsigned i) {
+      binarize_input_images(&imgs[i*img_words], &X[size_t(b+i) * IMG_SIZE], S_tab[0]);
+    });
+    golden.run_batch(&imgs[0], nb, &maps[0]);
+    for (unsigned i = 0; i < nb; ++i) {
+      labels[b+i] = maps[i].prediction;
+      class_count[maps[i].prediction]++;
+      for (unsigned l = 0; l < N_LAYERS-1; ++l)
+        for (unsigned j = 0; j < maps[i].out[l].size(); ++j)
+          set_bits[l] += __builtin_popcountll(maps[i].out[l][j]);
+    }
+    if (b == 0) {
+      for (unsigned l = 0; l < L_CONV; ++l)
+        write_map(root + "/data/cpp_conv" + std::to_string(l+1) + "_maps.zip",
+                  maps[0].out[l], N_tab[l]*S_tab[l+1]*S_tab[l+1]);
+      for (unsigned d = 0; d < 3; ++d)
+        write_map(root + "/data/cpp_dense" + std::to_string(d) + "_maps.zip",
+                  maps[0].out[L_CONV-1+d], M_tab[L_CONV+d]);
+    }
+  }
+
+  //--------------------------------------------------------------
+  // Archives
+  //--------------------------------------------------------------
+  printf ("## Writing %s ##\n", param_file.c_str());
+  zipFile ar = zipOpen(param_file.c_str(), 0);
+  if (!ar) {
+    fprintf (stderr, "**** ERROR: cannot create %s\n", param_file.c_str());
+    return -1;
+  }
+  for (unsigned i = 0; i < N_ARRAYS; ++i)
+    write_buffer_to_zip(ar, "arr_" + std::to_string(i), &arrays[i][0],
+                        arrays[i].size()*sizeof(float));
+  zipClose(ar, NULL);
+
+  printf ("## Writing %s ##\n", input_file.c_str());
+  write_floats(input_file, &X[0], X.size());
+  write_floats(label_file, &labels[0], n_imgs);
+
+  printf ("\nBits set per layer:");
+  for (unsigned l = 0; l < N_LAYERS-1; ++l)
+    printf (" %.2f", set_bits[l] / (double(n_imgs) * GoldenModel::output_words(l) * WORD_SIZE));
+  printf ("\nImages per class:  ");
+  for (unsigned n = 0; n < N_CLASSES; ++n)
+    printf (" %u", class_count[n]);
+  printf ("\n");
+
+  for (unsigned l = 0; l < N_LAYERS; ++l) {
+    delete[] wt[l];
+    delete[] kh[l];
+  }
+  return 0;
+}
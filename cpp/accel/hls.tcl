@@ -4,8 +4,8 @@
 
 set top "top"
 set cflags "-DHLS_COMPILE -O3 -std=c++0x -I../utils"
-set tbflags "-DHLS_COMPILE -O3 -std=c++0x -I../utils -lminizip -laes -lz"
-set utils "../utils/Common.cpp ../utils/DataIO.cpp ../utils/ParamIO.cpp ../utils/ZipIO.cpp"
+set tbflags "-DHLS_COMPILE -O3 -std=c++0x -I../utils -lminizip -laes -lz -lpthread"
+set utils "../utils/Common.cpp ../utils/DataIO.cpp ../utils/ParamIO.cpp ../utils/ZipIO.cpp ../utils/LowJitter.cpp ../utils/BitPack.cpp ../utils/Trace.cpp ../utils/Timer.cpp ../utils/Metrics.cpp ../utils/PerfCounters.cpp ../utils/MemTrack.cpp"
 
 open_project hls.prj
 
@@ -14,8 +14,11 @@ set_top $top
 add_files Accel.cpp -cflags $cflags
 add_files -tb accel_test_random.cpp -cflags $tbflags
 add_files -tb AccelSchedule.cpp -cflags $cflags
+add_files -tb AccelSw.cpp -cflags $cflags
+add_files -tb WeightPack.cpp -cflags $cflags
 add_files -tb AccelTest.cpp -cflags $cflags
 add_files -tb AccelPrint.cpp -cflags $cflags
+add_files -tb BufferPool.cpp -cflags $cflags
 add_files -tb InputConv.cpp -cflags $tbflags
 add_files -tb Dense.cpp -cflags $tbflags
 add_files -tb $utils -cflags $tbflags
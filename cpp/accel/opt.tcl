@@ -24,6 +24,8 @@ set_directive_loop_tripcount -min 1 -max 512 bin_conv/LOOP_PHASES
 set_directive_pipeline bin_conv/LOOP_WORDS_IN_PHASE
 set_directive_loop_tripcount -min 17 -max 32 bin_conv/LOOP_WORDS_IN_PHASE
 set_directive_dependence -variable fixed_buffer -type inter -dependent false bin_conv/LOOP_WORDS_IN_PHASE
+# bin_conv/LOOP_OUT_PAR, one iteration per output of the pass
+set_directive_loop_tripcount -min 1 -max 2 bin_conv/LOOP_OUT_PAR
 # bin_conv/LOOP_ACC_PHASES
 set_directive_loop_tripcount -min 1 -max 1  bin_conv/LOOP_ACC_PHASES
 set_directive_pipeline bin_conv/LOOP_ACC_PHASES_I
@@ -59,13 +61,16 @@ set_directive_array_partition top dmem           -dim 2 -type complete
 set_directive_array_partition top wt_mem         -dim 1 -type complete
 set_directive_array_partition bin_conv line_buffer     -dim 0 -type complete
 set_directive_array_partition bin_conv conv_params     -dim 0 -type complete
-set_directive_array_partition bin_conv fixed_buffer    -dim 2 -type complete
+set_directive_array_partition bin_conv fixed_buffer    -dim 1 -type complete
+set_directive_array_partition bin_conv fixed_buffer    -dim 3 -type complete
 set_directive_array_partition bin_conv fixed_temp      -dim 0 -type complete
 set_directive_array_partition bin_conv word_buffer     -dim 0 -type complete
 set_directive_array_partition bin_conv old_word_buffer -dim 0 -type complete
 set_directive_array_partition bin_conv lb              -dim 0 -type complete
 set_directive_array_partition bin_conv rb              -dim 0 -type complete
 set_directive_array_partition bin_conv wt_word_buffer  -dim 0 -type complete
+set_directive_array_partition bin_conv wt_addr_j       -dim 0 -type complete
+set_directive_array_partition bin_conv wt_offset_j     -dim 0 -type complete
 set_directive_array_partition bin_conv conv_out_buffer -dim 0 -type complete
 set_directive_array_partition fp_conv win       -dim 0 -type complete
 set_directive_array_partition fp_conv lbuf      -dim 0 -type complete
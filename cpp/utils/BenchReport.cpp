@@ -0,0 +1,95 @@
+//---------------------------------------------------------
+// BenchReport.cpp
+//---------------------------------------------------------
+#include <math.h>
+#include <stdio.h>
+
+#include "BenchReport.h"
+
+static std::string json_string(const std::string& s) {
+  std::string out = "\"";
+  for (unsigned i = 0; i < s.size(); ++i) {
+    const char c = s[i];
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if ((unsigned char)c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+static std::string json_number(double x) {
+  // JSON has no inf or nan
+  if (!isfinite(x))
+    return "null";
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.9g", x);
+  return buf;
+}
+
+void BenchReport::set_config(const std::string& key, const std::string& value) {
+  configs.push_back(std::make_pair(key, json_string(value)));
+}
+
+void BenchReport::set_config(const std::string& key, double value) {
+  configs.push_back(std::make_pair(key, json_number(value)));
+}
+
+void BenchReport::add_sample(const std::string& name, double value,
+                             const char* unit, bool higher_is_better) {
+  for (unsigned i = 0; i < metrics.size(); ++i) {
+    if (metrics[i].name == name) {
+      metrics[i].samples.push_back(value);
+      return;
+    }
+  }
+  Metric m;
+  m.name = name;
+  m.unit = unit;
+  m.higher_is_better = higher_is_better;
+  m.samples.push_back(value);
+  metrics.push_back(m);
+}
+
+bool BenchReport::write(const std::string& path) const {
+  if (path == "-")
+    return write(stdout);
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f) {
+    perror(path.c_str());
+    return false;
+  }
+  const bool ok = write(f);
+  return (fclose(f) == 0) && ok;
+}
+
+bool BenchReport::write(FILE* f) const {
+  fprintf (f, "{\n  \"bench\": %s,\n  \"config\": {", json_string(bench).c_str());
+  for (unsigned i = 0; i < configs.size(); ++i)
+    fprintf (f, "%s\n    %s: %s", i ? "," : "", json_string(configs[i].first).c_str(),
+        configs[i].second.c_str());
+  fprintf (f, "\n  },\n  \"metrics\": {");
+
+  for (unsigned i = 0; i < metrics.size(); ++i) {
+    const Metric& m = metrics[i];
+    double sum = 0;
+    for (unsigned j = 0; j < m.samples.size(); ++j)
+      sum += m.samples[j];
+    fprintf (f, "%s\n    %s: {\"unit\": %s, \"better\": \"%s\", \"mean\": %s, \"samples\": [",
+        i ? "," : "", json_string(m.name).c_str(), json_string(m.unit).c_str(),
+        m.higher_is_better ? "higher" : "lower",
+        json_number(sum / m.samples.size()).c_str());
+    for (unsigned j = 0; j < m.samples.size(); ++j)
+      fprintf (f, "%s%s", j ? ", " : "", json_number(m.samples[j]).c_str());
+    fprintf (f, "]}");
+  }
+  fprintf (f, "\n  }\n}\n");
+
+  return (fflush(f) == 0) && !ferror(f);
+}
@@ -0,0 +1,56 @@
+//---------------------------------------------------------
+// BenchReport.h
+//---------------------------------------------------------
+#ifndef __BENCH_REPORT_H__
+#define __BENCH_REPORT_H__
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------
+// BenchReport collects the config and the metrics of one
+// benchmark run and writes them as JSON:
+//
+//   { "bench": "<name>",
+//     "config": { "<key>": <value>, ... },
+//     "metrics": {
+//       "<metric>": { "unit": "<unit>", "better": "higher",
+//                     "mean": <mean>, "samples": [ ... ] },
+//       ... } }
+//
+// A metric gets one sample per repetition of the measured
+// run, the samples let a regression check tell noise from a
+// real change. "better" is "higher" or "lower".
+//---------------------------------------------------------
+class BenchReport {
+
+  struct Metric {
+    std::string name;
+    std::string unit;
+    bool higher_is_better;
+    std::vector<double> samples;
+  };
+
+  std::string bench;
+  // config values are kept as JSON text
+  std::vector<std::pair<std::string, std::string> > configs;
+  std::vector<Metric> metrics;
+
+  public:
+    BenchReport(const std::string& name) : bench(name) {}
+
+    void set_config(const std::string& key, const std::string& value);
+    void set_config(const std::string& key, double value);
+
+    // adds one sample of metric [name], the first sample sets
+    // its unit and direction
+    void add_sample(const std::string& name, double value,
+                    const char* unit, bool higher_is_better);
+
+    // writes the JSON to [path], "-" is stdout
+    bool write(const std::string& path) const;
+    // writes the JSON to the open stream [f] and flushes it
+    bool write(FILE* f) const;
+};
+
+#endif
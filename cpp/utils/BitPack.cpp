@@ -0,0 +1,65 @@
+#include "BitPack.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//------------------------------------------------------------------------
+// 64 floats -> 1 word
+//------------------------------------------------------------------------
+static inline uint64_t pack_full64(const float* in) {
+#ifdef __SSE2__
+  const __m128 zero = _mm_setzero_ps();
+  uint64_t w = 0;
+  for (unsigned i = 0; i < 64; i += 4) {
+    // one mask bit per lane, compare (not the raw sign bit) so that
+    // -0.0 packs like +0.0
+    const __m128 lt = _mm_cmplt_ps(_mm_loadu_ps(in + i), zero);
+    w |= uint64_t(_mm_movemask_ps(lt)) << i;
+  }
+  return w;
+#else
+  uint64_t w = 0;
+  for (unsigned i = 0; i < 64; ++i)
+    w |= uint64_t(in[i] < 0) << i;
+  return w;
+#endif
+}
+
+uint64_t pack_signs64(const float* in, unsigned n) {
+  if (n == 64)
+    return pack_full64(in);
+  uint64_t w = 0;
+  for (unsigned i = 0; i < n; ++i)
+    w |= uint64_t(in[i] < 0) << i;
+  return w;
+}
+
+void pack_signs(uint64_t* out, const float* in, size_t n) {
+  const size_t full = n / 64;
+  for (size_t i = 0; i < full; ++i)
+    out[i] = pack_full64(in + 64*i);
+  if (n % 64)
+    out[full] = pack_signs64(in + 64*full, n % 64);
+}
+
+void unpack_signs(float* out, const uint64_t* in, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    out[i] = ((in[i/64] >> (i%64)) & 1) ? -1.0f : 1.0f;
+}
+
+//------------------------------------------------------------------------
+// Recursive block swap (Hacker's Delight 7-3): swap the off-diagonal
+// 32x32 blocks, then the 16x16 blocks inside each, ... down to single
+// bits, 6 passes of 32 masked xor-swaps
+//------------------------------------------------------------------------
+void transpose64(uint64_t a[64]) {
+  uint64_t m = 0x00000000FFFFFFFFULL;
+  for (unsigned j = 32; j != 0; j >>= 1, m ^= m << j) {
+    for (unsigned k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+      const uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+      a[k] ^= t << j;
+      a[k | j] ^= t;
+    }
+  }
+}
@@ -0,0 +1,32 @@
+//---------------------------------------------------------
+// BitPack.h
+//---------------------------------------------------------
+#ifndef __BIT_PACK_H__
+#define __BIT_PACK_H__
+#include <cstddef>
+#include <stdint.h>
+
+//---------------------------------------------------------
+// Bulk conversion between float arrays and packed sign
+// bits, 64 elements per uint64_t word, element i in bit
+// i%64 of word i/64. A set bit means negative, the encoding
+// used for feature maps and weights everywhere (-1 -> 1).
+//---------------------------------------------------------
+
+// Sets bit i of [out] to (in[i] < 0) for i in [0, n). The
+// bits of the last word past n are cleared. Uses SSE2
+// compares and movemask 4 floats at a time where present.
+void pack_signs(uint64_t* out, const float* in, size_t n);
+
+// The signs of up to 64 floats as one word
+uint64_t pack_signs64(const float* in, unsigned n = 64);
+
+// Writes -1.0 for each set and +1.0 for each clear bit
+// i in [0, n) of [in]
+void unpack_signs(float* out, const uint64_t* in, size_t n);
+
+// Transposes a 64x64 bit matrix in place: bit j of a[i]
+// is swapped with bit i of a[j]
+void transpose64(uint64_t a[64]);
+
+#endif
@@ -1,3 +1,6 @@
+#include <cstdio>
+#include <cstring>
+
 #include "Common.h"
 
 //------------------------------------------------------------------------
@@ -10,3 +13,29 @@ std::string get_root_dir() {
   return std::string(root);
 }
 
+//------------------------------------------------------------------------
+// Reads a "<key>: <n> kB" line of /proc/self/status
+static size_t proc_status_kb(const char* key) {
+  FILE* f = fopen("/proc/self/status", "r");
+  if (!f)
+    return 0;
+  char line[128];
+  size_t kb = 0;
+  const size_t len = strlen(key);
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, key, len) == 0 && line[len] == ':') {
+      kb = strtoul(line + len + 1, NULL, 10);
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
+size_t resident_bytes() {
+  return proc_status_kb("VmRSS") * 1024;
+}
+
+size_t peak_resident_bytes() {
+  return proc_status_kb("VmHWM") * 1024;
+}
@@ -11,6 +11,11 @@
 // Returns the repo's root dir or exits
 std::string get_root_dir();
 
+// Current and peak resident set size of the process in bytes, from
+// /proc/self/status, 0 if unavailable
+size_t resident_bytes();
+size_t peak_resident_bytes();
+
 // We encode negative to -1, positive to 0
 template<typename T>
 Bit sgn(const T x) {
@@ -1,10 +1,11 @@
 #include "DataIO.h"
 
 
-Cifar10TestInputs::Cifar10TestInputs(unsigned n)
+Cifar10TestInputs::Cifar10TestInputs(unsigned n, unsigned start)
   : m_size(n*CHANNELS*ROWS*COLS)
 {
   data = new float[m_size];
+  mem_tag(MEM_DATASET, MEM_NO_LAYER, m_size*sizeof(float));
 
   std::string full_filename = get_root_dir() + filename;
   DB_PRINT(2, "Opening data archive %s\n", full_filename.c_str());
@@ -12,20 +13,23 @@ Cifar10TestInputs::Cifar10TestInputs(unsigned n)
   unsigned nfiles = get_nfiles_in_unzip(ar);
   assert(nfiles == 1);
 
-  // We read m_size*4 bytes from the archive
+  // We read m_size*4 bytes from the archive, after the first
+  // [start] images
+  const unsigned offset = start*CHANNELS*ROWS*COLS*4;
   unsigned fsize = get_current_file_size(ar);
-  assert(m_size*4 <= fsize);
+  assert(offset + m_size*4 <= fsize);
 
-  DB_PRINT(2, "Reading %u bytes\n", m_size*4);
-  read_current_file(ar, (void*)data, m_size*4);
+  DB_PRINT(2, "Reading %u bytes at %u\n", m_size*4, offset);
+  read_current_file(ar, (void*)data, m_size*4, offset);
   
   unzClose(ar);
 }
 
-Cifar10TestLabels::Cifar10TestLabels(unsigned n)
+Cifar10TestLabels::Cifar10TestLabels(unsigned n, unsigned start)
   : m_size(n)
 {
   data = new float[m_size];
+  mem_tag(MEM_DATASET, MEM_NO_LAYER, m_size*sizeof(float));
 
   std::string full_filename = get_root_dir() + filename;
   DB_PRINT(2, "Opening data archive %s\n", full_filename.c_str());
@@ -33,12 +37,12 @@ Cifar10TestLabels::Cifar10TestLabels(unsigned n)
   unsigned nfiles = get_nfiles_in_unzip(ar);
   assert(nfiles == 1);
 
-  // We read n*4 bytes from the archive
+  // We read n*4 bytes from the archive, after the first [start] labels
   unsigned fsize = get_current_file_size(ar);
-  assert(m_size*4 <= fsize);
+  assert((start + m_size)*4 <= fsize);
 
-  DB_PRINT(2, "Reading %u bytes\n", m_size*4);
-  read_current_file(ar, (void*)data, m_size*4);
+  DB_PRINT(2, "Reading %u bytes at %u\n", m_size*4, start*4);
+  read_current_file(ar, (void*)data, m_size*4, start*4);
   unzClose(ar);
 }
 
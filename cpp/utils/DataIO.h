@@ -7,8 +7,9 @@
 #include "ZipIO.h"
 #include "Common.h"
 #include "SArray.h"
+#include "MemTrack.h"
 
-// This class will load N cifar10 test images
+// This class will load N cifar10 test images, starting at image [start]
 struct Cifar10TestInputs {
   static const unsigned CHANNELS=3;
   static const unsigned ROWS=32;
@@ -18,8 +19,11 @@ struct Cifar10TestInputs {
   float* data;
   unsigned m_size;
 
-  Cifar10TestInputs(unsigned n);
-  ~Cifar10TestInputs() { delete[] data; }
+  Cifar10TestInputs(unsigned n, unsigned start=0);
+  ~Cifar10TestInputs() {
+    mem_tag(MEM_DATASET, MEM_NO_LAYER, -(long long)(m_size*sizeof(float)));
+    delete[] data;
+  }
   unsigned size() { return m_size; }
 };
 
@@ -29,7 +33,10 @@ struct Cifar10TestLabels {
   float* data;
   unsigned m_size;
 
-  Cifar10TestLabels(unsigned n);
-  ~Cifar10TestLabels() { delete[] data; }
+  Cifar10TestLabels(unsigned n, unsigned start=0);
+  ~Cifar10TestLabels() {
+    mem_tag(MEM_DATASET, MEM_NO_LAYER, -(long long)(m_size*sizeof(float)));
+    delete[] data;
+  }
   unsigned size() { return m_size; }
 };
@@ -0,0 +1,47 @@
+//---------------------------------------------------------
+// LatencyStats.cpp
+//---------------------------------------------------------
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+#include "LatencyStats.h"
+
+void LatencyStats::add(const LatencyStats& other) {
+  samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+}
+
+float LatencyStats::mean() const {
+  if (samples.empty())
+    return 0;
+  double sum = 0;
+  for (unsigned i = 0; i < samples.size(); ++i)
+    sum += samples[i];
+  return sum / samples.size();
+}
+
+float LatencyStats::max() const {
+  if (samples.empty())
+    return 0;
+  return *std::max_element(samples.begin(), samples.end());
+}
+
+float LatencyStats::percentile(float p) const {
+  if (samples.empty())
+    return 0;
+  std::vector<float> sorted(samples);
+  std::sort(sorted.begin(), sorted.end());
+  unsigned rank = (unsigned)ceil(p / 100 * sorted.size());
+  if (rank > 0)
+    rank--;
+  if (rank >= sorted.size())
+    rank = sorted.size()-1;
+  return sorted[rank];
+}
+
+void LatencyStats::print(const char* name) const {
+  printf ("%-20s: %6u samples; ", name, count());
+  printf ("mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f usecs\n",
+      mean(), percentile(50), percentile(90), percentile(99),
+      percentile(99.9), max());
+}
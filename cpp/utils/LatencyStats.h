@@ -0,0 +1,31 @@
+//---------------------------------------------------------
+// LatencyStats.h
+//---------------------------------------------------------
+#ifndef __LATENCY_STATS_H__
+#define __LATENCY_STATS_H__
+#include <vector>
+
+//---------------------------------------------------------
+// LatencyStats collects per-item latency samples (in
+// microseconds) and reports mean, max and percentiles.
+//---------------------------------------------------------
+class LatencyStats {
+
+  std::vector<float> samples;
+
+  public:
+    void add(float usecs) { samples.push_back(usecs); }
+    void add(const LatencyStats& other);
+    void clear() { samples.clear(); }
+
+    unsigned count() const { return samples.size(); }
+    float mean() const;
+    float max() const;
+    // nearest-rank percentile, p is in [0,100]
+    float percentile(float p) const;
+
+    // prints count, mean, p50, p90, p99, p99.9 and max
+    void print(const char* name) const;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "LowJitter.h"
+
+LowJitterConfig low_jitter_from_env() {
+  LowJitterConfig cfg;
+  cfg.enabled = getenv("BNN_LOW_JITTER") != NULL;
+
+  const char* cpus = getenv("BNN_CPUS");
+  while (cpus && *cpus) {
+    char* end;
+    const long c = strtol(cpus, &end, 10);
+    if (end == cpus)
+      break;
+    cfg.cpus.push_back(c);
+    cpus = (*end == ',') ? end+1 : end;
+  }
+
+  const char* fifo = getenv("BNN_SCHED_FIFO");
+  cfg.fifo_prio = fifo ? atoi(fifo) : 0;
+  return cfg;
+}
+
+void apply_low_jitter(const LowJitterConfig& cfg, unsigned slot, pthread_t thread) {
+  if (!cfg.enabled)
+    return;
+  const int cpu = cfg.cpu(slot);
+  if (cpu >= 0 && !pin_thread(thread, cpu))
+    fprintf(stderr, "low jitter: cannot pin thread %u to cpu %d\n", slot, cpu);
+  if (cfg.fifo_prio > 0 && !set_fifo_priority(thread, cfg.fifo_prio))
+    fprintf(stderr, "low jitter: cannot set SCHED_FIFO %d on thread %u: %s\n",
+        cfg.fifo_prio, slot, strerror(errno));
+}
+
+bool pin_thread(pthread_t thread, int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+bool set_fifo_priority(pthread_t thread, int prio) {
+  sched_param sp;
+  sp.sched_priority = prio;
+  const int err = pthread_setschedparam(thread, SCHED_FIFO, &sp);
+  errno = err;
+  return err == 0;
+}
+
+bool lock_pages(const void* ptr, size_t bytes) {
+  if (ptr == NULL || bytes == 0)
+    return true;
+  return mlock(ptr, bytes) == 0;
+}
+
+void prefault_pages(void* ptr, size_t bytes) {
+  if (ptr == NULL)
+    return;
+  const size_t page = sysconf(_SC_PAGESIZE);
+  volatile char* p = (volatile char*)ptr;
+  // the first byte of each page, and the last byte of the range
+  for (size_t i = 0; i < bytes; i += page)
+    p[i] = p[i];
+  if (bytes > 0)
+    p[bytes-1] = p[bytes-1];
+}
@@ -0,0 +1,55 @@
+//---------------------------------------------------------
+// LowJitter.h
+//---------------------------------------------------------
+#ifndef __LOW_JITTER_H__
+#define __LOW_JITTER_H__
+#include <cstddef>
+#include <pthread.h>
+#include <vector>
+
+//---------------------------------------------------------
+// Low-jitter runtime mode: trades setup work for a lower
+// tail latency. Inference threads are pinned to fixed
+// cores (and optionally run SCHED_FIFO), and the memory
+// they touch is locked and pre-faulted at load time.
+//
+// Set from the environment:
+//   BNN_LOW_JITTER      enables the mode
+//   BNN_CPUS=a,b,...    cores of the inference threads in
+//                       order (main/batcher thread first)
+//   BNN_SCHED_FIFO=p    run them SCHED_FIFO at priority p
+//---------------------------------------------------------
+struct LowJitterConfig {
+  bool enabled;
+  std::vector<int> cpus;
+  int fifo_prio;        // 0 keeps the default policy
+
+  LowJitterConfig() : enabled(false), fifo_prio(0) {}
+
+  // core of inference thread [slot], -1 if not configured
+  int cpu(unsigned slot) const {
+    return slot < cpus.size() ? cpus[slot] : -1;
+  }
+};
+
+LowJitterConfig low_jitter_from_env();
+
+// Pins / schedules inference thread [slot] of [cfg], no-op
+// if the mode is off. Failures are reported and ignored.
+void apply_low_jitter(const LowJitterConfig& cfg, unsigned slot,
+                      pthread_t thread = pthread_self());
+
+// Pins [thread] to core [cpu], false on failure
+bool pin_thread(pthread_t thread, int cpu);
+// Switches [thread] to SCHED_FIFO at [prio], false on failure
+// (usually EPERM without CAP_SYS_NICE)
+bool set_fifo_priority(pthread_t thread, int prio);
+
+// Locks the pages of [ptr, ptr+bytes) into RAM, false on
+// failure (e.g. RLIMIT_MEMLOCK)
+bool lock_pages(const void* ptr, size_t bytes);
+// Touches every page of [ptr, ptr+bytes) for writing so
+// the first real access does not fault
+void prefault_pages(void* ptr, size_t bytes);
+
+#endif
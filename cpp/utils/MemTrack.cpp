@@ -0,0 +1,135 @@
+//---------------------------------------------------------
+// MemTrack.cpp
+//---------------------------------------------------------
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MemTrack.h"
+#include "Common.h"
+
+// slot MEM_MAX_LAYERS holds MEM_NO_LAYER (and out of range layers)
+static std::atomic<long long> g_bytes[N_MEM_CATEGORIES][MEM_MAX_LAYERS+1];
+
+static const char* category_names[N_MEM_CATEGORIES] = {
+  "params", "packed", "schedule", "dma", "dataset"
+};
+
+static unsigned slot(int layer) {
+  return (layer < 0 || layer >= (int)MEM_MAX_LAYERS) ? MEM_MAX_LAYERS : layer;
+}
+
+void mem_tag(MemCategory c, int layer, long long bytes) {
+  g_bytes[c][slot(layer)].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+size_t mem_tagged(MemCategory c, int layer) {
+  const long long b = g_bytes[c][slot(layer)].load(std::memory_order_relaxed);
+  return b > 0 ? b : 0;
+}
+
+size_t mem_tagged_total(MemCategory c) {
+  size_t total = 0;
+  for (unsigned l = 0; l <= MEM_MAX_LAYERS; ++l) {
+    const long long b = g_bytes[c][l].load(std::memory_order_relaxed);
+    total += b > 0 ? b : 0;
+  }
+  return total;
+}
+
+const char* mem_category_name(MemCategory c) {
+  return category_names[c];
+}
+
+//---------------------------------------------------------
+// Phases
+//---------------------------------------------------------
+struct MemPhase {
+  std::string name;
+  size_t rss;
+  size_t peak;
+};
+
+static std::mutex g_phase_mutex;
+static std::vector<MemPhase> g_phases;
+static bool g_peak_reset = true;    // false once a reset failed
+static std::atomic<bool> g_phases_on(false);
+
+// writing 5 to clear_refs resets VmHWM to the current RSS (Linux 4.0+)
+static bool reset_peak_resident() {
+  FILE* f = fopen("/proc/self/clear_refs", "w");
+  if (!f)
+    return false;
+  const bool ok = fputs("5", f) >= 0;
+  return (fclose(f) == 0) && ok;
+}
+
+void mem_enable_phases() {
+  g_phases_on = true;
+}
+
+void mem_phase(const char* name) {
+  if (!g_phases_on)
+    return;
+  MemPhase p;
+  p.name = name;
+  p.rss = resident_bytes();
+  p.peak = peak_resident_bytes();
+  std::lock_guard<std::mutex> lock(g_phase_mutex);
+  g_phases.push_back(p);
+  if (!reset_peak_resident())
+    g_peak_reset = false;
+}
+
+//---------------------------------------------------------
+// Report in KB, one row per layer, one column per category
+//---------------------------------------------------------
+static void print_row(const char* name, const size_t* bytes) {
+  size_t total = 0;
+  printf("%-10s", name);
+  for (unsigned c = 0; c < N_MEM_CATEGORIES; ++c) {
+    printf(" %10lu", (unsigned long)(bytes[c] >> 10));
+    total += bytes[c];
+  }
+  printf(" %10lu\n", (unsigned long)(total >> 10));
+}
+
+void mem_report(const char* const* layer_names, unsigned n_layers) {
+  printf("## Memory by layer and category (KB) ##\n");
+  printf("%-10s", "layer");
+  for (unsigned c = 0; c < N_MEM_CATEGORIES; ++c)
+    printf(" %10s", category_names[c]);
+  printf(" %10s\n", "total");
+
+  size_t bytes[N_MEM_CATEGORIES];
+  size_t totals[N_MEM_CATEGORIES];
+  for (unsigned l = 0; l <= n_layers && l <= MEM_MAX_LAYERS; ++l) {
+    // the last row holds what belongs to no layer
+    const int layer = (l == n_layers) ? MEM_NO_LAYER : (int)l;
+    for (unsigned c = 0; c < N_MEM_CATEGORIES; ++c)
+      bytes[c] = mem_tagged(MemCategory(c), layer);
+    print_row(layer == MEM_NO_LAYER ? "-" : layer_names[l], bytes);
+  }
+  size_t tagged = 0;
+  for (unsigned c = 0; c < N_MEM_CATEGORIES; ++c) {
+    totals[c] = mem_tagged_total(MemCategory(c));
+    tagged += totals[c];
+  }
+  print_row("total", totals);
+
+  const size_t rss = resident_bytes();
+  printf("RSS %.1f MB, %.1f MB tagged, %.1f MB other (code, heap, caches)\n",
+      rss / float(1 << 20), tagged / float(1 << 20),
+      (rss > tagged ? rss - tagged : 0) / float(1 << 20));
+
+  std::lock_guard<std::mutex> lock(g_phase_mutex);
+  if (g_phases.empty())
+    return;
+  printf("## RSS per phase (MB)%s ##\n",
+      g_peak_reset ? "" : ", peaks are since process start");
+  for (unsigned i = 0; i < g_phases.size(); ++i)
+    printf("%-10s rss %8.1f  peak %8.1f\n", g_phases[i].name.c_str(),
+        g_phases[i].rss / float(1 << 20), g_phases[i].peak / float(1 << 20));
+}
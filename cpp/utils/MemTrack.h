@@ -0,0 +1,55 @@
+//---------------------------------------------------------
+// MemTrack.h
+//---------------------------------------------------------
+#ifndef __MEM_TRACK_H__
+#define __MEM_TRACK_H__
+#include <cstddef>
+
+//---------------------------------------------------------
+// Memory accounting by category and layer. The owners of
+// the big allocations tag them when they allocate (+bytes)
+// and free (-bytes), so the totals always show what is live.
+// Phases mark points of the startup and record the RSS and
+// the peak RSS since the previous mark.
+//
+// - Layers are 0-based, MEM_NO_LAYER for memory that does
+//   not belong to one layer
+// - Tagging is a relaxed atomic add and always on
+//---------------------------------------------------------
+enum MemCategory {
+  MEM_PARAMS,       // source archive: float Params or PackedParams
+  MEM_PACKED,       // binarized weights and kh params, wt[l]/kh[l]
+  MEM_SCHEDULE,     // per-invocation buffers of the AccelSchedules
+  MEM_DMA,          // accelerator buffers held by the BufferPool
+  MEM_DATASET,      // test images and labels
+  N_MEM_CATEGORIES
+};
+
+const unsigned MEM_MAX_LAYERS = 16;
+const int MEM_NO_LAYER = -1;
+
+// Adds [bytes] (negative on free) to category [c] of [layer]
+void mem_tag(MemCategory c, int layer, long long bytes);
+// Live bytes of category [c] in [layer]
+size_t mem_tagged(MemCategory c, int layer);
+// Live bytes of category [c] over all layers
+size_t mem_tagged_total(MemCategory c);
+const char* mem_category_name(MemCategory c);
+
+// Turns on phase recording. Only tools that report phases
+// call this, the library never resets the peak RSS of the
+// process it runs in.
+void mem_enable_phases();
+// Ends the current phase as [name], recording the RSS now and
+// the peak RSS since the previous mark. The peak is reset
+// through /proc/self/clear_refs, where that is not possible
+// the peak is the one since process start. Does nothing until
+// mem_enable_phases() is called.
+void mem_phase(const char* name);
+
+// Prints the tagged bytes per category and layer, the
+// untagged rest of the RSS and the phases. [layer_names]
+// names layers 0 .. n_layers-1.
+void mem_report(const char* const* layer_names, unsigned n_layers);
+
+#endif
@@ -0,0 +1,332 @@
+//---------------------------------------------------------
+// Metrics.cpp
+//---------------------------------------------------------
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Metrics.h"
+#include "Common.h"
+
+void MetricGauge::add(double d) {
+  double v = m_value.load(std::memory_order_relaxed);
+  while (!m_value.compare_exchange_weak(v, v + d, std::memory_order_relaxed))
+    ;
+}
+
+MetricHistogram::MetricHistogram(const std::vector<double>& bounds)
+  : m_bounds(bounds), m_counts(bounds.size() + 1), m_sum(0)
+{
+  for (unsigned i = 0; i < m_counts.size(); ++i)
+    m_counts[i].store(0);
+}
+
+void MetricHistogram::observe(double v) {
+  unsigned i = 0;
+  while (i < m_bounds.size() && v > m_bounds[i])
+    ++i;
+  m_counts[i].fetch_add(1, std::memory_order_relaxed);
+  double s = m_sum.load(std::memory_order_relaxed);
+  while (!m_sum.compare_exchange_weak(s, s + v, std::memory_order_relaxed))
+    ;
+}
+
+//---------------------------------------------------------
+// Registry: families in creation order, each with its
+// label sets. Never freed, the exporter runs until exit.
+//---------------------------------------------------------
+enum MetricType { COUNTER, GAUGE, HISTOGRAM };
+
+struct MetricFamily {
+  std::string name;
+  std::string help;
+  MetricType type;
+  std::vector<std::string> labels;
+  std::vector<void*> metrics;
+};
+
+// function statics, metrics may be created during static init
+static std::mutex& registry_mutex() {
+  static std::mutex* m = new std::mutex;
+  return *m;
+}
+
+static std::vector<MetricFamily*>& registry() {
+  static std::vector<MetricFamily*>* r = new std::vector<MetricFamily*>;
+  return *r;
+}
+
+static const double default_bounds[] = {
+  1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3,
+  1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+static void* lookup(const char* name, const char* help, MetricType type,
+                    const std::string& labels, const std::vector<double>& bounds) {
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  MetricFamily* f = NULL;
+  for (unsigned i = 0; i < registry().size() && !f; ++i)
+    if (registry()[i]->name == name)
+      f = registry()[i];
+  if (!f) {
+    f = new MetricFamily;
+    f->name = name;
+    f->help = help;
+    f->type = type;
+    registry().push_back(f);
+  }
+  if (f->type != type) {
+    fprintf(stderr, "**** ERROR: metric %s registered with two types\n", name);
+    exit(-1);
+  }
+  for (unsigned i = 0; i < f->labels.size(); ++i)
+    if (f->labels[i] == labels)
+      return f->metrics[i];
+
+  void* m = NULL;
+  if (type == COUNTER)
+    m = new MetricCounter;
+  else if (type == GAUGE)
+    m = new MetricGauge;
+  else if (bounds.empty())
+    m = new MetricHistogram(std::vector<double>(default_bounds,
+        default_bounds + sizeof(default_bounds)/sizeof(default_bounds[0])));
+  else
+    m = new MetricHistogram(bounds);
+  f->labels.push_back(labels);
+  f->metrics.push_back(m);
+  return m;
+}
+
+MetricCounter* metric_counter(const char* name, const char* help,
+                              const std::string& labels) {
+  return (MetricCounter*) lookup(name, help, COUNTER, labels, std::vector<double>());
+}
+
+MetricGauge* metric_gauge(const char* name, const char* help,
+                          const std::string& labels) {
+  return (MetricGauge*) lookup(name, help, GAUGE, labels, std::vector<double>());
+}
+
+MetricHistogram* metric_histogram(const char* name, const char* help,
+                                  const std::string& labels,
+                                  const std::vector<double>& bounds) {
+  return (MetricHistogram*) lookup(name, help, HISTOGRAM, labels, bounds);
+}
+
+//---------------------------------------------------------
+// Text format
+//---------------------------------------------------------
+static void append(std::string& s, const char* fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void append(std::string& s, const char* fmt, ...) {
+  char buf[512];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  s += buf;
+}
+
+// "{labels}" or "", with an extra label appended
+static std::string braces(const std::string& labels, const std::string& extra = "") {
+  if (labels.empty() && extra.empty())
+    return "";
+  if (labels.empty() || extra.empty())
+    return "{" + labels + extra + "}";
+  return "{" + labels + "," + extra + "}";
+}
+
+std::string metrics_text() {
+  static MetricGauge* rss = metric_gauge("bnn_resident_bytes",
+      "Resident set size of the process");
+  static MetricGauge* peak_rss = metric_gauge("bnn_peak_resident_bytes",
+      "Peak resident set size of the process");
+  rss->set(resident_bytes());
+  peak_rss->set(peak_resident_bytes());
+
+  static const char* type_names[] = { "counter", "gauge", "histogram" };
+  std::string s;
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  for (unsigned i = 0; i < registry().size(); ++i) {
+    const MetricFamily* f = registry()[i];
+    const char* name = f->name.c_str();
+    append(s, "# HELP %s %s\n", name, f->help.c_str());
+    append(s, "# TYPE %s %s\n", name, type_names[f->type]);
+
+    for (unsigned j = 0; j < f->metrics.size(); ++j) {
+      const std::string& labels = f->labels[j];
+      if (f->type == COUNTER) {
+        const MetricCounter* m = (const MetricCounter*) f->metrics[j];
+        append(s, "%s%s %llu\n", name, braces(labels).c_str(),
+               (unsigned long long) m->value());
+      } else if (f->type == GAUGE) {
+        const MetricGauge* m = (const MetricGauge*) f->metrics[j];
+        append(s, "%s%s %.10g\n", name, braces(labels).c_str(), m->value());
+      } else {
+        const MetricHistogram* m = (const MetricHistogram*) f->metrics[j];
+        const std::vector<double>& b = m->bounds();
+        uint64_t count = 0;
+        char le[64];
+        for (unsigned k = 0; k <= b.size(); ++k) {
+          count += m->bucket(k);
+          if (k < b.size())
+            snprintf(le, sizeof(le), "le=\"%g\"", b[k]);
+          else
+            snprintf(le, sizeof(le), "le=\"+Inf\"");
+          append(s, "%s_bucket%s %llu\n", name, braces(labels, le).c_str(),
+                 (unsigned long long) count);
+        }
+        append(s, "%s_sum%s %.10g\n", name, braces(labels).c_str(), m->sum());
+        append(s, "%s_count%s %llu\n", name, braces(labels).c_str(),
+               (unsigned long long) count);
+      }
+    }
+  }
+  return s;
+}
+
+//---------------------------------------------------------
+// Exporter thread
+//---------------------------------------------------------
+static std::mutex* g_exp_mutex = new std::mutex;
+static std::condition_variable* g_exp_cv = new std::condition_variable;
+static std::thread* g_exporter = NULL;
+static bool g_exp_stop = false;
+static std::string g_path;      // file, or socket path
+static int g_listen_fd = -1;
+static unsigned g_interval_ms = 10000;
+
+static const char* metrics_env() {
+  const char* p = getenv("BNN_METRICS");
+  return (p && *p) ? p : NULL;
+}
+
+bool metrics_enabled() {
+  static const bool on = metrics_env() != NULL;
+  return on;
+}
+
+// writes to a temp file first so that a reader never sees half a dump
+static bool write_file(const std::string& path) {
+  const std::string text = metrics_text();
+  const std::string tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (!f)
+    return false;
+  const bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+  if (fclose(f) != 0 || !ok)
+    return false;
+  return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// A client that does not read must not stall the exporter (and
+// metrics_stop() joining it): each send gives up after the timeout,
+// the whole dump after CLIENT_DEADLINE_MS. MSG_NOSIGNAL turns a
+// closed peer into an error instead of SIGPIPE.
+static const unsigned CLIENT_TIMEOUT_MS = 200;
+static const unsigned CLIENT_DEADLINE_MS = 1000;
+
+static void serve_client(int fd) {
+  timeval tv = { 0, CLIENT_TIMEOUT_MS * 1000 };
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(CLIENT_DEADLINE_MS);
+
+  const std::string text = metrics_text();
+  size_t done = 0;
+  while (done < text.size() && std::chrono::steady_clock::now() < deadline) {
+    ssize_t n = send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+    if (n <= 0)
+      break;
+    done += n;
+  }
+  close(fd);
+}
+
+static void export_loop() {
+  std::unique_lock<std::mutex> lock(*g_exp_mutex);
+  while (!g_exp_stop) {
+    if (g_listen_fd >= 0) {
+      lock.unlock();
+      pollfd p = { g_listen_fd, POLLIN, 0 };
+      if (poll(&p, 1, 200) > 0) {
+        int fd = accept(g_listen_fd, NULL, NULL);
+        if (fd >= 0)
+          serve_client(fd);
+      }
+      lock.lock();
+    } else {
+      g_exp_cv->wait_for(lock, std::chrono::milliseconds(g_interval_ms));
+      if (!g_exp_stop && !write_file(g_path))
+        fprintf(stderr, "**** ERROR: cannot write metrics %s\n", g_path.c_str());
+    }
+  }
+}
+
+static void metrics_stop() {
+  {
+    std::lock_guard<std::mutex> lock(*g_exp_mutex);
+    g_exp_stop = true;
+  }
+  g_exp_cv->notify_all();
+  g_exporter->join();
+  if (g_listen_fd >= 0) {
+    close(g_listen_fd);
+    unlink(g_path.c_str());
+  } else if (!write_file(g_path)) {
+    fprintf(stderr, "**** ERROR: cannot write metrics %s\n", g_path.c_str());
+  }
+}
+
+static int open_listen_socket(const char* path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+  unlink(path);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void metrics_start_from_env() {
+  static std::mutex start_mutex;
+  std::lock_guard<std::mutex> lock(start_mutex);
+  const char* env = metrics_env();
+  if (g_exporter || !env)
+    return;
+
+  const char* interval = getenv("BNN_METRICS_INTERVAL");
+  if (interval && atof(interval) > 0)
+    g_interval_ms = unsigned(atof(interval) * 1000);
+
+  if (strncmp(env, "unix:", 5) == 0) {
+    g_path = env + 5;
+    g_listen_fd = open_listen_socket(g_path.c_str());
+    if (g_listen_fd < 0) {
+      fprintf(stderr, "**** ERROR: cannot listen on metrics socket %s\n", g_path.c_str());
+      return;
+    }
+  } else {
+    g_path = env;
+  }
+  g_exporter = new std::thread(export_loop);
+  atexit(metrics_stop);
+}
@@ -0,0 +1,81 @@
+//---------------------------------------------------------
+// Metrics.h
+//---------------------------------------------------------
+#ifndef __METRICS_H__
+#define __METRICS_H__
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------
+// In-process metrics registry in the Prometheus model:
+// counters, gauges and histograms, each named by a metric
+// name plus an optional label set such as
+// layer="xl-Conv1". Updates are lock-free atomics, so they
+// are always on; the registry itself is only written out
+// when an exporter runs (metrics_start_from_env).
+//
+// - Metrics are created on first lookup and never freed,
+//   call sites keep the pointer in a static
+// - Names, help texts and labels are copied
+//---------------------------------------------------------
+class MetricCounter {
+  std::atomic<uint64_t> m_value;
+  public:
+    MetricCounter() : m_value(0) {}
+    void inc(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+};
+
+class MetricGauge {
+  std::atomic<double> m_value;
+  public:
+    MetricGauge() : m_value(0) {}
+    void set(double v) { m_value.store(v, std::memory_order_relaxed); }
+    void add(double d);
+    double value() const { return m_value.load(std::memory_order_relaxed); }
+};
+
+class MetricHistogram {
+  const std::vector<double> m_bounds;           // upper bucket bounds
+  std::vector<std::atomic<uint64_t> > m_counts; // per bucket, last is +Inf
+  std::atomic<double> m_sum;
+
+  public:
+    MetricHistogram(const std::vector<double>& bounds);
+    void observe(double v);
+
+    const std::vector<double>& bounds() const { return m_bounds; }
+    // observations in bucket i (not cumulative), i = bounds().size() is +Inf
+    uint64_t bucket(unsigned i) const { return m_counts[i].load(std::memory_order_relaxed); }
+    double sum() const { return m_sum.load(std::memory_order_relaxed); }
+};
+
+// Looks up or creates a metric. [labels] is the inside of
+// the label braces, e.g. "layer=\"xl-Conv1\"", or "".
+MetricCounter* metric_counter(const char* name, const char* help,
+                              const std::string& labels = "");
+MetricGauge* metric_gauge(const char* name, const char* help,
+                          const std::string& labels = "");
+// Histograms take [bounds] on creation, the default buckets
+// suit latencies in seconds (10 us to 10 s)
+MetricHistogram* metric_histogram(const char* name, const char* help,
+                                  const std::string& labels = "",
+                                  const std::vector<double>& bounds = std::vector<double>());
+
+// Renders the registry in the Prometheus text format (0.0.4)
+std::string metrics_text();
+
+// True if BNN_METRICS is set
+bool metrics_enabled();
+// Starts the exporter thread named by the environment, once
+// per process, later calls do nothing:
+//   BNN_METRICS=<file>         rewrite the file every interval
+//                              (atomically) and at exit
+//   BNN_METRICS=unix:<path>    serve the text to every client
+//                              that connects to the socket
+//   BNN_METRICS_INTERVAL=<s>   file interval, default 10
+void metrics_start_from_env();
+
+#endif
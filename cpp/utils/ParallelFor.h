@@ -0,0 +1,50 @@
+//---------------------------------------------------------
+// ParallelFor.h
+//---------------------------------------------------------
+#ifndef __PARALLEL_FOR_H__
+#define __PARALLEL_FOR_H__
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+//---------------------------------------------------------
+// Number of worker threads used for host-side parallel
+// work: BNN_THREADS if set, else the number of hardware
+// threads
+//---------------------------------------------------------
+inline unsigned default_threads() {
+  const char* env = getenv("BNN_THREADS");
+  const int n = env ? atoi(env) : (int)std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+//---------------------------------------------------------
+// Calls f(i) for every i in [0, n) on up to n_threads
+// threads, the caller being one of them. Tasks are handed
+// out one at a time in order, so put the big ones first
+// and keep each one reasonably large. Returns when all
+// tasks are done. n_threads 0 means default_threads().
+//---------------------------------------------------------
+template<typename F>
+void parallel_for(unsigned n, unsigned n_threads, F f) {
+  if (n_threads == 0)
+    n_threads = default_threads();
+  if (n_threads > n)
+    n_threads = n;
+
+  std::atomic<unsigned> next(0);
+  auto worker = [&]() {
+    for (unsigned i = next++; i < n; i = next++)
+      f(i);
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < n_threads; ++t)
+    threads.push_back(std::thread(worker));
+  worker();
+  for (unsigned t = 0; t < threads.size(); ++t)
+    threads[t].join();
+}
+
+#endif
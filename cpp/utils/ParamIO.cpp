@@ -1,34 +1,67 @@
 #include <assert.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 #include "ParamIO.h"
 #include "ZipIO.h"
 #include "Common.h"
 
+Params::Params()
+  : m_arrays(0)
+{
+}
+
 Params::Params(std::string zipfile)
   : m_filename(zipfile),
     m_arrays(0)
 {
+  if (!load(zipfile))
+    exit(-1);
+}
+
+bool Params::load(std::string zipfile) {
+  assert(m_arrays == 0);
+  m_filename = zipfile;
+
   // Open file
   DB_PRINT(2, "Opening params archive %s\n", m_filename.c_str());
-  unzFile ar = open_unzip(m_filename);
+  unzFile ar = try_open_unzip(m_filename);
+  if (ar == NULL) {
+    fprintf(stderr, "Error opening %s\n", m_filename.c_str());
+    return false;
+  }
 
   // Get number of files in the archive
-  m_arrays = get_nfiles_in_unzip(ar);
-  DB_PRINT(2, "Number of param arrays: %u\n", m_arrays);
-  assert(m_arrays <= MAX_LAYERS);
+  unz_global_info info;
+  bool ok = unzGetGlobalInfo(ar, &info) == UNZ_OK &&
+            info.number_entry <= MAX_LAYERS;
+  const unsigned n_arrays = ok ? info.number_entry : 0;
+  DB_PRINT(2, "Number of param arrays: %u\n", n_arrays);
 
-  // Read each array
-  for (unsigned i = 0; i < m_arrays; ++i) {
-    unsigned fsize = get_current_file_size(ar);
+  // Read each array, a short read or a CRC mismatch is an error
+  for (unsigned i = 0; ok && i < n_arrays; ++i) {
+    unz_file_info finfo;
+    ok = unzGetCurrentFileInfo(ar, &finfo, NULL, 0, NULL, 0, NULL, 0) == UNZ_OK &&
+         finfo.uncompressed_size > 0 && finfo.uncompressed_size % 4 == 0;
+    if (!ok)
+      break;
+    const unsigned fsize = finfo.uncompressed_size;
     m_array_size[i] = fsize;  // size in bytes
-    
     m_data[i] = new float[fsize/4];
-    read_current_file(ar, (void*)m_data[i], fsize);
-    
-    unzGoToNextFile(ar);
+    m_arrays = i+1;
+
+    ok = unzOpenCurrentFile(ar) == UNZ_OK;
+    ok = ok && unzReadCurrentFile(ar, (void*)m_data[i], fsize) == (int)fsize;
+    ok = (unzCloseCurrentFile(ar) == UNZ_OK) && ok;
+    if (ok && i+1 < n_arrays)
+      ok = unzGoToNextFile(ar) == UNZ_OK;
   }
 
   unzClose(ar);
+  if (!ok)
+    fprintf(stderr, "%s: corrupt params archive\n", m_filename.c_str());
+  return ok;
 }
 
 Params::~Params() {
@@ -36,3 +69,133 @@ Params::~Params() {
     delete[] m_data[i];
 }
 
+
+//------------------------------------------------------------------------
+// Packed archives
+//------------------------------------------------------------------------
+PackedParams::PackedParams()
+  : m_buf(NULL),
+    m_bytes(0)
+{
+}
+
+PackedParams::PackedParams(std::string filename)
+  : m_filename(filename),
+    m_buf(NULL),
+    m_bytes(0)
+{
+  if (!load(filename))
+    exit(-1);
+}
+
+bool PackedParams::load(std::string filename) {
+  assert(m_buf == NULL);
+  m_filename = filename;
+  DB_PRINT(2, "Opening packed params %s\n", m_filename.c_str());
+  FILE* f = fopen(m_filename.c_str(), "rb");
+  if (f == NULL) {
+    fprintf(stderr, "Error opening %s\n", m_filename.c_str());
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  m_bytes = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  // one read of the whole file into a Word aligned buffer
+  m_buf = new uint64_t[(m_bytes + 7) / 8];
+  const size_t got = fread(m_buf, 1, m_bytes, f);
+  fclose(f);
+
+  const char* base = (const char*)m_buf;
+  if (got != m_bytes || m_bytes < sizeof(PackedHeader)) {
+    fprintf(stderr, "Error reading %s\n", m_filename.c_str());
+    return false;
+  }
+  memcpy(&m_header, base, sizeof(PackedHeader));
+  if (memcmp(m_header.magic, PACKED_MAGIC, sizeof(PACKED_MAGIC)) != 0 ||
+      m_header.version != PACKED_VERSION || m_header.word_bits != 64) {
+    fprintf(stderr, "%s: not a version %u packed params archive\n",
+        m_filename.c_str(), PACKED_VERSION);
+    return false;
+  }
+
+  const size_t table_end = sizeof(PackedHeader) +
+                           m_header.n_arrays * sizeof(PackedArrayInfo);
+  if (table_end > m_bytes) {
+    fprintf(stderr, "%s: truncated array table\n", m_filename.c_str());
+    return false;
+  }
+  m_arrays.resize(m_header.n_arrays);
+  for (unsigned i = 0; i < m_header.n_arrays; ++i) {
+    PackedArray& a = m_arrays[i];
+    memcpy(&a.info, base + sizeof(PackedHeader) + i*sizeof(PackedArrayInfo),
+           sizeof(PackedArrayInfo));
+    // offset >= table_end and table_end <= m_bytes, so the subtraction
+    // cannot wrap where a sum of two crafted fields could
+    if (a.info.offset % 8 != 0 || a.info.offset < table_end ||
+        a.info.offset > m_bytes || a.info.bytes > m_bytes - a.info.offset) {
+      fprintf(stderr, "%s: array %u out of bounds\n", m_filename.c_str(), i);
+      return false;
+    }
+    a.data = base + a.info.offset;
+    DB_PRINT(3, "Layer %u kind %u: %lu bytes\n", a.info.layer, a.info.kind,
+        (unsigned long)a.info.bytes);
+  }
+  return true;
+}
+
+PackedParams::~PackedParams() {
+  delete[] m_buf;
+}
+
+const PackedArray* PackedParams::find(unsigned layer, unsigned kind) const {
+  for (unsigned i = 0; i < m_arrays.size(); ++i)
+    if (m_arrays[i].info.layer == layer && m_arrays[i].info.kind == kind)
+      return &m_arrays[i];
+  return NULL;
+}
+
+bool PackedParams::is_packed(std::string filename) {
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (f == NULL)
+    return false;
+  char magic[sizeof(PACKED_MAGIC)];
+  const bool packed = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                      memcmp(magic, PACKED_MAGIC, sizeof(magic)) == 0;
+  fclose(f);
+  return packed;
+}
+
+bool write_packed_params(std::string filename,
+                         const std::vector<PackedArray>& arrays) {
+  FILE* f = fopen(filename.c_str(), "wb");
+  if (f == NULL)
+    return false;
+
+  PackedHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PACKED_MAGIC, sizeof(PACKED_MAGIC));
+  header.version = PACKED_VERSION;
+  header.n_arrays = arrays.size();
+  header.word_bits = 64;
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+  // the table, with the data offsets rounded up to 8 bytes
+  uint64_t offset = sizeof(PackedHeader) + arrays.size()*sizeof(PackedArrayInfo);
+  for (unsigned i = 0; i < arrays.size(); ++i) {
+    PackedArrayInfo info = arrays[i].info;
+    info.offset = offset;
+    ok = ok && fwrite(&info, sizeof(info), 1, f) == 1;
+    offset += (info.bytes + 7) / 8 * 8;
+  }
+
+  const char pad[8] = {0};
+  for (unsigned i = 0; i < arrays.size(); ++i) {
+    const uint64_t bytes = arrays[i].info.bytes;
+    ok = ok && fwrite(arrays[i].data, 1, bytes, f) == bytes;
+    ok = ok && fwrite(pad, 1, (8 - bytes % 8) % 8, f) == (8 - bytes % 8) % 8;
+  }
+
+  ok = (fclose(f) == 0) && ok;
+  return ok;
+}
@@ -7,6 +7,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 #include "../minizip/unzip.h"
 #include "Debug.h"
 
@@ -24,8 +25,14 @@ struct Params {
   public:
     // Read a zip archive containing NN params. We make the assumption
     // that each file in the archive is one array. The data is stored
-    // as just an array of bytes
+    // as just an array of bytes. Exits on a missing or corrupt archive.
     Params(std::string zipfile);
+    // An empty set of params for load()
+    Params();
+    // Reads [zipfile] like the constructor, but reports a missing or
+    // corrupt archive (bad sizes, inflate or CRC errors) by returning
+    // false instead of exiting. Library code loads through this.
+    bool load(std::string zipfile);
     // Safely deletes params
     ~Params();
 
@@ -45,4 +52,80 @@ struct Params {
     }
 };
 
+//------------------------------------------------------------------------
+// Packed model archive (.bnn). Holds each layer's params already
+// binarized and packed into the 64-bit Word layouts the accelerator
+// takes, so loading is one read and a copy per array instead of
+// inflating and converting 32-bit floats.
+//
+// Layout, all fields native (little) endian:
+//   PackedHeader
+//   PackedArrayInfo x n_arrays
+//   array data, each starting on an 8 byte boundary at info.offset
+//------------------------------------------------------------------------
+const char PACKED_MAGIC[8] = {'B','N','N','P','A','C','K','\0'};
+const unsigned PACKED_VERSION = 1;
+
+// kinds of packed arrays
+enum PackedKind {
+  PACKED_WT = 0,  // binarized weights, Words as set_weight_array
+  PACKED_KH = 1,  // thresholds / k,h pairs, Words as set_bnorm_array
+  PACKED_K  = 2,  // float batch norm k, kept for the CPU dense paths
+  PACKED_H  = 3   // float batch norm h
+};
+
+struct PackedHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t n_arrays;
+  uint32_t word_bits;   // 64
+  uint32_t reserved;
+};
+
+struct PackedArrayInfo {
+  uint32_t layer;       // 1-based layer index
+  uint32_t kind;        // PackedKind
+  uint32_t M, N;        // layer inputs and outputs
+  uint64_t offset;      // of the data from the start of the file
+  uint64_t bytes;
+};
+
+struct PackedArray {
+  PackedArrayInfo info;
+  const void* data;
+};
+
+class PackedParams {
+  std::string m_filename;
+  uint64_t* m_buf;
+  size_t m_bytes;
+  PackedHeader m_header;
+  std::vector<PackedArray> m_arrays;
+
+  public:
+    // Reads a packed archive, exits on a missing or malformed file
+    PackedParams(std::string filename);
+    // An empty archive for load()
+    PackedParams();
+    // Reads a packed archive, returns false on a missing or malformed
+    // file instead of exiting
+    bool load(std::string filename);
+    ~PackedParams();
+
+    unsigned version() const { return m_header.version; }
+    unsigned num_arrays() const { return m_arrays.size(); }
+    const PackedArray& array(unsigned i) const { return m_arrays[i]; }
+    // The array of [kind] for [layer], NULL if the archive has none
+    const PackedArray* find(unsigned layer, unsigned kind) const;
+    // Size of the archive in bytes
+    size_t bytes() const { return m_bytes; }
+
+    // True if [filename] starts with the packed magic
+    static bool is_packed(std::string filename);
+};
+
+// Writes [arrays] as a packed archive, false on an I/O error
+bool write_packed_params(std::string filename,
+                         const std::vector<PackedArray>& arrays);
+
 #endif
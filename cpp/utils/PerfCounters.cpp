@@ -0,0 +1,166 @@
+//---------------------------------------------------------
+// PerfCounters.cpp
+//---------------------------------------------------------
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "PerfCounters.h"
+#include "Timer.h"
+
+struct PerfEventDesc {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+static const PerfEventDesc event_tab[N_PERF_EVENTS] = {
+  { "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { "l1d_misses",    PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+  { "llc_misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  { "task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+
+static bool g_available[N_PERF_EVENTS];
+
+// the counters of one thread, closed when the thread exits
+struct PerfThread {
+  int fd[N_PERF_EVENTS];
+  int err[N_PERF_EVENTS];   // errno of a failed open
+
+  PerfThread() {
+    for (unsigned e = 0; e < N_PERF_EVENTS; ++e) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = event_tab[e].type;
+      attr.config = event_tab[e].config;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                         PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fd[e] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      err[e] = fd[e] < 0 ? errno : 0;
+    }
+  }
+  ~PerfThread() {
+    for (unsigned e = 0; e < N_PERF_EVENTS; ++e)
+      if (fd[e] >= 0)
+        close(fd[e]);
+  }
+};
+
+static PerfThread& perf_thread() {
+  static thread_local PerfThread t;
+  return t;
+}
+
+// opens the counters of the first thread, which decide availability
+static bool perf_init() {
+  const char* env = getenv("BNN_PERF");
+  if (!env || !*env || !strcmp(env, "0"))
+    return false;
+
+  const PerfThread& t = perf_thread();
+  unsigned n_open = 0;
+  for (unsigned e = 0; e < N_PERF_EVENTS; ++e) {
+    g_available[e] = (t.fd[e] >= 0);
+    n_open += g_available[e];
+  }
+  if (n_open == 0) {
+    fprintf(stderr, "**** WARNING: BNN_PERF: perf_event_open failed (%s), "
+            "counters are off\n", strerror(t.err[PERF_CYCLES]));
+    return false;
+  }
+  for (unsigned e = 0; e < N_PERF_EVENTS; ++e)
+    if (!g_available[e])
+      fprintf(stderr, "**** WARNING: BNN_PERF: no %s counter (%s)\n",
+              event_tab[e].name, strerror(t.err[e]));
+  return true;
+}
+
+bool perf_enabled() {
+  static const bool on = perf_init();
+  return on;
+}
+
+bool perf_available(unsigned e) {
+  return perf_enabled() && g_available[e];
+}
+
+const char* perf_event_name(unsigned e) {
+  return event_tab[e].name;
+}
+
+void perf_read(PerfReading& r) {
+  const PerfThread& t = perf_thread();
+  for (unsigned e = 0; e < N_PERF_EVENTS; ++e) {
+    uint64_t buf[3] = { 0, 0, 0 };
+    if (t.fd[e] >= 0 && read(t.fd[e], buf, sizeof(buf)) != sizeof(buf))
+      buf[0] = buf[1] = buf[2] = 0;
+    r.value[e] = buf[0];
+    r.enabled[e] = buf[1];
+    r.running[e] = buf[2];
+  }
+}
+
+void perf_add(const PerfReading& start, const PerfReading& stop,
+              double totals[N_PERF_EVENTS]) {
+  for (unsigned e = 0; e < N_PERF_EVENTS; ++e) {
+    const uint64_t running = stop.running[e] - start.running[e];
+    if (running == 0)
+      continue;
+    const double enabled = stop.enabled[e] - start.enabled[e];
+    totals[e] += double(stop.value[e] - start.value[e]) * enabled / running;
+  }
+}
+
+//---------------------------------------------------------
+// Report, counters that did not open are printed as "-"
+//---------------------------------------------------------
+static void print_count(unsigned e, double count) {
+  if (perf_available(e))
+    printf(" %12.0f", count);
+  else
+    printf(" %12s", "-");
+}
+
+void perf_print_timers(unsigned n_images) {
+  if (!perf_enabled() || n_images == 0)
+    return;
+
+  printf("## Performance counters per image (%u images) ##\n", n_images);
+  printf("%-14s %8s %12s %12s %6s %12s %12s %12s %9s\n", "timer", "calls",
+         "cycles", "instrs", "IPC", "L1D-miss", "LLC-miss", "br-miss", "cpu-ms");
+  for (Timer* t = Timer::first(); t; t = t->next()) {
+    if (t->get_calls() == 0)
+      continue;
+    double c[N_PERF_EVENTS];
+    for (unsigned e = 0; e < N_PERF_EVENTS; ++e)
+      c[e] = t->get_perf(e) / n_images;
+
+    printf("%-14s %8u", t->get_name(), t->get_calls());
+    print_count(PERF_CYCLES, c[PERF_CYCLES]);
+    print_count(PERF_INSTRUCTIONS, c[PERF_INSTRUCTIONS]);
+    if (perf_available(PERF_CYCLES) && perf_available(PERF_INSTRUCTIONS) &&
+        c[PERF_CYCLES] > 0)
+      printf(" %6.2f", c[PERF_INSTRUCTIONS] / c[PERF_CYCLES]);
+    else
+      printf(" %6s", "-");
+    print_count(PERF_L1D_MISSES, c[PERF_L1D_MISSES]);
+    print_count(PERF_LLC_MISSES, c[PERF_LLC_MISSES]);
+    print_count(PERF_BRANCH_MISSES, c[PERF_BRANCH_MISSES]);
+    if (perf_available(PERF_TASK_CLOCK))
+      printf(" %9.3f\n", c[PERF_TASK_CLOCK] * 1e-6);
+    else
+      printf(" %9s\n", "-");
+  }
+}
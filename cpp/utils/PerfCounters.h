@@ -0,0 +1,55 @@
+//---------------------------------------------------------
+// PerfCounters.h
+//---------------------------------------------------------
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+#include <stdint.h>
+
+//---------------------------------------------------------
+// CPU performance counters of the calling thread, read
+// with perf_event_open around every Timer region. They are
+// off unless BNN_PERF=1. Then each thread opens its own
+// counters on first use, user space only, each counter on
+// its own so that a missing one (no PMU in a VM, an event
+// the CPU lacks) only drops that counter. Counts are
+// scaled for the time the kernel multiplexed them out.
+//
+// If no counter can be opened (no perf support or a too
+// strict perf_event_paranoid) a warning is printed once
+// and the timers run without counters.
+//---------------------------------------------------------
+enum PerfEvent {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_L1D_MISSES,      // L1 data cache read misses
+  PERF_LLC_MISSES,      // last level cache misses
+  PERF_BRANCH_MISSES,
+  PERF_TASK_CLOCK,      // ns on the cpu, a software event
+  N_PERF_EVENTS
+};
+
+// Raw counter values, enabled and running times
+struct PerfReading {
+  uint64_t value[N_PERF_EVENTS];
+  uint64_t enabled[N_PERF_EVENTS];
+  uint64_t running[N_PERF_EVENTS];
+};
+
+// True if BNN_PERF is set and at least one counter opened
+bool perf_enabled();
+// True if counter [e] opened in the first thread
+bool perf_available(unsigned e);
+// Short name of counter [e], e.g. "l1d_misses"
+const char* perf_event_name(unsigned e);
+
+// Reads the counters of the calling thread
+void perf_read(PerfReading& r);
+// Adds the scaled counts between [start] and [stop] to [totals]
+void perf_add(const PerfReading& start, const PerfReading& stop,
+              double totals[N_PERF_EVENTS]);
+
+// Prints calls, IPC and the counts per image of every timer
+// that ran, for a run of [n_images] images
+void perf_print_timers(unsigned n_images);
+
+#endif
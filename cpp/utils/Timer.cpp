@@ -2,12 +2,17 @@
 // Timer.cpp
 //---------------------------------------------------------
 #include "Timer.h"
+#include "Metrics.h"
 
 #ifdef TIMER_ON
 //---------------------------------------------------------
 // Timer is active
 //---------------------------------------------------------
 
+// head of the list of live timers, a plain pointer so that it is
+// valid before and after any static constructor or destructor
+static Timer* timer_list = NULL;
+
 Timer::Timer(const char* Name, bool On) {
   if (On) {
     // record the start time
@@ -18,10 +23,22 @@ Timer::Timer(const char* Name, bool On) {
     nCalls = 0;
   }
   totalTime = 0;	
-  strcpy(binName, Name);
+  memset(perfTotal, 0, sizeof(perfTotal));
+  histogram = NULL;
+  strncpy(binName, Name, sizeof(binName)-1);
+  binName[sizeof(binName)-1] = 0;
+  nextTimer = timer_list;
+  timer_list = this;
 }
 
 Timer::~Timer() {
+  for (Timer** t = &timer_list; *t; t = &(*t)->nextTimer) {
+    if (*t == this) {
+      *t = nextTimer;
+      break;
+    }
+  }
+
   // on being destroyed, print the average and total time
   if (nCalls > 0) {
     printf ("%-20s: ", binName);
@@ -37,6 +54,8 @@ Timer::~Timer() {
 
 void Timer::start() {
   // record start time
+  if (perf_enabled())
+    perf_read(perfStart);
   gettimeofday(&ts_start, NULL);
   nCalls++;
 }
@@ -45,14 +64,47 @@ void Timer::stop() {
   // get current time, add elapsed time to totalTime
   timeval ts_curr;
   gettimeofday(&ts_curr, NULL);
-  totalTime += float(ts_curr.tv_sec - ts_start.tv_sec) +
-               float(ts_curr.tv_usec)*1e-6 - float(ts_start.tv_usec)*1e-6;
+  if (perf_enabled()) {
+    PerfReading perfStop;
+    perf_read(perfStop);
+    perf_add(perfStart, perfStop, perfTotal);
+  }
+  const float elapsed = float(ts_curr.tv_sec - ts_start.tv_sec) +
+                        float(ts_curr.tv_usec)*1e-6 - float(ts_start.tv_usec)*1e-6;
+  totalTime += elapsed;
+  if (metrics_enabled()) {
+    if (!histogram)
+      histogram = metric_histogram("bnn_timer_seconds",
+          "Duration of each call of a Timer region",
+          std::string("timer=\"") + binName + "\"");
+    histogram->observe(elapsed);
+  }
 }
 
 float Timer::get_time() {
   return totalTime;
 }
 
+unsigned Timer::get_calls() {
+  return nCalls;
+}
+
+const char* Timer::get_name() {
+  return binName;
+}
+
+double Timer::get_perf(unsigned e) {
+  return perfTotal[e];
+}
+
+Timer* Timer::first() {
+  return timer_list;
+}
+
+Timer* Timer::next() {
+  return nextTimer;
+}
+
 #else
 //---------------------------------------------------------
 // Timer turned off, methods do nothing
@@ -73,4 +125,24 @@ float Timer::get_time() {
   return 0;
 }
 
+unsigned Timer::get_calls() {
+  return 0;
+}
+
+const char* Timer::get_name() {
+  return "";
+}
+
+double Timer::get_perf(unsigned e) {
+  return 0;
+}
+
+Timer* Timer::first() {
+  return NULL;
+}
+
+Timer* Timer::next() {
+  return NULL;
+}
+
 #endif
@@ -7,6 +7,9 @@
 #include <sys/time.h>
 #include <string.h>
 #include <stdio.h>
+#include "PerfCounters.h"
+
+class MetricHistogram;
 
 #define TIMER_ON
 
@@ -18,6 +21,10 @@
 // - Passing True to the constructor starts the timer when
 //   it is constructed
 // - When the timer is destructed it prints stats to stdout
+// - With BNN_PERF set the timer also sums the CPU counters
+//   of the calling thread (PerfCounters.h) over its calls
+// - With BNN_METRICS set each call is also recorded in a
+//   latency histogram of the metrics registry (Metrics.h)
 //---------------------------------------------------------
 class Timer {
 
@@ -27,6 +34,12 @@ class Timer {
     unsigned nCalls;
     timeval ts_start;
     float totalTime;
+    Timer* nextTimer;
+    // counters at start() and totals, with BNN_PERF set
+    PerfReading perfStart;
+    double perfTotal[N_PERF_EVENTS];
+    // bnn_timer_seconds{timer=binName}, with BNN_METRICS set
+    MetricHistogram* histogram;
 
   #endif
     
@@ -42,6 +55,17 @@ class Timer {
 
       // returns time in seconds
       float get_time();
+      // returns the number of times the timer was started
+      unsigned get_calls();
+      const char* get_name();
+      // returns the total of PerfEvent [e] over all calls
+      double get_perf(unsigned e);
+
+      // All live timers form a list, newest first, so that tools can
+      // report every timer without knowing where it is defined. Timers
+      // join it on construction, which for most of them is static init.
+      static Timer* first();
+      Timer* next();
 };
 
 #endif
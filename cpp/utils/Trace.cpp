@@ -0,0 +1,149 @@
+//---------------------------------------------------------
+// Trace.cpp
+//---------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Trace.h"
+
+struct TraceEvent {
+  const char* name;
+  const char* cat;
+  uint64_t start, dur;  // ns
+  unsigned nargs;
+  const char* keys[TRACE_MAX_ARGS];
+  int64_t vals[TRACE_MAX_ARGS];
+};
+
+// the events of one thread, appended only by that thread
+struct ThreadBuffer {
+  long tid;
+  std::string name;
+  std::mutex mutex;     // against trace_write
+  std::vector<TraceEvent> events;
+};
+
+// never freed, so that they are valid in exit handlers
+static std::mutex* g_mutex = new std::mutex;
+static std::vector<ThreadBuffer*>* g_buffers = new std::vector<ThreadBuffer*>;
+static thread_local ThreadBuffer* tl_buffer = NULL;
+static uint64_t g_origin = 0;
+
+static uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* trace_path() {
+  const char* p = getenv("BNN_TRACE");
+  return (p && *p) ? p : NULL;
+}
+
+static void write_at_exit() {
+  if (!trace_write(trace_path()))
+    fprintf(stderr, "**** ERROR: cannot write trace %s\n", trace_path());
+}
+
+static bool trace_init() {
+  if (!trace_path())
+    return false;
+  g_origin = now_ns();
+  atexit(write_at_exit);
+  return true;
+}
+
+bool trace_enabled() {
+  static const bool on = trace_init();
+  return on;
+}
+
+static ThreadBuffer* thread_buffer() {
+  if (!tl_buffer) {
+    ThreadBuffer* b = new ThreadBuffer;
+    b->tid = syscall(SYS_gettid);
+    if (b->tid == getpid())
+      b->name = "main";
+    std::lock_guard<std::mutex> lock(*g_mutex);
+    g_buffers->push_back(b);
+    tl_buffer = b;
+  }
+  return tl_buffer;
+}
+
+void trace_thread_name(const char* name) {
+  if (!trace_enabled())
+    return;
+  ThreadBuffer* b = thread_buffer();
+  std::lock_guard<std::mutex> lock(b->mutex);
+  b->name = name;
+}
+
+//---------------------------------------------------------
+// Scopes
+//---------------------------------------------------------
+TraceScope::TraceScope(const char* name, const char* cat)
+  : m_name(name), m_cat(cat), m_start(0), m_nargs(0)
+{
+  if (trace_enabled())
+    m_start = now_ns();
+}
+
+TraceScope::~TraceScope() {
+  if (!m_start)
+    return;
+  TraceEvent e;
+  e.name = m_name;
+  e.cat = m_cat;
+  e.start = m_start;
+  e.dur = now_ns() - m_start;
+  e.nargs = m_nargs;
+  for (unsigned i = 0; i < m_nargs; ++i) {
+    e.keys[i] = m_keys[i];
+    e.vals[i] = m_vals[i];
+  }
+  ThreadBuffer* b = thread_buffer();
+  std::lock_guard<std::mutex> lock(b->mutex);
+  b->events.push_back(e);
+}
+
+//---------------------------------------------------------
+// Output, timestamps in microseconds from the first event
+//---------------------------------------------------------
+bool trace_write(const char* path) {
+  FILE* f = path ? fopen(path, "w") : NULL;
+  if (!f)
+    return false;
+
+  const int pid = getpid();
+  bool first = true;
+  fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  std::lock_guard<std::mutex> glock(*g_mutex);
+  for (unsigned t = 0; t < g_buffers->size(); ++t) {
+    ThreadBuffer* b = (*g_buffers)[t];
+    std::lock_guard<std::mutex> lock(b->mutex);
+    if (!b->name.empty()) {
+      fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %ld, "
+              "\"args\": {\"name\": \"%s\"}}", first ? "" : ",\n", pid, b->tid, b->name.c_str());
+      first = false;
+    }
+    for (unsigned i = 0; i < b->events.size(); ++i) {
+      const TraceEvent& e = b->events[i];
+      fprintf(f, "%s{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, "
+              "\"dur\": %.3f, \"pid\": %d, \"tid\": %ld, \"args\": {",
+          first ? "" : ",\n", e.name, e.cat, (e.start - g_origin) * 1e-3,
+          e.dur * 1e-3, pid, b->tid);
+      for (unsigned j = 0; j < e.nargs; ++j)
+        fprintf(f, "%s\"%s\": %lld", j ? ", " : "", e.keys[j], (long long)e.vals[j]);
+      fprintf(f, "}}");
+      first = false;
+    }
+  }
+  fprintf(f, "\n]}\n");
+  return fclose(f) == 0;
+}
@@ -0,0 +1,54 @@
+//---------------------------------------------------------
+// Trace.h
+//---------------------------------------------------------
+#ifndef __TRACE_H__
+#define __TRACE_H__
+#include <stdint.h>
+
+//---------------------------------------------------------
+// Event tracer writing the Chrome trace-event JSON format
+// (chrome://tracing, ui.perfetto.dev). It is off unless
+// BNN_TRACE names an output file. Then every TraceScope
+// records one complete event (begin time and duration) with
+// its category, args and thread, and the events of all
+// threads are written to the file when the process exits.
+//
+// - Names, categories and arg keys must be string literals
+//   or otherwise outlive the process
+// - Each thread appends to its own buffer, events of a
+//   thread that has exited are kept
+// - When tracing is off a scope costs one test of a flag
+//---------------------------------------------------------
+const unsigned TRACE_MAX_ARGS = 6;
+
+class TraceScope {
+  const char* m_name;
+  const char* m_cat;
+  uint64_t m_start;     // ns, 0 when tracing is off
+  unsigned m_nargs;
+  const char* m_keys[TRACE_MAX_ARGS];
+  int64_t m_vals[TRACE_MAX_ARGS];
+
+  public:
+    TraceScope(const char* name, const char* cat);
+    ~TraceScope();
+
+    // attaches an integer arg to the event, extra args are dropped
+    TraceScope& arg(const char* key, int64_t value) {
+      if (m_start && m_nargs < TRACE_MAX_ARGS) {
+        m_keys[m_nargs] = key;
+        m_vals[m_nargs++] = value;
+      }
+      return *this;
+    }
+};
+
+// True if BNN_TRACE is set
+bool trace_enabled();
+// Names the calling thread in the trace (e.g. "input-stage")
+void trace_thread_name(const char* name);
+// Writes all events recorded so far to [path], done at exit
+// with the BNN_TRACE file. False on an I/O error.
+bool trace_write(const char* path);
+
+#endif
@@ -1,11 +1,88 @@
 #include <assert.h>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "ZipIO.h"
 #include "Debug.h"
+#include "../minizip/ioapi_buf.h"
+#include "../minizip/ioapi_mem.h"
 
 //------------------------------------------------------------------------
+// Archives are mapped whole and read through minizip's ioapi_mem, so
+// reading a member is a copy out of the page cache rather than a chain
+// of buffered fseek/fread calls. Sources that cannot be mapped (pipes,
+// empty files) are read through ioapi_buf over stdio instead.
+//------------------------------------------------------------------------
+struct MappedArchive {
+  ourmemory_t mem;    // first, the mem functions take it as opaque
+  size_t bytes;
+};
+
+// unzip opens the archive twice but ioapi_mem hands back the same
+// stream, so this runs once per archive
+static int ZCALLBACK close_mapped(voidpf opaque, voidpf stream) {
+  MappedArchive* m = (MappedArchive*)opaque;
+  munmap(m->mem.base, m->bytes);
+  delete m;
+  return 0;
+}
+
+static unzFile open_mapped(const std::string& filename) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  void* base = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return NULL;
+  madvise(base, st.st_size, MADV_WILLNEED);
+
+  MappedArchive* m = new MappedArchive;
+  memset(&m->mem, 0, sizeof(m->mem));
+  m->mem.base = (char*)base;
+  m->mem.size = st.st_size;
+  m->bytes = st.st_size;
+
+  zlib_filefunc_def ff;
+  fill_memory_filefunc(&ff, &m->mem);
+  ff.zclose_file = close_mapped;
+  ff.opaque = m;
+  // on failure unzip has already closed (and so unmapped) the stream
+  return unzOpen2(filename.c_str(), &ff);
+}
+
+static ourbuffer_t stdio_filefuncs() {
+  ourbuffer_t funcs;
+  fill_fopen_filefunc(&funcs.filefunc);
+  fill_fopen64_filefunc(&funcs.filefunc64);
+  return funcs;
+}
+
+static unzFile open_buffered(const std::string& filename) {
+  // ioapi_buf keeps a pointer to the functions it wraps
+  static ourbuffer_t stdio_funcs = stdio_filefuncs();
+
+  zlib_filefunc_def ff;
+  fill_buffer_filefunc(&ff, &stdio_funcs);
+  return unzOpen2(filename.c_str(), &ff);
+}
+
+//------------------------------------------------------------------------
+unzFile try_open_unzip(const std::string filename) {
+  unzFile ar = open_mapped(filename);
+  if (ar == NULL)
+    ar = open_buffered(filename);
+  return ar;
+}
+
 unzFile open_unzip(const std::string filename) {
-  unzFile ar = unzOpen(filename.c_str());
+  unzFile ar = try_open_unzip(filename);
   if (ar == NULL) {
     fprintf(stderr, "Error opening %s\n", filename.c_str());
     exit(-1);
@@ -37,10 +114,20 @@ unsigned get_current_file_size(unzFile ar) {
 }
 
 //------------------------------------------------------------------------
-void read_current_file(unzFile ar, void* buffer, unsigned bytes) {
+void read_current_file(unzFile ar, void* buffer, unsigned bytes, unsigned offset) {
   int err = unzOpenCurrentFile(ar);
   assert(!err);
 
+  if (offset) {
+    char skip[1 << 16];
+    while (offset) {
+      const unsigned n = (offset < sizeof(skip)) ? offset : sizeof(skip);
+      unsigned b = unzReadCurrentFile(ar, skip, n);
+      assert(b == n);
+      offset -= n;
+    }
+  }
+
   unsigned b = unzReadCurrentFile(ar, buffer, bytes);
   assert(b == bytes);
 
@@ -6,14 +6,19 @@
 #include <string>
 #include "../minizip/zip.h"
 #include "../minizip/unzip.h"
+#include "BitPack.h"
 
 //------------------------------------------------------------------------
 // Functions for reading a zip archive
 //------------------------------------------------------------------------
 unzFile open_unzip(const std::string filename);
+// Same as open_unzip but returns NULL instead of exiting
+unzFile try_open_unzip(const std::string filename);
 unsigned get_nfiles_in_unzip(unzFile ar);
 unsigned get_current_file_size(unzFile ar);
-void read_current_file(unzFile ar, void* buffer, unsigned bytes);
+// Reads [bytes] bytes of the current file starting at byte [offset],
+// the bytes before it are inflated and dropped
+void read_current_file(unzFile ar, void* buffer, unsigned bytes, unsigned offset=0);
 
 //------------------------------------------------------------------------
 // Writes a buffer to a new file with name [fname] inside the 
@@ -80,8 +85,15 @@ void bitarray_to_zip(std::string filename, T buf[], unsigned n_elems) {
 
   // copy the array data to an array of float
   float* data = new float[n_elems];
-  for (unsigned i = 0; i < n_elems; ++i) {
-    data[i] = (buf[i/elem_size][i%elem_size] == 0) ? 1.0 : -1.0;
+  if (elem_size == 64) {
+    for (unsigned i = 0; i < n_elems; i += 64) {
+      const uint64_t wrd = buf[i/64].to_uint64();
+      unpack_signs(data + i, &wrd, (n_elems - i < 64) ? n_elems - i : 64);
+    }
+  } else {
+    for (unsigned i = 0; i < n_elems; ++i) {
+      data[i] = (buf[i/elem_size][i%elem_size] == 0) ? 1.0 : -1.0;
+    }
   }
   // store the array of float
   write_buffer_to_zip(ar, "arr_0", (void*)data, n_elems*sizeof(float));
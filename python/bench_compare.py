@@ -0,0 +1,193 @@
+#!/usr/bin/env python
+#-------------------------------------------------------------------------
+# Compares a benchmark report with a baseline and fails on regressions.
+#
+# Both files are BenchReport JSON (cpp/utils/BenchReport.h) as written
+# by bnn_bench.exe, from end-to-end metrics such as images_per_s down to
+# the per-layer kernel times (layer.*). Each metric carries one sample
+# per measured run. The change of a metric is taken in its "worse"
+# direction, relative to the baseline mean, with a Welch confidence
+# interval over the samples of both runs. A metric regresses only when
+# the whole interval lies beyond the threshold, so a noisy metric needs
+# more samples (bnn_bench -r) to fail or pass with confidence. Metrics
+# with a single sample (startup times, RSS) are reported but do not fail
+# the run unless --min-samples is 1.
+# A metric whose baseline is 0 (an error rate, say) has no relative
+# change, any worsening of it beyond the interval is a regression.
+#
+#   bench_compare.py [options] <baseline.json> <current.json>
+#
+# Exits 0 when nothing regressed, 1 on a regression, 2 on bad input.
+# To store a new baseline copy the current report over it.
+#-------------------------------------------------------------------------
+from __future__ import print_function
+import argparse, json, math, re, sys
+
+# two-sided Student t quantiles for 1..30 degrees of freedom, then normal
+T_TABLE = {
+  0.90: [6.314, 2.920, 2.353, 2.132, 2.015, 1.943, 1.895, 1.860, 1.833, 1.812,
+         1.796, 1.782, 1.771, 1.761, 1.753, 1.746, 1.740, 1.734, 1.729, 1.725,
+         1.721, 1.717, 1.714, 1.711, 1.708, 1.706, 1.703, 1.701, 1.699, 1.697],
+  0.95: [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+         2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+         2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042],
+  0.99: [63.657, 9.925, 5.841, 4.604, 4.032, 3.707, 3.499, 3.355, 3.250, 3.169,
+         3.106, 3.055, 3.012, 2.977, 2.947, 2.921, 2.898, 2.878, 2.861, 2.845,
+         2.831, 2.819, 2.807, 2.797, 2.787, 2.779, 2.771, 2.763, 2.756, 2.750],
+}
+Z_TABLE = { 0.90: 1.645, 0.95: 1.960, 0.99: 2.576 }
+
+def t_quantile(conf, dof):
+  if dof < 1:
+    dof = 1
+  table = T_TABLE[conf]
+  if dof > len(table):
+    return Z_TABLE[conf]
+  return table[int(dof) - 1]
+
+def mean_var(xs):
+  n = len(xs)
+  m = sum(xs) / n
+  if n < 2:
+    return m, None
+  return m, sum((x - m) ** 2 for x in xs) / (n - 1)
+
+#-------------------------------------------------------------------------
+# Confidence interval of the mean difference cur - base (Welch). With a
+# single sample on one side its variance is taken from the other side,
+# with single samples on both sides the interval is the point estimate.
+#-------------------------------------------------------------------------
+def diff_interval(base, cur, conf):
+  nb, nc = len(base), len(cur)
+  mb, vb = mean_var(base)
+  mc, vc = mean_var(cur)
+  if vb is None and vc is None:
+    return mb, mc, mc - mb, mc - mb
+  if vb is None: vb = vc
+  if vc is None: vc = vb
+  sb, sc = vb / nb, vc / nc
+  se = math.sqrt(sb + sc)
+  if se == 0:
+    return mb, mc, mc - mb, mc - mb
+  dof = (sb + sc) ** 2 / ((sb ** 2) / max(nb - 1, 1) + (sc ** 2) / max(nc - 1, 1))
+  h = t_quantile(conf, dof) * se
+  return mb, mc, mc - mb - h, mc - mb + h
+
+def load_report(path):
+  try:
+    with open(path) as f:
+      r = json.load(f)
+  except (IOError, ValueError) as e:
+    print("**** ERROR: cannot read %s: %s" % (path, e), file=sys.stderr)
+    sys.exit(2)
+  if "metrics" not in r:
+    print("**** ERROR: %s is not a benchmark report" % path, file=sys.stderr)
+    sys.exit(2)
+  return r
+
+def samples(m):
+  return [float(x) for x in m.get("samples", []) if x is not None]
+
+def parse_thresholds(items):
+  out = []
+  for it in items:
+    pattern, _, pct = it.rpartition("=")
+    if not pattern:
+      print("**** ERROR: expected <regex>=<percent>, got %s" % it, file=sys.stderr)
+      sys.exit(2)
+    out.append((re.compile(pattern), float(pct)))
+  return out
+
+if __name__ == "__main__":
+  ap = argparse.ArgumentParser(description="Compare a benchmark report with a baseline.")
+  ap.add_argument("baseline")
+  ap.add_argument("current")
+  ap.add_argument("-t", "--threshold", type=float, default=5.0,
+                  help="allowed worsening in percent (default 5)")
+  ap.add_argument("-m", "--metric-threshold", action="append", default=[],
+                  metavar="REGEX=PCT", help="threshold of the metrics matching REGEX, "
+                  "the last match wins")
+  ap.add_argument("-c", "--confidence", type=float, default=0.95,
+                  choices=sorted(T_TABLE.keys()), help="confidence level (default 0.95)")
+  ap.add_argument("-n", "--min-samples", type=int, default=2,
+                  help="samples per side a metric needs to fail the run (default 2), "
+                  "metrics with fewer are only reported")
+  ap.add_argument("-i", "--ignore", action="append", default=[], metavar="REGEX",
+                  help="skip the metrics matching REGEX")
+  ap.add_argument("-a", "--all", action="store_true",
+                  help="print every metric, not only the ones that moved")
+  args = ap.parse_args()
+
+  base = load_report(args.baseline)
+  cur = load_report(args.current)
+  thresholds = parse_thresholds(args.metric_threshold)
+  ignore = [re.compile(p) for p in args.ignore]
+
+  if base.get("bench") != cur.get("bench"):
+    print("**** WARNING: comparing bench %s with %s" % (base.get("bench"), cur.get("bench")))
+  bc, cc = base.get("config", {}), cur.get("config", {})
+  for k in sorted(set(bc) | set(cc)):
+    if k not in ("repeat",) and bc.get(k) != cc.get(k):
+      print("**** WARNING: config %s differs: %s -> %s" % (k, bc.get(k), cc.get(k)))
+
+  #-----------------------------------------------------------------------
+  # Compare every metric of the baseline
+  #-----------------------------------------------------------------------
+  rows = []
+  regressions = []
+  for name in sorted(base["metrics"]):
+    if any(p.search(name) for p in ignore):
+      continue
+    bm = base["metrics"][name]
+    if name not in cur["metrics"]:
+      print("**** WARNING: %s missing from %s" % (name, args.current))
+      continue
+    cm = cur["metrics"][name]
+    bs, cs = samples(bm), samples(cm)
+    if not bs or not cs:
+      continue
+    limit = args.threshold
+    for p, pct in thresholds:
+      if p.search(name):
+        limit = pct
+
+    mb, mc, lo, hi = diff_interval(bs, cs, args.confidence)
+    # worsening in percent of the baseline, interval [w_lo, w_hi]. A zero
+    # baseline has no relative change: the worsening is taken in the
+    # metric's unit and any of it beyond the interval counts.
+    sign = -1.0 if bm.get("better") == "higher" else 1.0
+    scale = 100 / abs(mb) if mb != 0 else 1.0
+    if mb == 0:
+      limit = 0.0
+    w_lo, w_hi = sorted((scale * sign * lo, scale * sign * hi))
+    w = scale * sign * (mc - mb)
+
+    gated = min(len(bs), len(cs)) >= args.min_samples
+    if w_lo > limit and gated:
+      status = "REGRESSION"
+      regressions.append(name)
+    elif w_lo > limit:
+      status = "worse (few samples)"
+    elif w_hi < -limit:
+      status = "improved"
+    elif w_lo > 0 or w_hi < 0:
+      status = "moved"
+    else:
+      status = "ok"
+    if mb == 0 and status != "ok":
+      status += " (from 0, in %s)" % (bm.get("unit", "") or "units")
+    rows.append((name, bm.get("unit", ""), mb, mc, w, w_lo, w_hi, limit,
+                 len(bs), len(cs), status))
+
+  print("%-36s %9s %12s %12s %8s %19s %6s %5s  %s" % ("metric", "unit",
+      "baseline", "current", "worse%", "interval%", "limit", "n", "status"))
+  for r in sorted(rows, key=lambda r: -r[4]):
+    if args.all or r[10] != "ok":
+      print("%-36s %9s %12.4g %12.4g %+8.2f [%+8.2f,%+8.2f] %6.1f %2d/%-2d  %s" % r)
+
+  print("")
+  if regressions:
+    print("%d of %d metrics regressed beyond their limit at %g%% confidence: %s" %
+        (len(regressions), len(rows), 100 * args.confidence, ", ".join(regressions)))
+    sys.exit(1)
+  print("No regressions in %d metrics at %g%% confidence" % (len(rows), 100 * args.confidence))